@@ -1,12 +1,17 @@
 #include "devices/disk.h"
 #include <ctype.h>
 #include <debug.h>
+#include <round.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
    controller.  It attempts to comply to [ATA-3]. */
@@ -55,7 +60,8 @@ struct disk {
 	int dev_no;                 /* Device 0 or 1 for master or slave. */
 
 	bool is_ata;                /* 1=This device is an ATA disk. */
-	disk_sector_t capacity;     /* Capacity in sectors (if is_ata). */
+	disk_sector_t capacity;     /* Capacity in sectors (if is_ata or ram). */
+	uint8_t **ram;              /* Backing pages if this is a RAM disk. */
 
 	long long read_cnt;         /* Number of sectors read. */
 	long long write_cnt;        /* Number of sectors written. */
@@ -80,11 +86,19 @@ struct channel {
 #define CHANNEL_CNT 2
 static struct channel channels[CHANNEL_CNT];
 
+/* Sectors held by each page of a RAM disk. */
+#define SECTORS_PER_PAGE (PGSIZE / DISK_SECTOR_SIZE)
+
+/* Requested RAM disk sizes, in sectors, indexed by
+   [chan_no][dev_no].  Filled in from the kernel command line
+   before disk_init() runs; zero means "use the IDE device". */
+static disk_sector_t ramdisk_sectors[CHANNEL_CNT][2];
+
 static void reset_channel (struct channel *);
 static bool check_device_type (struct disk *);
 static void identify_ata_device (struct disk *);
 
-static void select_sector (struct disk *, disk_sector_t);
+static void select_sector (struct disk *, disk_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
@@ -96,6 +110,9 @@ static void select_device_wait (const struct disk *);
 
 static void interrupt_handler (struct intr_frame *);
 
+static void ramdisk_init (struct disk *, disk_sector_t);
+static uint8_t *ramdisk_sector (struct disk *, disk_sector_t);
+
 /* Initialize the disk subsystem and detect disks. */
 void
 disk_init (void) {
@@ -132,6 +149,7 @@ disk_init (void) {
 
 			d->is_ata = false;
 			d->capacity = 0;
+			d->ram = NULL;
 
 			d->read_cnt = d->write_cnt = 0;
 		}
@@ -150,6 +168,12 @@ disk_init (void) {
 		for (dev_no = 0; dev_no < 2; dev_no++)
 			if (c->devices[dev_no].is_ata)
 				identify_ata_device (&c->devices[dev_no]);
+
+		/* Put RAM disks in place of the devices they replace. */
+		for (dev_no = 0; dev_no < 2; dev_no++)
+			if (ramdisk_sectors[chan_no][dev_no] > 0)
+				ramdisk_init (&c->devices[dev_no],
+						ramdisk_sectors[chan_no][dev_no]);
 	}
 
 	/* DO NOT MODIFY BELOW LINES. */
@@ -166,7 +190,7 @@ disk_print_stats (void) {
 
 		for (dev_no = 0; dev_no < 2; dev_no++) {
 			struct disk *d = disk_get (chan_no, dev_no);
-			if (d != NULL && d->is_ata)
+			if (d != NULL)
 				printf ("%s: %lld reads, %lld writes\n",
 						d->name, d->read_cnt, d->write_cnt);
 		}
@@ -181,19 +205,42 @@ disk_print_stats (void) {
 0:1 - file system
 1:0 - scratch
 1:1 - swap
-*/
+
+Any of the last three may be a RAM disk instead; see
+disk_set_ramdisk(). */
 struct disk *
 disk_get (int chan_no, int dev_no) {
 	ASSERT (dev_no == 0 || dev_no == 1);
 
 	if (chan_no < (int) CHANNEL_CNT) {
 		struct disk *d = &channels[chan_no].devices[dev_no];
-		if (d->is_ata)
+		if (d->is_ata || d->ram != NULL)
 			return d;
 	}
 	return NULL;
 }
 
+/* Requests that the disk in ROLE, one of "fs", "scratch" or
+   "swap", be replaced by a RAM disk of SECTORS sectors.  Must be
+   called before disk_init(), i.e. while parsing the kernel
+   command line.  Returns false if ROLE is unknown. */
+bool
+disk_set_ramdisk (const char *role, disk_sector_t sectors) {
+	int chan_no, dev_no;
+
+	if (!strcmp (role, "fs"))
+		chan_no = 0, dev_no = 1;
+	else if (!strcmp (role, "scratch"))
+		chan_no = 1, dev_no = 0;
+	else if (!strcmp (role, "swap"))
+		chan_no = 1, dev_no = 1;
+	else
+		return false;
+
+	ramdisk_sectors[chan_no][dev_no] = sectors;
+	return true;
+}
+
 /* Returns the size of disk D, measured in DISK_SECTOR_SIZE-byte
    sectors. */
 disk_sector_t
@@ -209,47 +256,99 @@ disk_size (struct disk *d) {
    per-disk locking is unneeded. */
 void
 disk_read (struct disk *d, disk_sector_t sec_no, void *buffer) {
+	disk_read_multiple (d, sec_no, buffer, 1);
+}
+
+/* Write sector SEC_NO to disk D from BUFFER, which must contain
+   DISK_SECTOR_SIZE bytes.  Returns after the disk has
+   acknowledged receiving the data.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+void
+disk_write (struct disk *d, disk_sector_t sec_no, const void *buffer) {
+	disk_write_multiple (d, sec_no, buffer, 1);
+}
+
+/* Reads CNT consecutive sectors starting at SEC_NO from disk D
+   into BUFFER, which must have room for CNT * DISK_SECTOR_SIZE
+   bytes.  The sectors are transferred with a single command, so
+   this is much cheaper than CNT calls to disk_read().  CNT must
+   be between 1 and DISK_MAX_SECTORS. */
+void
+disk_read_multiple (struct disk *d, disk_sector_t sec_no, void *buffer,
+		size_t cnt) {
 	struct channel *c;
+	uint8_t *p = buffer;
+	size_t i;
 
 	ASSERT (d != NULL);
 	ASSERT (buffer != NULL);
+	ASSERT (cnt >= 1 && cnt <= DISK_MAX_SECTORS);
 
 	c = d->channel;
 	lock_acquire (&c->lock);
-	select_sector (d, sec_no);
+	if (d->ram != NULL) {
+		for (i = 0; i < cnt; i++)
+			memcpy (p + i * DISK_SECTOR_SIZE, ramdisk_sector (d, sec_no + i),
+					DISK_SECTOR_SIZE);
+		d->read_cnt += cnt;
+		lock_release (&c->lock);
+		return;
+	}
+	select_sector (d, sec_no, cnt);
 	issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-	sema_down (&c->completion_wait);
-	if (!wait_while_busy (d))
-		PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-	input_sector (c, buffer);
-	d->read_cnt++;
+	/* The drive interrupts once for each sector it has ready. */
+	for (i = 0; i < cnt; i++) {
+		sema_down (&c->completion_wait);
+		if (!wait_while_busy (d))
+			PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name,
+					(disk_sector_t) (sec_no + i));
+		input_sector (c, p + i * DISK_SECTOR_SIZE);
+	}
+	d->read_cnt += cnt;
 	lock_release (&c->lock);
 }
 
-/* Write sector SEC_NO to disk D from BUFFER, which must contain
-   DISK_SECTOR_SIZE bytes.  Returns after the disk has
-   acknowledged receiving the data.
-   Internally synchronizes accesses to disks, so external
-   per-disk locking is unneeded. */
+/* Writes CNT consecutive sectors starting at SEC_NO to disk D
+   from BUFFER, which must contain CNT * DISK_SECTOR_SIZE bytes,
+   with a single command.  Returns after the disk has
+   acknowledged receiving all of the data.  CNT must be between 1
+   and DISK_MAX_SECTORS. */
 void
-disk_write (struct disk *d, disk_sector_t sec_no, const void *buffer) {
+disk_write_multiple (struct disk *d, disk_sector_t sec_no,
+		const void *buffer, size_t cnt) {
 	struct channel *c;
+	const uint8_t *p = buffer;
+	size_t i;
 
 	ASSERT (d != NULL);
 	ASSERT (buffer != NULL);
+	ASSERT (cnt >= 1 && cnt <= DISK_MAX_SECTORS);
 
 	c = d->channel;
 	lock_acquire (&c->lock);
-	select_sector (d, sec_no);
+	if (d->ram != NULL) {
+		for (i = 0; i < cnt; i++)
+			memcpy (ramdisk_sector (d, sec_no + i), p + i * DISK_SECTOR_SIZE,
+					DISK_SECTOR_SIZE);
+		d->write_cnt += cnt;
+		lock_release (&c->lock);
+		return;
+	}
+	select_sector (d, sec_no, cnt);
 	issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-	if (!wait_while_busy (d))
-		PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-	output_sector (c, buffer);
-	sema_down (&c->completion_wait);
-	d->write_cnt++;
+	/* The drive interrupts once it has taken each sector. */
+	for (i = 0; i < cnt; i++) {
+		if (!wait_while_busy (d))
+			PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name,
+					(disk_sector_t) (sec_no + i));
+		output_sector (c, p + i * DISK_SECTOR_SIZE);
+		sema_down (&c->completion_wait);
+	}
+	d->write_cnt += cnt;
 	lock_release (&c->lock);
 }
-
+
 /* Disk detection and identification. */
 
 static void print_ata_string (char *string, size_t size);
@@ -401,18 +500,55 @@ print_ata_string (char *string, size_t size) {
 		printf ("%c", string[i ^ 1]);
 }
 
+/* RAM disks. */
+
+/* Turns D into a RAM disk of SECTORS zeroed sectors, hiding any
+   IDE device detected in its place.  The backing store is
+   allocated page by page from the kernel pool, so it need not be
+   physically contiguous. */
+static void
+ramdisk_init (struct disk *d, disk_sector_t sectors) {
+	size_t page_cnt = DIV_ROUND_UP (sectors, SECTORS_PER_PAGE);
+	size_t i;
+
+	d->ram = calloc (page_cnt, sizeof *d->ram);
+	if (d->ram == NULL)
+		PANIC ("%s: out of memory for RAM disk", d->name);
+	for (i = 0; i < page_cnt; i++) {
+		d->ram[i] = palloc_get_page (PAL_ZERO);
+		if (d->ram[i] == NULL)
+			PANIC ("%s: out of memory for %'"PRDSNu"-sector RAM disk",
+					d->name, sectors);
+	}
+
+	d->is_ata = false;
+	d->capacity = sectors;
+	printf ("%s: using %'"PRDSNu" sector (%zu kB) RAM disk\n",
+			d->name, sectors, page_cnt * PGSIZE / 1024);
+}
+
+/* Returns the address of sector SEC_NO within RAM disk D. */
+static uint8_t *
+ramdisk_sector (struct disk *d, disk_sector_t sec_no) {
+	ASSERT (sec_no < d->capacity);
+
+	return d->ram[sec_no / SECTORS_PER_PAGE]
+		+ sec_no % SECTORS_PER_PAGE * DISK_SECTOR_SIZE;
+}
+
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and CNT to the disk's sector selection registers.
+   (We use LBA mode.) */
 static void
-select_sector (struct disk *d, disk_sector_t sec_no) {
+select_sector (struct disk *d, disk_sector_t sec_no, size_t cnt) {
 	struct channel *c = d->channel;
 
-	ASSERT (sec_no < d->capacity);
-	ASSERT (sec_no < (1UL << 28));
+	ASSERT (cnt >= 1 && cnt <= DISK_MAX_SECTORS);
+	ASSERT (sec_no + cnt <= d->capacity);
+	ASSERT (sec_no + cnt <= (1UL << 28));
 
 	select_device_wait (d);
-	outb (reg_nsect (c), 1);
+	outb (reg_nsect (c), cnt);    /* 256 wraps to 0, which means 256. */
 	outb (reg_lbal (c), sec_no);
 	outb (reg_lbam (c), sec_no >> 8);
 	outb (reg_lbah (c), (sec_no >> 16));
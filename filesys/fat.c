@@ -1,8 +1,10 @@
 #include "filesys/fat.h"
+#include <bitmap.h>
 #include "devices/disk.h"
 #include "filesys/filesys.h"
 #include "threads/malloc.h"
 #include "threads/synch.h"
+#include <round.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -16,14 +18,40 @@ struct fat_boot {
 	unsigned int root_dir_cluster;
 };
 
+/* Number of FAT entries in one FAT sector. */
+#define ENTRIES_PER_SECTOR (DISK_SECTOR_SIZE / sizeof (cluster_t))
+
+/* Number of FAT sectors kept in memory. */
+#define FAT_CACHE_SIZE 32
+
+/* A FAT sector held in memory. */
+struct fat_cache_slot {
+	unsigned int idx;     /* FAT sector number, relative to fat_start. */
+	bool valid;           /* Holds a sector? */
+	bool dirty;           /* Changed since read from disk? */
+	bool accessed;        /* Used since the clock hand last passed? */
+	cluster_t entries[ENTRIES_PER_SECTOR];
+};
+
 /* FAT FS */
 struct fat_fs {
 	struct fat_boot bs;
-	unsigned int *fat;
 	unsigned int fat_length;
 	disk_sector_t data_start;
-	cluster_t last_clst;
-	struct lock write_lock;
+	cluster_t last_clst;        /* Where the next free cluster search starts. */
+	struct lock write_lock;     /* Protects everything below. */
+
+	/* The FAT is only read and written a sector at a time through
+	 * this cache, so mounting does not read the whole table. */
+	struct fat_cache_slot *cache;
+	size_t clock_hand;
+
+	/* Free clusters, one bit per FAT entry.  The bits of a FAT
+	 * sector are only filled in once that sector has been scanned,
+	 * the first time allocation runs out of known free clusters. */
+	struct bitmap *free_map;
+	struct bitmap *scanned;     /* FAT sectors reflected in free_map. */
+	size_t free_cnt;            /* Number of set bits in free_map. */
 };
 
 static struct fat_fs *fat_fs;
@@ -31,6 +59,14 @@ static struct fat_fs *fat_fs;
 void fat_boot_create (void);
 void fat_fs_init (void);
 
+static void fat_cache_open (void);
+static void fat_cache_flush (void);
+static cluster_t *fat_entry (cluster_t clst, bool write);
+static cluster_t fat_read (cluster_t clst);
+static void fat_write (cluster_t clst, cluster_t val);
+static cluster_t fat_alloc_cluster (void);
+static bool fat_scan_sector (void);
+
 void
 fat_init (void) {
 	fat_fs = calloc (1, sizeof (struct fat_fs));
@@ -51,33 +87,11 @@ fat_init (void) {
 	fat_fs_init ();
 }
 
+/* Gets the FAT ready for use.  Nothing is read from the FAT
+ * itself: its sectors are cached as they are touched. */
 void
 fat_open (void) {
-	fat_fs->fat = calloc (fat_fs->fat_length, sizeof (cluster_t));
-	if (fat_fs->fat == NULL)
-		PANIC ("FAT load failed");
-
-	// Load FAT directly from the disk
-	uint8_t *buffer = (uint8_t *) fat_fs->fat;
-	off_t bytes_read = 0;
-	off_t bytes_left = sizeof (fat_fs->fat);
-	const off_t fat_size_in_bytes = fat_fs->fat_length * sizeof (cluster_t);
-	for (unsigned i = 0; i < fat_fs->bs.fat_sectors; i++) {
-		bytes_left = fat_size_in_bytes - bytes_read;
-		if (bytes_left >= DISK_SECTOR_SIZE) {
-			disk_read (filesys_disk, fat_fs->bs.fat_start + i,
-			           buffer + bytes_read);
-			bytes_read += DISK_SECTOR_SIZE;
-		} else {
-			uint8_t *bounce = malloc (DISK_SECTOR_SIZE);
-			if (bounce == NULL)
-				PANIC ("FAT load failed");
-			disk_read (filesys_disk, fat_fs->bs.fat_start + i, bounce);
-			memcpy (buffer + bytes_read, bounce, bytes_left);
-			bytes_read += bytes_left;
-			free (bounce);
-		}
-	}
+	fat_cache_open ();
 }
 
 void
@@ -90,27 +104,15 @@ fat_close (void) {
 	disk_write (filesys_disk, FAT_BOOT_SECTOR, bounce);
 	free (bounce);
 
-	// Write FAT directly to the disk
-	uint8_t *buffer = (uint8_t *) fat_fs->fat;
-	off_t bytes_wrote = 0;
-	off_t bytes_left = sizeof (fat_fs->fat);
-	const off_t fat_size_in_bytes = fat_fs->fat_length * sizeof (cluster_t);
-	for (unsigned i = 0; i < fat_fs->bs.fat_sectors; i++) {
-		bytes_left = fat_size_in_bytes - bytes_wrote;
-		if (bytes_left >= DISK_SECTOR_SIZE) {
-			disk_write (filesys_disk, fat_fs->bs.fat_start + i,
-			            buffer + bytes_wrote);
-			bytes_wrote += DISK_SECTOR_SIZE;
-		} else {
-			bounce = calloc (1, DISK_SECTOR_SIZE);
-			if (bounce == NULL)
-				PANIC ("FAT close failed");
-			memcpy (bounce, buffer + bytes_wrote, bytes_left);
-			disk_write (filesys_disk, fat_fs->bs.fat_start + i, bounce);
-			bytes_wrote += bytes_left;
-			free (bounce);
-		}
-	}
+	// Write back the FAT sectors that changed
+	lock_acquire (&fat_fs->write_lock);
+	fat_cache_flush ();
+	free (fat_fs->cache);
+	bitmap_destroy (fat_fs->free_map);
+	bitmap_destroy (fat_fs->scanned);
+	fat_fs->cache = NULL;
+	fat_fs->free_map = fat_fs->scanned = NULL;
+	lock_release (&fat_fs->write_lock);
 }
 
 void
@@ -119,18 +121,18 @@ fat_create (void) {
 	fat_boot_create ();
 	fat_fs_init ();
 
-	// Create FAT table
-	fat_fs->fat = calloc (fat_fs->fat_length, sizeof (cluster_t));
-	if (fat_fs->fat == NULL)
-		PANIC ("FAT creation failed");
+	// Create FAT table, all clusters free
+	uint8_t *buf = calloc (1, DISK_SECTOR_SIZE);
+	if (buf == NULL)
+		PANIC ("FAT create failed due to OOM");
+	for (unsigned i = 0; i < fat_fs->bs.fat_sectors; i++)
+		disk_write (filesys_disk, fat_fs->bs.fat_start + i, buf);
+	fat_cache_open ();
 
 	// Set up ROOT_DIR_CLST
 	fat_put (ROOT_DIR_CLUSTER, EOChain);
 
 	// Fill up ROOT_DIR_CLUSTER region with 0
-	uint8_t *buf = calloc (1, DISK_SECTOR_SIZE);
-	if (buf == NULL)
-		PANIC ("FAT create failed due to OOM");
 	disk_write (filesys_disk, cluster_to_sector (ROOT_DIR_CLUSTER), buf);
 	free (buf);
 }
@@ -152,7 +154,19 @@ fat_boot_create (void) {
 
 void
 fat_fs_init (void) {
-	/* TODO: Your code goes here. */
+	/* Cluster 0 means "free", so clusters are numbered from 1 and
+	 * cluster N lives at data_start + (N - 1) * SECTORS_PER_CLUSTER.
+	 * The FAT has an entry for every cluster that fits on the disk
+	 * and in the FAT. */
+	unsigned int data_sectors;
+
+	fat_fs->data_start = fat_fs->bs.fat_start + fat_fs->bs.fat_sectors;
+	data_sectors = fat_fs->bs.total_sectors - fat_fs->data_start;
+	fat_fs->fat_length = data_sectors / SECTORS_PER_CLUSTER + 1;
+	if (fat_fs->fat_length > fat_fs->bs.fat_sectors * ENTRIES_PER_SECTOR)
+		fat_fs->fat_length = fat_fs->bs.fat_sectors * ENTRIES_PER_SECTOR;
+	fat_fs->last_clst = ROOT_DIR_CLUSTER;
+	lock_init (&fat_fs->write_lock);
 }
 
 /*----------------------------------------------------------------------------*/
@@ -164,30 +178,211 @@ fat_fs_init (void) {
  * Returns 0 if fails to allocate a new cluster. */
 cluster_t
 fat_create_chain (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	cluster_t new_clst;
+
+	ASSERT (clst < fat_fs->fat_length);
+
+	lock_acquire (&fat_fs->write_lock);
+	new_clst = fat_alloc_cluster ();
+	if (new_clst != 0) {
+		fat_write (new_clst, EOChain);
+		if (clst != 0)
+			fat_write (clst, new_clst);
+	}
+	lock_release (&fat_fs->write_lock);
+	return new_clst;
 }
 
 /* Remove the chain of clusters starting from CLST.
  * If PCLST is 0, assume CLST as the start of the chain. */
 void
 fat_remove_chain (cluster_t clst, cluster_t pclst) {
-	/* TODO: Your code goes here. */
+	lock_acquire (&fat_fs->write_lock);
+	if (pclst != 0)
+		fat_write (pclst, EOChain);
+	while (clst != 0 && clst != EOChain) {
+		cluster_t next = fat_read (clst);
+		fat_write (clst, 0);
+		clst = next;
+	}
+	lock_release (&fat_fs->write_lock);
 }
 
 /* Update a value in the FAT table. */
 void
 fat_put (cluster_t clst, cluster_t val) {
-	/* TODO: Your code goes here. */
+	lock_acquire (&fat_fs->write_lock);
+	fat_write (clst, val);
+	lock_release (&fat_fs->write_lock);
 }
 
 /* Fetch a value in the FAT table. */
 cluster_t
 fat_get (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	cluster_t val;
+
+	lock_acquire (&fat_fs->write_lock);
+	val = fat_read (clst);
+	lock_release (&fat_fs->write_lock);
+	return val;
 }
 
 /* Covert a cluster # to a sector number. */
 disk_sector_t
 cluster_to_sector (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	ASSERT (clst >= 1 && clst < fat_fs->fat_length);
+	return fat_fs->data_start + (clst - 1) * SECTORS_PER_CLUSTER;
+}
+
+/* Convert a sector number inside the data area to its cluster #. */
+cluster_t
+sector_to_cluster (disk_sector_t sector) {
+	ASSERT (sector >= fat_fs->data_start);
+	return (sector - fat_fs->data_start) / SECTORS_PER_CLUSTER + 1;
+}
+
+/*----------------------------------------------------------------------------*/
+/* FAT sector cache and free cluster map                                      */
+/*----------------------------------------------------------------------------*/
+
+/* Sets up an empty FAT sector cache and free cluster map. */
+static void
+fat_cache_open (void) {
+	fat_fs->cache = calloc (FAT_CACHE_SIZE, sizeof *fat_fs->cache);
+	fat_fs->free_map = bitmap_create (fat_fs->fat_length);
+	/* Only the sectors that hold entries below fat_length, which may
+	 * end before the last FAT sector. */
+	fat_fs->scanned = bitmap_create (DIV_ROUND_UP (fat_fs->fat_length,
+				ENTRIES_PER_SECTOR));
+	if (fat_fs->cache == NULL || fat_fs->free_map == NULL
+			|| fat_fs->scanned == NULL)
+		PANIC ("FAT load failed");
+	fat_fs->clock_hand = 0;
+	fat_fs->free_cnt = 0;
+}
+
+/* Writes every dirty cached FAT sector back to disk.
+ * The FAT lock must be held. */
+static void
+fat_cache_flush (void) {
+	for (size_t i = 0; i < FAT_CACHE_SIZE; i++) {
+		struct fat_cache_slot *slot = &fat_fs->cache[i];
+		if (slot->valid && slot->dirty) {
+			disk_write (filesys_disk, fat_fs->bs.fat_start + slot->idx,
+			            slot->entries);
+			slot->dirty = false;
+		}
+	}
+}
+
+/* Returns the FAT entry for CLST in the cache, reading in its
+ * sector if needed and evicting another with the clock
+ * algorithm.  If WRITE is true, the sector is marked dirty.
+ * The FAT lock must be held. */
+static cluster_t *
+fat_entry (cluster_t clst, bool write) {
+	unsigned int idx = clst / ENTRIES_PER_SECTOR;
+	struct fat_cache_slot *slot = NULL;
+
+	ASSERT (lock_held_by_current_thread (&fat_fs->write_lock));
+	ASSERT (clst < fat_fs->fat_length);
+
+	for (size_t i = 0; i < FAT_CACHE_SIZE; i++)
+		if (fat_fs->cache[i].valid && fat_fs->cache[i].idx == idx) {
+			slot = &fat_fs->cache[i];
+			break;
+		}
+
+	if (slot == NULL) {
+		for (;;) {
+			slot = &fat_fs->cache[fat_fs->clock_hand];
+			fat_fs->clock_hand = (fat_fs->clock_hand + 1) % FAT_CACHE_SIZE;
+			if (!slot->valid || !slot->accessed)
+				break;
+			slot->accessed = false;
+		}
+		if (slot->valid && slot->dirty)
+			disk_write (filesys_disk, fat_fs->bs.fat_start + slot->idx,
+			            slot->entries);
+		disk_read (filesys_disk, fat_fs->bs.fat_start + idx, slot->entries);
+		slot->idx = idx;
+		slot->valid = true;
+		slot->dirty = false;
+	}
+
+	slot->accessed = true;
+	if (write)
+		slot->dirty = true;
+	return &slot->entries[clst % ENTRIES_PER_SECTOR];
+}
+
+/* Returns the FAT entry for CLST.
+ * The FAT lock must be held. */
+static cluster_t
+fat_read (cluster_t clst) {
+	return *fat_entry (clst, false);
+}
+
+/* Sets the FAT entry for CLST to VAL, keeping the free cluster
+ * map up to date.  The FAT lock must be held. */
+static void
+fat_write (cluster_t clst, cluster_t val) {
+	cluster_t *entry = fat_entry (clst, true);
+	bool was_free = *entry == 0;
+
+	*entry = val;
+	if (clst != 0 && was_free != (val == 0)
+			&& bitmap_test (fat_fs->scanned, clst / ENTRIES_PER_SECTOR)) {
+		bitmap_set (fat_fs->free_map, clst, val == 0);
+		if (val == 0)
+			fat_fs->free_cnt++;
+		else
+			fat_fs->free_cnt--;
+	}
+}
+
+/* Finds a free cluster, searching onward from the last one
+ * handed out.  Returns 0 if the disk is full.  The cluster is not
+ * marked used until its FAT entry is written.
+ * The FAT lock must be held. */
+static cluster_t
+fat_alloc_cluster (void) {
+	for (;;) {
+		if (fat_fs->free_cnt > 0) {
+			size_t clst = bitmap_scan (fat_fs->free_map, fat_fs->last_clst, 1, true);
+			if (clst == BITMAP_ERROR)
+				clst = bitmap_scan (fat_fs->free_map, 0, 1, true);
+			ASSERT (clst != BITMAP_ERROR);
+			fat_fs->last_clst = clst;
+			return clst;
+		}
+		if (!fat_scan_sector ())
+			return 0;
+	}
+}
+
+/* Adds the free clusters of the next FAT sector that has not
+ * been scanned yet to the free cluster map.  Returns false if
+ * every sector has been scanned already.
+ * The FAT lock must be held. */
+static bool
+fat_scan_sector (void) {
+	size_t idx = bitmap_scan_and_flip (fat_fs->scanned, 0, 1, false);
+	cluster_t first, last;
+	cluster_t *entries;
+
+	if (idx == BITMAP_ERROR)
+		return false;
+
+	first = idx * ENTRIES_PER_SECTOR;
+	last = first + ENTRIES_PER_SECTOR;
+	if (last > fat_fs->fat_length)
+		last = fat_fs->fat_length;
+	entries = fat_entry (first, false);
+	for (cluster_t clst = first == 0 ? 1 : first; clst < last; clst++)
+		if (entries[clst - first] == 0) {
+			bitmap_mark (fat_fs->free_map, clst);
+			fat_fs->free_cnt++;
+		}
+	return true;
 }
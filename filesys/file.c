@@ -6,9 +6,29 @@
 /* An open file. */
 struct file
 {
-	struct inode *inode; /* File's inode. */
-	off_t pos;			 /* Current position. */
-	bool deny_write;	 /* Has file_deny_write() been called? */
+	const struct file_operations *ops; /* Operations on OBJ. */
+	void *obj;						   /* Backing object, e.g. inode. */
+	off_t pos;						   /* Current position. */
+	bool deny_write;				   /* Has file_deny_write() been called? */
+};
+
+static void *inode_file_reopen(void *);
+static void inode_file_close(void *);
+static off_t inode_file_read_at(void *, void *, off_t, off_t);
+static off_t inode_file_write_at(void *, const void *, off_t, off_t);
+static off_t inode_file_length(void *);
+static void inode_file_deny_write(void *);
+static void inode_file_allow_write(void *);
+
+/* Operations of files backed by an on-disk inode. */
+static const struct file_operations inode_file_ops = {
+	.reopen = inode_file_reopen,
+	.close = inode_file_close,
+	.read_at = inode_file_read_at,
+	.write_at = inode_file_write_at,
+	.length = inode_file_length,
+	.deny_write = inode_file_deny_write,
+	.allow_write = inode_file_allow_write,
 };
 
 /* Opens a file for the given INODE, of which it takes ownership,
@@ -17,19 +37,30 @@ struct file
 
 struct file *
 file_open(struct inode *inode)
+{
+	return file_open_obj(&inode_file_ops, inode);
+}
+
+/* Opens a file for OBJ, which is operated on through OPS and of
+ * which the file takes ownership, and returns the new file.
+ * Returns a null pointer if an allocation fails or if OBJ is
+ * null. */
+struct file *
+file_open_obj(const struct file_operations *ops, void *obj)
 {
 	struct file *file = calloc(1, sizeof *file);
-	// printf("file_size : %d\n", sizeof *file);
-	if (inode != NULL && file != NULL)
+	if (obj != NULL && file != NULL)
 	{
-		file->inode = inode;
+		file->ops = ops;
+		file->obj = obj;
 		file->pos = 0;
 		file->deny_write = false;
 		return file;
 	}
 	else
 	{
-		inode_close(inode);
+		if (obj != NULL)
+			ops->close(obj);
 		free(file);
 		return NULL;
 	}
@@ -40,7 +71,7 @@ file_open(struct inode *inode)
 struct file *
 file_reopen(struct file *file)
 {
-	return file_open(inode_reopen(file->inode));
+	return file_open_obj(file->ops, file->ops->reopen(file->obj));
 }
 
 /* Duplicate the file object including attributes and returns a new file for the
@@ -48,7 +79,7 @@ file_reopen(struct file *file)
 struct file *
 file_duplicate(struct file *file)
 {
-	struct file *nfile = file_open(inode_reopen(file->inode));
+	struct file *nfile = file_reopen(file);
 	if (nfile)
 	{
 		nfile->pos = file->pos;
@@ -64,16 +95,17 @@ void file_close(struct file *file)
 	if (file != NULL)
 	{
 		file_allow_write(file);
-		inode_close(file->inode);
+		file->ops->close(file->obj);
 		free(file);
 	}
 }
 
-/* Returns the inode encapsulated by FILE. */
+/* Returns the inode encapsulated by FILE, or a null pointer if
+ * FILE does not live on the disk file system. */
 struct inode *
 file_get_inode(struct file *file)
 {
-	return file->inode;
+	return file->ops == &inode_file_ops ? file->obj : NULL;
 }
 
 /* Reads SIZE bytes from FILE into BUFFER,
@@ -83,7 +115,7 @@ file_get_inode(struct file *file)
  * Advances FILE's position by the number of bytes read. */
 off_t file_read(struct file *file, void *buffer, off_t size)
 {
-	off_t bytes_read = inode_read_at(file->inode, buffer, size, file->pos);
+	off_t bytes_read = file->ops->read_at(file->obj, buffer, size, file->pos);
 	file->pos += bytes_read;
 	return bytes_read;
 }
@@ -95,7 +127,7 @@ off_t file_read(struct file *file, void *buffer, off_t size)
  * The file's current position is unaffected. */
 off_t file_read_at(struct file *file, void *buffer, off_t size, off_t file_ofs)
 {
-	return inode_read_at(file->inode, buffer, size, file_ofs);
+	return file->ops->read_at(file->obj, buffer, size, file_ofs);
 }
 
 /* Writes SIZE bytes from BUFFER into FILE,
@@ -107,7 +139,7 @@ off_t file_read_at(struct file *file, void *buffer, off_t size, off_t file_ofs)
  * Advances FILE's position by the number of bytes read. */
 off_t file_write(struct file *file, const void *buffer, off_t size)
 {
-	off_t bytes_written = inode_write_at(file->inode, buffer, size, file->pos);
+	off_t bytes_written = file->ops->write_at(file->obj, buffer, size, file->pos);
 	file->pos += bytes_written;
 	return bytes_written;
 }
@@ -122,7 +154,7 @@ off_t file_write(struct file *file, const void *buffer, off_t size)
 off_t file_write_at(struct file *file, const void *buffer, off_t size,
 					off_t file_ofs)
 {
-	return inode_write_at(file->inode, buffer, size, file_ofs);
+	return file->ops->write_at(file->obj, buffer, size, file_ofs);
 }
 
 /* Prevents write operations on FILE's underlying inode
@@ -133,7 +165,7 @@ void file_deny_write(struct file *file)
 	if (!file->deny_write)
 	{
 		file->deny_write = true;
-		inode_deny_write(file->inode);
+		file->ops->deny_write(file->obj);
 	}
 }
 
@@ -146,7 +178,7 @@ void file_allow_write(struct file *file)
 	if (file->deny_write)
 	{
 		file->deny_write = false;
-		inode_allow_write(file->inode);
+		file->ops->allow_write(file->obj);
 	}
 }
 
@@ -154,7 +186,7 @@ void file_allow_write(struct file *file)
 off_t file_length(struct file *file)
 {
 	ASSERT(file != NULL);
-	return inode_length(file->inode);
+	return file->ops->length(file->obj);
 }
 
 /* Sets the current position in FILE to NEW_POS bytes from the
@@ -173,3 +205,47 @@ off_t file_tell(struct file *file)
 	ASSERT(file != NULL);
 	return file->pos;
 }
+
+/* Operations of files backed by an on-disk inode. */
+
+static void *
+inode_file_reopen(void *inode)
+{
+	return inode_reopen(inode);
+}
+
+static void
+inode_file_close(void *inode)
+{
+	inode_close(inode);
+}
+
+static off_t
+inode_file_read_at(void *inode, void *buffer, off_t size, off_t ofs)
+{
+	return inode_read_at(inode, buffer, size, ofs);
+}
+
+static off_t
+inode_file_write_at(void *inode, const void *buffer, off_t size, off_t ofs)
+{
+	return inode_write_at(inode, buffer, size, ofs);
+}
+
+static off_t
+inode_file_length(void *inode)
+{
+	return inode_length(inode);
+}
+
+static void
+inode_file_deny_write(void *inode)
+{
+	inode_deny_write(inode);
+}
+
+static void
+inode_file_allow_write(void *inode)
+{
+	inode_allow_write(inode);
+}
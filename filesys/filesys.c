@@ -1,12 +1,21 @@
 #include "filesys/filesys.h"
 #include <debug.h>
+#include <round.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/fat.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
+#include "filesys/initramfs.h"
+#include "filesys/mount.h"
+#if defined (VM) && defined (EFILESYS)
+#include "filesys/page_cache.h"
+#endif
+#include "filesys/tmpfs.h"
 #include "devices/disk.h"
+#include "threads/vaddr.h"
 
 /* The disk that contains the file system. */
 struct disk *filesys_disk;
@@ -22,6 +31,8 @@ filesys_init (bool format) {
 		PANIC ("hd0:1 (hdb) not present, file system initialization failed");
 
 	inode_init ();
+	mount_init ();
+	initramfs_init ();
 
 #ifdef EFILESYS
 	fat_init ();
@@ -45,6 +56,10 @@ filesys_init (bool format) {
  * to disk. */
 void
 filesys_done (void) {
+#if defined (VM) && defined (EFILESYS)
+	page_cache_flush ();
+#endif
+
 	/* Original FS */
 #ifdef EFILESYS
 	fat_close ();
@@ -55,30 +70,67 @@ filesys_done (void) {
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
  * Returns true if successful, false otherwise.
- * Fails if a file named NAME already exists,
- * or if internal memory allocation fails. */
+ * Fails if a file named NAME already exists, also in the
+ * initramfs, or if internal memory allocation fails. */
 bool
 filesys_create (const char *name, off_t initial_size) {
+	if (initramfs_contains (name))
+		return false;
+
+	const char *rest;
+	struct mount *m = mount_acquire (name, &rest);
+	if (m != NULL) {
+		bool success = mount_ops (m)->create (mount_fs (m), rest, initial_size);
+		mount_release (m);
+		return success;
+	}
+
 	disk_sector_t inode_sector = 0;
 	struct dir *dir = dir_open_root ();
+#ifdef EFILESYS
+	/* The inode takes a cluster of its own. */
+	cluster_t inode_clst = fat_create_chain (0);
+	if (inode_clst != 0)
+		inode_sector = cluster_to_sector (inode_clst);
+	bool success = (dir != NULL
+			&& inode_clst != 0
+			&& inode_create (inode_sector, initial_size)
+			&& dir_add (dir, name, inode_sector));
+	if (!success && inode_clst != 0)
+		fat_remove_chain (inode_clst, 0);
+#else
 	bool success = (dir != NULL
 			&& free_map_allocate (1, &inode_sector)
 			&& inode_create (inode_sector, initial_size)
 			&& dir_add (dir, name, inode_sector));
 	if (!success && inode_sector != 0)
 		free_map_release (inode_sector, 1);
+#endif
 	dir_close (dir);
 
 	return success;
 }
 
-/* Opens the file with the given NAME.
+/* Opens the file with the given NAME.  The initramfs is
+ * searched first, then mounted file systems, then the disk.
  * Returns the new file if successful or a null pointer
  * otherwise.
  * Fails if no file named NAME exists,
  * or if an internal memory allocation fails. */
 struct file *
 filesys_open (const char *name) {
+	struct file *file = initramfs_open (name);
+	if (file != NULL)
+		return file;
+
+	const char *rest;
+	struct mount *m = mount_acquire (name, &rest);
+	if (m != NULL) {
+		file = mount_ops (m)->open (mount_fs (m), rest);
+		mount_release (m);
+		return file;
+	}
+
 	struct dir *dir = dir_open_root ();
 	struct inode *inode = NULL;
 
@@ -91,10 +143,22 @@ filesys_open (const char *name) {
 
 /* Deletes the file named NAME.
  * Returns true if successful, false on failure.
- * Fails if no file named NAME exists,
- * or if an internal memory allocation fails. */
+ * Fails if no file named NAME exists, if NAME is in the
+ * read-only initramfs, or if an internal memory allocation
+ * fails. */
 bool
 filesys_remove (const char *name) {
+	if (initramfs_contains (name))
+		return false;
+
+	const char *rest;
+	struct mount *m = mount_acquire (name, &rest);
+	if (m != NULL) {
+		bool success = mount_ops (m)->remove (mount_fs (m), rest);
+		mount_release (m);
+		return success;
+	}
+
 	struct dir *dir = dir_open_root ();
 	bool success = dir != NULL && dir_remove (dir, name);
 	dir_close (dir);
@@ -102,6 +166,51 @@ filesys_remove (const char *name) {
 	return success;
 }
 
+/* Creates a directory named NAME.
+ * Returns true if successful, false otherwise.
+ * Only mounted file systems support directories; the disk file
+ * system has just the root directory. */
+bool
+filesys_mkdir (const char *name) {
+	const char *rest;
+	struct mount *m = mount_acquire (name, &rest);
+	if (m != NULL) {
+		bool success = mount_ops (m)->mkdir (mount_fs (m), rest);
+		mount_release (m);
+		return success;
+	}
+	return false;
+}
+
+/* Mounts a file system at PATH.  CHAN_NO and DEV_NO name the disk
+ * to mount, except that CHAN_NO == MOUNT_TMPFS mounts a fresh
+ * tmpfs limited to DEV_NO kB (0 for no limit).
+ * Returns true if successful, false otherwise. */
+bool
+filesys_mount (const char *path, int chan_no, int dev_no) {
+	void *fs;
+
+	/* The disk file system cannot yet be instantiated twice. */
+	if (chan_no != MOUNT_TMPFS || dev_no < 0)
+		return false;
+
+	fs = tmpfs_create (DIV_ROUND_UP ((size_t) dev_no * 1024, PGSIZE));
+	if (fs == NULL)
+		return false;
+	if (!mount_add (path, &tmpfs_ops, fs)) {
+		tmpfs_ops.unmount (fs);
+		return false;
+	}
+	return true;
+}
+
+/* Unmounts the file system mounted at PATH.
+ * Fails if nothing is mounted there or if it is busy. */
+bool
+filesys_umount (const char *path) {
+	return mount_remove (path);
+}
+
 /* Formats the file system. */
 static void
 do_format (void) {
@@ -110,6 +219,8 @@ do_format (void) {
 #ifdef EFILESYS
 	/* Create FAT and save it to the disk. */
 	fat_create ();
+	if (!dir_create (ROOT_DIR_SECTOR, 16))
+		PANIC ("root directory creation failed");
 	fat_close ();
 #else
 	free_map_create ();
@@ -0,0 +1,345 @@
+/* initramfs.c: Read-only file system unpacked from a ustar archive.
+ *
+ * The pintos utility can append a ustar archive to the kernel
+ * image on the boot disk (see its --initramfs option).  At boot
+ * the whole archive is read into kernel memory, and
+ * filesys_open() looks a name up here before it goes anywhere
+ * else, so programs and data in the archive never cost a disk
+ * access after boot.  Only regular files are kept; the archive cannot be
+ * changed at run time. */
+
+#include "filesys/initramfs.h"
+#include <debug.h>
+#include <hash.h>
+#include <round.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/disk.h"
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/vaddr.h"
+
+/* On-disk ustar header.  Numbers are ASCII octal. */
+struct ustar_header {
+	char name[100];             /* File name. */
+	char mode[8];
+	char uid[8];
+	char gid[8];
+	char size[12];              /* File size in bytes. */
+	char mtime[12];
+	char chksum[8];             /* Sum of header bytes. */
+	char typeflag;              /* Type of file. */
+	char linkname[100];
+	char magic[6];              /* "ustar\0". */
+	char version[2];
+	char uname[32];
+	char gname[32];
+	char devmajor[8];
+	char devminor[8];
+	char prefix[155];           /* Directory prepended to NAME. */
+	char padding[12];
+} __attribute__((packed));
+
+/* File in the archive. */
+struct initramfs_file {
+	struct hash_elem elem;      /* Element in files. */
+	uint8_t *data;              /* File contents. */
+	off_t length;               /* File size in bytes. */
+	char name[];                /* File name, no leading '/'. */
+};
+
+/* All files in the archive, keyed by name.  Never changes after
+ * initramfs_init(), so lookups need no lock. */
+static struct hash files;
+static bool present;
+
+static bool read_header (struct disk *, disk_sector_t,
+		struct ustar_header *);
+static bool parse_octal (const char *, size_t, size_t *);
+static bool add_file (const struct ustar_header *, struct disk *,
+		disk_sector_t, size_t);
+static const char *normalize (const char *);
+static struct initramfs_file *lookup (const char *name);
+static uint64_t file_hash (const struct hash_elem *, void *);
+static bool file_less (const struct hash_elem *, const struct hash_elem *,
+		void *);
+
+static void *initramfs_file_reopen (void *);
+static void initramfs_file_close (void *);
+static off_t initramfs_file_read_at (void *, void *, off_t, off_t);
+static off_t initramfs_file_write_at (void *, const void *, off_t, off_t);
+static off_t initramfs_file_length (void *);
+static void initramfs_file_deny_write (void *);
+static void initramfs_file_allow_write (void *);
+
+static const struct file_operations initramfs_file_ops = {
+	.reopen = initramfs_file_reopen,
+	.close = initramfs_file_close,
+	.read_at = initramfs_file_read_at,
+	.write_at = initramfs_file_write_at,
+	.length = initramfs_file_length,
+	.deny_write = initramfs_file_deny_write,
+	.allow_write = initramfs_file_allow_write,
+};
+
+/* Loads the archive that follows the kernel image on hd0:0, if
+ * there is one. */
+void
+initramfs_init (void) {
+	/* The kernel image is loaded from hd0:0 starting at sector 1,
+	 * right after the boot loader, and is padded to a whole number
+	 * of pages.  Its loaded part ends where the BSS begins. */
+	extern char start, _start_bss;
+	size_t image_size = ROUND_UP (&_start_bss - &start, PGSIZE);
+	disk_sector_t sector = 1 + image_size / DISK_SECTOR_SIZE;
+	struct disk *disk = disk_get (0, 0);
+	struct ustar_header *h;
+	size_t file_cnt = 0;
+	size_t byte_cnt = 0;
+
+	hash_init (&files, file_hash, file_less, NULL);
+	if (disk == NULL)
+		return;
+
+	h = malloc (sizeof *h);
+	if (h == NULL)
+		PANIC ("initramfs: out of memory");
+
+	while (read_header (disk, sector, h)) {
+		size_t size;
+
+		if (!parse_octal (h->size, sizeof h->size, &size))
+			PANIC ("initramfs: bad size in header at sector %"PRDSNu, sector);
+		sector++;
+
+		/* Regular files only: directories are implied by names, and
+		 * links, devices and the like have no meaning here. */
+		if (h->typeflag == '0' || h->typeflag == '\0') {
+			if (!add_file (h, disk, sector, size))
+				PANIC ("initramfs: out of memory");
+			file_cnt++;
+			byte_cnt += size;
+		}
+		sector += DIV_ROUND_UP (size, DISK_SECTOR_SIZE);
+	}
+	free (h);
+
+	present = file_cnt > 0;
+	if (present)
+		printf ("initramfs: %zu files, %zu bytes\n", file_cnt, byte_cnt);
+}
+
+/* Returns true if NAME names a file in the archive. */
+bool
+initramfs_contains (const char *name) {
+	return lookup (name) != NULL;
+}
+
+/* Opens the file in the archive named NAME.
+ * Returns a null pointer if there is none or if memory is
+ * exhausted. */
+struct file *
+initramfs_open (const char *name) {
+	struct initramfs_file *f = lookup (name);
+	return f != NULL ? file_open_obj (&initramfs_file_ops, f) : NULL;
+}
+
+/* Reads the header at SECTOR of DISK into H.
+ * Returns false at the end of the archive, which is marked by a
+ * zeroed block, or if SECTOR does not hold a valid header. */
+static bool
+read_header (struct disk *disk, disk_sector_t sector,
+		struct ustar_header *h) {
+	const uint8_t *bytes = (const uint8_t *) h;
+	size_t chksum, sum;
+	size_t i;
+
+	if (sector >= disk_size (disk))
+		return false;
+	disk_read (disk, sector, h);
+	if (memcmp (h->magic, "ustar", 5))
+		return false;
+
+	/* The checksum is computed with its own field taken as
+	 * blanks. */
+	if (!parse_octal (h->chksum, sizeof h->chksum, &chksum))
+		return false;
+	sum = 0;
+	for (i = 0; i < sizeof *h; i++)
+		sum += (i >= offsetof (struct ustar_header, chksum)
+				&& i < offsetof (struct ustar_header, typeflag)) ? ' ' : bytes[i];
+	return sum == chksum;
+}
+
+/* Parses the octal number in the SIZE-byte field S into *VALUE.
+ * The number may be padded with leading spaces and ends at a
+ * space, a null, or the end of the field. */
+static bool
+parse_octal (const char *s, size_t size, size_t *value) {
+	size_t i = 0;
+
+	while (i < size && s[i] == ' ')
+		i++;
+	if (i == size || s[i] < '0' || s[i] > '7')
+		return false;
+
+	*value = 0;
+	for (; i < size && s[i] >= '0' && s[i] <= '7'; i++)
+		*value = *value * 8 + (s[i] - '0');
+	return i == size || s[i] == ' ' || s[i] == '\0';
+}
+
+/* Adds the file described by H, whose SIZE bytes of data start
+ * at SECTOR of DISK, to the archive.  A later file replaces an
+ * earlier one of the same name, as tar does when extracting.
+ * Returns false if memory is exhausted. */
+static bool
+add_file (const struct ustar_header *h, struct disk *disk,
+		disk_sector_t sector, size_t size) {
+	char path[sizeof h->prefix + 1 + sizeof h->name + 1];
+	struct initramfs_file *f;
+	struct hash_elem *old;
+	const char *name;
+	uint8_t *bounce = NULL;
+	size_t ofs;
+
+	/* Names may fill their fields completely, without a null. */
+	if (h->prefix[0] != '\0')
+		snprintf (path, sizeof path, "%.*s/%.*s",
+				(int) sizeof h->prefix, h->prefix, (int) sizeof h->name, h->name);
+	else
+		snprintf (path, sizeof path, "%.*s", (int) sizeof h->name, h->name);
+	name = normalize (path);
+
+	f = malloc (sizeof *f + strlen (name) + 1);
+	if (f == NULL)
+		return false;
+	strlcpy (f->name, name, strlen (name) + 1);
+	f->length = size;
+	f->data = malloc (size > 0 ? size : 1);
+	if (f->data == NULL) {
+		free (f);
+		return false;
+	}
+
+	/* Whole sectors go straight into the file's buffer; only a
+	 * partial last sector needs a bounce buffer. */
+	for (ofs = 0; ofs < size; ofs += DISK_SECTOR_SIZE, sector++) {
+		if (size - ofs >= DISK_SECTOR_SIZE)
+			disk_read (disk, sector, f->data + ofs);
+		else {
+			bounce = malloc (DISK_SECTOR_SIZE);
+			if (bounce == NULL) {
+				free (f->data);
+				free (f);
+				return false;
+			}
+			disk_read (disk, sector, bounce);
+			memcpy (f->data + ofs, bounce, size - ofs);
+			free (bounce);
+		}
+	}
+
+	old = hash_replace (&files, &f->elem);
+	if (old != NULL) {
+		struct initramfs_file *o = hash_entry (old, struct initramfs_file, elem);
+		free (o->data);
+		free (o);
+	}
+	return true;
+}
+
+/* Returns NAME without leading slashes and "./" components. */
+static const char *
+normalize (const char *name) {
+	for (;;) {
+		if (name[0] == '/')
+			name++;
+		else if (name[0] == '.' && name[1] == '/')
+			name += 2;
+		else
+			return name;
+	}
+}
+
+/* Returns the file in the archive named NAME, or a null pointer
+ * if there is none. */
+static struct initramfs_file *
+lookup (const char *name) {
+	struct initramfs_file *key;
+	struct hash_elem *e;
+	size_t len;
+
+	if (!present)
+		return NULL;
+
+	name = normalize (name);
+	len = strlen (name);
+	key = malloc (sizeof *key + len + 1);
+	if (key == NULL)
+		return NULL;
+	memcpy (key->name, name, len + 1);
+	e = hash_find (&files, &key->elem);
+	free (key);
+	return e != NULL ? hash_entry (e, struct initramfs_file, elem) : NULL;
+}
+
+/* Returns a hash of file E's name. */
+static uint64_t
+file_hash (const struct hash_elem *e, void *aux UNUSED) {
+	return hash_string (hash_entry (e, struct initramfs_file, elem)->name);
+}
+
+/* Returns true if file A's name precedes file B's. */
+static bool
+file_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return strcmp (hash_entry (a, struct initramfs_file, elem)->name,
+			hash_entry (b, struct initramfs_file, elem)->name) < 0;
+}
+
+/* Archive files are never freed, so every opener shares one. */
+static void *
+initramfs_file_reopen (void *obj) {
+	return obj;
+}
+
+static void
+initramfs_file_close (void *obj UNUSED) {
+}
+
+/* Reads up to SIZE bytes at offset OFS of file OBJ into BUFFER.
+ * Returns the number of bytes read. */
+static off_t
+initramfs_file_read_at (void *obj, void *buffer, off_t size, off_t ofs) {
+	struct initramfs_file *f = obj;
+
+	if (ofs < 0 || size <= 0 || ofs >= f->length)
+		return 0;
+	if (size > f->length - ofs)
+		size = f->length - ofs;
+	memcpy (buffer, f->data + ofs, size);
+	return size;
+}
+
+/* The archive is read-only: writes always fail. */
+static off_t
+initramfs_file_write_at (void *obj UNUSED, const void *buffer UNUSED,
+		off_t size UNUSED, off_t ofs UNUSED) {
+	return 0;
+}
+
+static off_t
+initramfs_file_length (void *obj) {
+	return ((struct initramfs_file *) obj)->length;
+}
+
+/* Writes are denied anyway, so there is nothing to track. */
+static void
+initramfs_file_deny_write (void *obj UNUSED) {
+}
+
+static void
+initramfs_file_allow_write (void *obj UNUSED) {
+}
@@ -3,9 +3,14 @@
 #include <debug.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/fat.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
+#if defined (VM) && defined (EFILESYS)
+#include "filesys/page_cache.h"
+#endif
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
@@ -13,7 +18,8 @@
 /* On-disk inode.
  * Must be exactly DISK_SECTOR_SIZE bytes long. */
 struct inode_disk {
-	disk_sector_t start;                /* First data sector. */
+	disk_sector_t start;                /* First data sector, or with
+	                                       EFILESYS first cluster. */
 	off_t length;                       /* File size in bytes. */
 	unsigned magic;                     /* Magic number. */
 	uint32_t unused[125];               /* Not used. */
@@ -26,6 +32,20 @@ bytes_to_sectors (off_t size) {
 	return DIV_ROUND_UP (size, DISK_SECTOR_SIZE);
 }
 
+#ifdef EFILESYS
+/* A run of clusters that are consecutive both in a file and on
+ * disk: clusters IDX...IDX + LEN - 1 of the file are clusters
+ * CLST...CLST + LEN - 1. */
+struct extent {
+	uint32_t idx;                       /* Index of first cluster in file. */
+	cluster_t clst;                     /* First cluster. */
+	uint32_t len;                       /* Number of clusters. */
+};
+
+static cluster_t inode_cluster (struct inode *, uint32_t idx);
+static bool grow_extents (struct inode *);
+#endif
+
 /* In-memory inode. */
 struct inode {
 	struct list_elem elem;              /* Element in inode list. */
@@ -34,6 +54,17 @@ struct inode {
 	bool removed;                       /* True if deleted, false otherwise. */
 	int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
 	struct inode_disk data;             /* Inode content. */
+#ifdef EFILESYS
+	/* The part of the cluster chain walked so far, as extents
+	 * sorted by IDX.  They cover clusters 0...MAPPED - 1.  Readers
+	 * of the same inode share them, so they are guarded by
+	 * EXTENT_LOCK. */
+	struct lock extent_lock;
+	struct extent *extents;
+	size_t extent_cnt;                  /* Number of extents in use. */
+	size_t extent_cap;                  /* Number of extents allocated. */
+	uint32_t mapped;                    /* Number of clusters covered. */
+#endif
 };
 
 /* Returns the disk sector that contains byte offset POS within
@@ -41,14 +72,42 @@ struct inode {
  * Returns -1 if INODE does not contain data for a byte at offset
  * POS. */
 static disk_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) {
+byte_to_sector (struct inode *inode, off_t pos) {
 	ASSERT (inode != NULL);
-	if (pos < inode->data.length)
+	if (pos < inode->data.length) {
+#ifdef EFILESYS
+		size_t sector_idx = pos / DISK_SECTOR_SIZE;
+		cluster_t clst = inode_cluster (inode,
+				sector_idx / SECTORS_PER_CLUSTER);
+		return clst != 0 ? cluster_to_sector (clst)
+			+ sector_idx % SECTORS_PER_CLUSTER : (disk_sector_t) -1;
+#else
 		return inode->data.start + pos / DISK_SECTOR_SIZE;
-	else
+#endif
+	} else
 		return -1;
 }
 
+/* Returns how many whole sectors of INODE from byte OFFSET, which
+ * is in SECTOR and sector-aligned, lie one after another on disk,
+ * counting no more than SIZE bytes and at most DISK_MAX_SECTORS.
+ * The first sector must be whole, so the result is at least 1. */
+static size_t
+sector_run (struct inode *inode, disk_sector_t sector, off_t offset,
+		off_t size) {
+	off_t left = inode_length (inode) - offset;
+	size_t cnt = 1;
+
+	if (size < left)
+		left = size;
+	while (cnt < DISK_MAX_SECTORS
+			&& (off_t) ((cnt + 1) * DISK_SECTOR_SIZE) <= left
+			&& byte_to_sector (inode, offset + cnt * DISK_SECTOR_SIZE)
+				== sector + cnt)
+		cnt++;
+	return cnt;
+}
+
 /* List of open inodes, so that opening a single inode twice
  * returns the same `struct inode'. */
 static struct list open_inodes;
@@ -80,6 +139,32 @@ inode_create (disk_sector_t sector, off_t length) {
 		size_t sectors = bytes_to_sectors (length);
 		disk_inode->length = length;
 		disk_inode->magic = INODE_MAGIC;
+#ifdef EFILESYS
+		size_t clusters = DIV_ROUND_UP (sectors, SECTORS_PER_CLUSTER);
+		cluster_t clst = 0;
+		size_t i;
+
+		/* Allocate and zero the chain a cluster at a time. */
+		success = true;
+		for (i = 0; i < clusters; i++) {
+			static char zeros[DISK_SECTOR_SIZE];
+			size_t j;
+
+			clst = fat_create_chain (clst);
+			if (clst == 0) {
+				if (disk_inode->start != 0)
+					fat_remove_chain (disk_inode->start, 0);
+				success = false;
+				break;
+			}
+			if (disk_inode->start == 0)
+				disk_inode->start = clst;
+			for (j = 0; j < SECTORS_PER_CLUSTER; j++)
+				disk_write (filesys_disk, cluster_to_sector (clst) + j, zeros);
+		}
+		if (success)
+			disk_write (filesys_disk, sector, disk_inode);
+#else
 		if (free_map_allocate (sectors, &disk_inode->start)) {
 			disk_write (filesys_disk, sector, disk_inode);
 			if (sectors > 0) {
@@ -91,6 +176,7 @@ inode_create (disk_sector_t sector, off_t length) {
 			}
 			success = true; 
 		} 
+#endif
 		free (disk_inode);
 	}
 	return success;
@@ -125,6 +211,12 @@ inode_open (disk_sector_t sector) {
 	inode->open_cnt = 1;
 	inode->deny_write_cnt = 0;
 	inode->removed = false;
+#ifdef EFILESYS
+	lock_init (&inode->extent_lock);
+	inode->extents = NULL;
+	inode->extent_cnt = inode->extent_cap = 0;
+	inode->mapped = 0;
+#endif
 	disk_read (filesys_disk, inode->sector, &inode->data);
 	return inode;
 }
@@ -157,13 +249,27 @@ inode_close (struct inode *inode) {
 		/* Remove from inode list and release lock. */
 		list_remove (&inode->elem);
 
+#if defined (VM) && defined (EFILESYS)
+		/* Nobody can reach its cached pages any more. */
+		page_cache_drop (inode, !inode->removed);
+#endif
+
 		/* Deallocate blocks if removed. */
 		if (inode->removed) {
+#ifdef EFILESYS
+			fat_remove_chain (sector_to_cluster (inode->sector), 0);
+			if (inode->data.start != 0)
+				fat_remove_chain (inode->data.start, 0);
+#else
 			free_map_release (inode->sector, 1);
 			free_map_release (inode->data.start,
 					bytes_to_sectors (inode->data.length)); 
+#endif
 		}
 
+#ifdef EFILESYS
+		free (inode->extents);
+#endif
 		free (inode); 
 	}
 }
@@ -180,7 +286,19 @@ inode_remove (struct inode *inode) {
  * Returns the number of bytes actually read, which may be less
  * than SIZE if an error occurs or end of file is reached. */
 off_t
-inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
+inode_read_at (struct inode *inode, void *buffer, off_t size, off_t offset) {
+#if defined (VM) && defined (EFILESYS)
+	return page_cache_read (inode, buffer, size, offset);
+#else
+	return inode_read_direct (inode, buffer, size, offset);
+#endif
+}
+
+/* Like inode_read_at(), but always reads from disk, bypassing the
+ * page cache. */
+off_t
+inode_read_direct (struct inode *inode, void *buffer_, off_t size,
+		off_t offset) {
 	uint8_t *buffer = buffer_;
 	off_t bytes_read = 0;
 	uint8_t *bounce = NULL;
@@ -197,12 +315,16 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 
 		/* Number of bytes to actually copy out of this sector. */
 		int chunk_size = size < min_left ? size : min_left;
-		if (chunk_size <= 0)
+		if (chunk_size <= 0 || sector_idx == (disk_sector_t) -1)
 			break;
 
 		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
-			/* Read full sector directly into caller's buffer. */
-			disk_read (filesys_disk, sector_idx, buffer + bytes_read); 
+			/* Read full sectors directly into caller's buffer, as
+			 * many with one request as follow each other on disk. */
+			size_t cnt = sector_run (inode, sector_idx, offset, size);
+			disk_read_multiple (filesys_disk, sector_idx, buffer + bytes_read,
+					cnt);
+			chunk_size = cnt * DISK_SECTOR_SIZE;
 		} else {
 			/* Read sector into bounce buffer, then partially copy
 			 * into caller's buffer. */
@@ -231,7 +353,21 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
  * (Normally a write at end of file would extend the inode, but
  * growth is not yet implemented.) */
 off_t
-inode_write_at (struct inode *inode, const void *buffer_, off_t size,
+inode_write_at (struct inode *inode, const void *buffer, off_t size,
+		off_t offset) {
+#if defined (VM) && defined (EFILESYS)
+	if (inode->deny_write_cnt)
+		return 0;
+	return page_cache_write (inode, buffer, size, offset);
+#else
+	return inode_write_direct (inode, buffer, size, offset);
+#endif
+}
+
+/* Like inode_write_at(), but always writes to disk, bypassing the
+ * page cache. */
+off_t
+inode_write_direct (struct inode *inode, const void *buffer_, off_t size,
 		off_t offset) {
 	const uint8_t *buffer = buffer_;
 	off_t bytes_written = 0;
@@ -252,12 +388,16 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 
 		/* Number of bytes to actually write into this sector. */
 		int chunk_size = size < min_left ? size : min_left;
-		if (chunk_size <= 0)
+		if (chunk_size <= 0 || sector_idx == (disk_sector_t) -1)
 			break;
 
 		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
-			/* Write full sector directly to disk. */
-			disk_write (filesys_disk, sector_idx, buffer + bytes_written); 
+			/* Write full sectors directly to disk, as many with one
+			 * request as follow each other there. */
+			size_t cnt = sector_run (inode, sector_idx, offset, size);
+			disk_write_multiple (filesys_disk, sector_idx,
+					buffer + bytes_written, cnt);
+			chunk_size = cnt * DISK_SECTOR_SIZE;
 		} else {
 			/* We need a bounce buffer. */
 			if (bounce == NULL) {
@@ -311,3 +451,89 @@ off_t
 inode_length (const struct inode *inode) {
 	return inode->data.length;
 }
+
+#ifdef EFILESYS
+/* Returns cluster IDX of INODE's data, or 0 if the chain is
+ * shorter than that.
+ *
+ * Following the chain from its start costs a FAT lookup per
+ * cluster, so the clusters seen are remembered as extents and
+ * later lookups are a binary search.  The chain is only walked
+ * past the furthest cluster looked up so far.  If there is no
+ * memory for another extent, the rest of the walk is not
+ * remembered. */
+static cluster_t
+inode_cluster (struct inode *inode, uint32_t idx) {
+	struct extent *e;
+	cluster_t clst;
+	uint32_t walked;
+	bool record = true;
+
+	lock_acquire (&inode->extent_lock);
+	if (idx < inode->mapped) {
+		size_t lo = 0, hi = inode->extent_cnt;
+
+		/* Find the last extent that starts at or before IDX. */
+		while (hi - lo > 1) {
+			size_t mid = (lo + hi) / 2;
+			if (inode->extents[mid].idx <= idx)
+				lo = mid;
+			else
+				hi = mid;
+		}
+		e = &inode->extents[lo];
+		clst = e->clst + (idx - e->idx);
+		lock_release (&inode->extent_lock);
+		return clst;
+	}
+
+	/* Walk on from the end of what is known. */
+	if (inode->extent_cnt > 0) {
+		e = &inode->extents[inode->extent_cnt - 1];
+		clst = e->clst + e->len - 1;
+	} else
+		clst = 0;
+
+	for (walked = inode->mapped; walked <= idx; walked++) {
+		cluster_t next = clst == 0 ? inode->data.start : fat_get (clst);
+		if (next == 0 || next == EOChain) {
+			clst = 0;
+			break;
+		}
+
+		if (record) {
+			e = inode->extent_cnt > 0
+				? &inode->extents[inode->extent_cnt - 1] : NULL;
+			if (e != NULL && next == clst + 1)
+				e->len++;
+			else if (inode->extent_cnt < inode->extent_cap
+					|| grow_extents (inode)) {
+				e = &inode->extents[inode->extent_cnt++];
+				e->idx = inode->mapped;
+				e->clst = next;
+				e->len = 1;
+			} else
+				record = false;
+			if (record)
+				inode->mapped++;
+		}
+		clst = next;
+	}
+	lock_release (&inode->extent_lock);
+	return clst;
+}
+
+/* Doubles the room for INODE's extents.  Returns false if memory
+ * is exhausted. */
+static bool
+grow_extents (struct inode *inode) {
+	size_t cap = inode->extent_cap > 0 ? inode->extent_cap * 2 : 4;
+	struct extent *extents = realloc (inode->extents, cap * sizeof *extents);
+
+	if (extents == NULL)
+		return false;
+	inode->extents = extents;
+	inode->extent_cap = cap;
+	return true;
+}
+#endif
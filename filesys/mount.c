@@ -0,0 +1,168 @@
+/* mount.c: Table of file systems mounted into the name space.
+ *
+ * The disk file system owns every name that is not under a mount
+ * point.  filesys_create(), filesys_open() and friends first ask
+ * this table whether a name belongs to a mounted file system, and
+ * if so dispatch to its struct fs_operations. */
+
+#include "filesys/mount.h"
+#include <debug.h>
+#include <list.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* A mounted file system. */
+struct mount {
+	struct list_elem elem;              /* Element in mounts. */
+	char path[MOUNT_PATH_MAX + 1];      /* Mount point, no leading '/'. */
+	const struct fs_operations *ops;    /* File system operations. */
+	void *fs;                           /* File system instance. */
+};
+
+/* All mounted file systems and the lock that protects them.
+ * The lock is also held while a file system operation runs, so a
+ * file system cannot be unmounted under its callers. */
+static struct list mounts;
+static struct lock mount_lock;
+
+static const char *skip_slashes (const char *);
+static struct mount *find_mount (const char *name, const char **rest);
+static bool has_mount_under (const char *path);
+
+/* Initializes the mount table. */
+void
+mount_init (void) {
+	list_init (&mounts);
+	lock_init (&mount_lock);
+}
+
+/* Mounts FS, operated on through OPS, at PATH.
+ * Fails if PATH is empty, too long, or already in use as or
+ * under a mount point. */
+bool
+mount_add (const char *path, const struct fs_operations *ops, void *fs) {
+	struct mount *m;
+	const char *rest;
+
+	path = skip_slashes (path);
+	if (*path == '\0' || strlen (path) > MOUNT_PATH_MAX
+			|| path[strlen (path) - 1] == '/')
+		return false;
+
+	m = malloc (sizeof *m);
+	if (m == NULL)
+		return false;
+	strlcpy (m->path, path, sizeof m->path);
+	m->ops = ops;
+	m->fs = fs;
+
+	lock_acquire (&mount_lock);
+	if (find_mount (path, &rest) != NULL || has_mount_under (path)) {
+		lock_release (&mount_lock);
+		free (m);
+		return false;
+	}
+	list_push_back (&mounts, &m->elem);
+	lock_release (&mount_lock);
+	return true;
+}
+
+/* Unmounts the file system mounted exactly at PATH.
+ * Fails if there is none or if it is still in use. */
+bool
+mount_remove (const char *path) {
+	struct mount *m;
+	const char *rest;
+	bool success = false;
+
+	lock_acquire (&mount_lock);
+	m = find_mount (path, &rest);
+	if (m != NULL && *rest == '\0' && m->ops->unmount (m->fs)) {
+		list_remove (&m->elem);
+		free (m);
+		success = true;
+	}
+	lock_release (&mount_lock);
+	return success;
+}
+
+/* Looks up the file system that NAME belongs to.  If it is a
+ * mounted one, returns it with the mount table locked and sets
+ * *REST to NAME relative to the mount point; the caller must
+ * call mount_release() when done.  Returns a null pointer if NAME
+ * belongs to the disk file system. */
+struct mount *
+mount_acquire (const char *name, const char **rest) {
+	struct mount *m;
+
+	lock_acquire (&mount_lock);
+	m = find_mount (name, rest);
+	if (m == NULL)
+		lock_release (&mount_lock);
+	return m;
+}
+
+/* Releases a mount returned by mount_acquire(). */
+void
+mount_release (struct mount *m) {
+	ASSERT (m != NULL);
+	ASSERT (lock_held_by_current_thread (&mount_lock));
+	lock_release (&mount_lock);
+}
+
+/* Returns the operations of mounted file system M. */
+const struct fs_operations *
+mount_ops (struct mount *m) {
+	return m->ops;
+}
+
+/* Returns the file system instance of M. */
+void *
+mount_fs (struct mount *m) {
+	return m->fs;
+}
+
+/* Returns S past any leading slashes. */
+static const char *
+skip_slashes (const char *s) {
+	while (*s == '/')
+		s++;
+	return s;
+}
+
+/* Returns the mount that NAME lies at or under, setting *REST to
+ * the remainder of NAME, or a null pointer if there is none.
+ * The mount table must be locked. */
+static struct mount *
+find_mount (const char *name, const char **rest) {
+	struct list_elem *e;
+
+	name = skip_slashes (name);
+	for (e = list_begin (&mounts); e != list_end (&mounts); e = list_next (e)) {
+		struct mount *m = list_entry (e, struct mount, elem);
+		size_t len = strlen (m->path);
+
+		if (!memcmp (name, m->path, len)
+				&& (name[len] == '/' || name[len] == '\0')) {
+			*rest = skip_slashes (name + len);
+			return m;
+		}
+	}
+	return NULL;
+}
+
+/* Returns true if some file system is mounted below PATH.
+ * The mount table must be locked. */
+static bool
+has_mount_under (const char *path) {
+	size_t len = strlen (path);
+	struct list_elem *e;
+
+	for (e = list_begin (&mounts); e != list_end (&mounts); e = list_next (e)) {
+		struct mount *m = list_entry (e, struct mount, elem);
+		if (!memcmp (m->path, path, len) && m->path[len] == '/')
+			return true;
+	}
+	return false;
+}
@@ -1,6 +1,34 @@
-/* page_cache.c: Implementation of Page Cache (Buffer Cache). */
+/* page_cache.c: Implementation of Page Cache (Buffer Cache).
+ *
+ * Pages of files on disk are cached in frames of the frame table,
+ * keyed by inode and page index.  read() and write() copy from and
+ * to these frames, and mmap() maps the same frames into processes,
+ * so a file is held in memory once however it is used, and every
+ * user sees the same bytes.
+ *
+ * Each cached page is a struct page of type VM_PAGE_CACHE owned by
+ * the worker thread, which maps it in an address space of its own.
+ * That way the clock hand ages and evicts the cache together with
+ * process pages, and the dirty bit of a cached page is found where
+ * it is for any other page.  The worker's page table lock doubles
+ * as the lock of the cache.  The worker reads pages ahead and
+ * writes dirty pages back. */
 
+#include "filesys/page_cache.h"
+#include <bitmap.h>
+#include <hash.h>
+#include <list.h>
+#include <round.h>
+#include <string.h>
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
 #include "vm/vm.h"
+
+#if defined (VM) && defined (EFILESYS)
 static bool page_cache_readahead (struct page *page, void *kva);
 static bool page_cache_writeback (struct page *page);
 static void page_cache_destroy (struct page *page);
@@ -15,36 +43,454 @@ static const struct page_operations page_cache_op = {
 
 tid_t page_cache_workerd;
 
+/* Where the worker maps cached pages: slot N at CACHE_BASE + N
+ * pages.  A page keeps its slot while it is cached, resident or
+ * not. */
+#define CACHE_BASE ((uint8_t *) 0x10000000)
+#define CACHE_SLOTS 8192
+
+/* Pages read ahead after a miss. */
+#define READ_AHEAD 4
+
+/* Writes through the cache before the worker writes back. */
+#define DIRTY_HIGH 64
+
+/* A page to read ahead. */
+struct ahead {
+	struct list_elem elem;      /* Element in requests. */
+	struct inode *inode;
+	size_t idx;
+};
+
+static struct thread *kworker;
+static struct hash cache;          /* Cached pages, by inode and index. */
+static struct bitmap *slots;       /* Slots in use. */
+static struct list requests;       /* Pages to read ahead. */
+static size_t dirty_cnt;           /* Writes since the last flush. */
+static bool flush_wanted;
+static struct semaphore kworker_wake;
+static struct semaphore kworker_ready;
+
+/* Protects everything above, and the cached pages' frames while
+ * they move in or out. */
+#define cache_lock (&kworker->spt.lock)
+
+static void page_cache_kworkerd (void *aux);
+static struct page *lookup (struct inode *, size_t idx);
+static struct page *page_create (struct inode *, size_t idx);
+static void reclaim_slots (void);
+static void write_back (struct page *);
+static void queue_ahead (struct inode *, size_t idx);
+static void flush (void);
+static uint64_t page_hash (const struct hash_elem *, void *);
+static bool page_less (const struct hash_elem *, const struct hash_elem *,
+		void *);
+
 /* The initializer of file vm */
 void
 pagecache_init (void) {
-	/* TODO: Create a worker daemon for page cache with page_cache_kworkerd */
+	hash_init (&cache, page_hash, page_less, NULL);
+	slots = bitmap_create (CACHE_SLOTS);
+	if (slots == NULL)
+		PANIC ("page cache creation failed");
+	list_init (&requests);
+	sema_init (&kworker_wake, 0);
+	sema_init (&kworker_ready, 0);
+
+	page_cache_workerd = thread_create ("kworkerd", PRI_DEFAULT,
+			page_cache_kworkerd, NULL);
+	if (page_cache_workerd == TID_ERROR)
+		PANIC ("cannot start page cache worker");
+	sema_down (&kworker_ready);
 }
 
 /* Initialize the page cache */
 bool
-page_cache_initializer (struct page *page, enum vm_type type, void *kva) {
+page_cache_initializer (struct page *page, enum vm_type type UNUSED,
+		void *kva UNUSED) {
 	/* Set up the handler */
 	page->operations = &page_cache_op;
+	page->owner = kworker;
+	page->writable = true;
+	page->vma = NULL;
+	return true;
+}
+
+/* Returns the page at index IDX of INODE, resident, with its frame
+ * pinned until page_cache_put().  Returns a null pointer if the
+ * cache cannot take it; the caller then goes to the disk itself. */
+struct page *
+page_cache_get (struct inode *inode, size_t idx) {
+	struct page *page;
+
+	lock_acquire (cache_lock);
+	page = lookup (inode, idx);
+	if (page == NULL)
+		page = page_create (inode, idx);
+	if (page != NULL && page->frame == NULL && !vm_load_page (page))
+		page = NULL;
+	if (page != NULL) {
+		page->page_cache.busy++;
+		page->frame->pinned = true;
+		pml4_set_accessed (kworker->pml4, page->va, true);
+	}
+	lock_release (cache_lock);
+	return page;
+}
+
+/* Unpins PAGE, which page_cache_get() returned.  DIRTY says that
+ * the caller wrote to it. */
+void
+page_cache_put (struct page *page, bool dirty) {
+	lock_acquire (cache_lock);
+	if (dirty) {
+		pml4_set_dirty (kworker->pml4, page->va, true);
+		if (++dirty_cnt >= DIRTY_HIGH && !flush_wanted) {
+			flush_wanted = true;
+			sema_up (&kworker_wake);
+		}
+	}
+	if (--page->page_cache.busy == 0)
+		page->frame->pinned = false;
+	lock_release (cache_lock);
+}
+
+/* Returns true if page IDX of INODE is in memory, so that getting
+ * it would not read the disk. */
+bool
+page_cache_resident (struct inode *inode, size_t idx) {
+	struct page *page;
+	bool resident;
+
+	lock_acquire (cache_lock);
+	page = lookup (inode, idx);
+	resident = page != NULL && page->frame != NULL;
+	lock_release (cache_lock);
+	return resident;
+}
+
+/* Reads SIZE bytes at OFFSET of INODE into BUFFER through the cache.
+ * BUFFER may be user memory: it is only touched without the cache
+ * lock, so faulting on it is fine.  Returns the number of bytes
+ * read, which is short at the end of the file. */
+off_t
+page_cache_read (struct inode *inode, void *buffer_, off_t size,
+		off_t offset) {
+	uint8_t *buffer = buffer_;
+	off_t length = inode_length (inode);
+	off_t bytes_read = 0;
+
+	while (size > 0 && offset < length) {
+		size_t ofs = offset % PGSIZE;
+		off_t chunk = PGSIZE - ofs;
+		struct page *page;
+
+		if (chunk > size)
+			chunk = size;
+		if (chunk > length - offset)
+			chunk = length - offset;
+
+		page = page_cache_get (inode, offset / PGSIZE);
+		if (page != NULL) {
+			memcpy (buffer + bytes_read, (uint8_t *) page->frame->kva + ofs,
+					chunk);
+			page_cache_put (page, false);
+		} else if (inode_read_direct (inode, buffer + bytes_read, chunk,
+					offset) != chunk)
+			break;
+
+		size -= chunk;
+		offset += chunk;
+		bytes_read += chunk;
+	}
+	return bytes_read;
+}
+
+/* Writes SIZE bytes from BUFFER at OFFSET of INODE through the
+ * cache, as page_cache_read() reads.  Files do not grow: returns the
+ * number of bytes written, which is short at the end of the file. */
+off_t
+page_cache_write (struct inode *inode, const void *buffer_, off_t size,
+		off_t offset) {
+	const uint8_t *buffer = buffer_;
+	off_t length = inode_length (inode);
+	off_t bytes_written = 0;
+
+	while (size > 0 && offset < length) {
+		size_t ofs = offset % PGSIZE;
+		off_t chunk = PGSIZE - ofs;
+		struct page *page;
+
+		if (chunk > size)
+			chunk = size;
+		if (chunk > length - offset)
+			chunk = length - offset;
 
+		page = page_cache_get (inode, offset / PGSIZE);
+		if (page != NULL) {
+			memcpy ((uint8_t *) page->frame->kva + ofs, buffer + bytes_written,
+					chunk);
+			page_cache_put (page, true);
+		} else if (inode_write_direct (inode, buffer + bytes_written, chunk,
+					offset) != chunk)
+			break;
+
+		size -= chunk;
+		offset += chunk;
+		bytes_written += chunk;
+	}
+	return bytes_written;
+}
+
+/* Removes the pages of INODE, which is being closed for the last
+ * time, from the cache, first writing back the dirty ones if
+ * WRITE. */
+void
+page_cache_drop (struct inode *inode, bool write) {
+	size_t cnt = DIV_ROUND_UP (inode_length (inode), PGSIZE);
+	struct list_elem *e;
+	size_t idx;
+
+	lock_acquire (cache_lock);
+	for (e = list_begin (&requests); e != list_end (&requests);) {
+		struct ahead *a = list_entry (e, struct ahead, elem);
+
+		e = list_next (e);
+		if (a->inode == inode) {
+			list_remove (&a->elem);
+			free (a);
+		}
+	}
+
+	for (idx = 0; idx < cnt; idx++) {
+		struct page *page = lookup (inode, idx);
+
+		if (page == NULL)
+			continue;
+		ASSERT (page->page_cache.busy == 0);
+		if (write)
+			write_back (page);
+		hash_delete (&cache, &page->page_cache.elem);
+		vm_dealloc_page (page);
+	}
+	lock_release (cache_lock);
+}
+
+/* Writes back every dirty page in the cache. */
+void
+page_cache_flush (void) {
+	lock_acquire (cache_lock);
+	flush ();
+	lock_release (cache_lock);
 }
 
 /* Utilze the Swap in mechanism to implement readhead */
 static bool
 page_cache_readahead (struct page *page, void *kva) {
+	struct page_cache *pc = &page->page_cache;
+	off_t ofs = pc->idx * PGSIZE;
+	off_t read = inode_read_direct (pc->inode, kva, PGSIZE, ofs);
+
+	memset ((uint8_t *) kva + read, 0, PGSIZE - read);
+
+	/* A miss: the pages after it are likely wanted next. */
+	if (pc->ahead)
+		pc->ahead = false;
+	else
+		queue_ahead (pc->inode, pc->idx);
+	return true;
 }
 
 /* Utilze the Swap out mechanism to implement writeback */
 static bool
 page_cache_writeback (struct page *page) {
+	write_back (page);
+	return true;
 }
 
 /* Destory the page_cache. */
 static void
 page_cache_destroy (struct page *page) {
+	vm_free_frame (page);
+	bitmap_reset (slots, ((uint8_t *) page->va - CACHE_BASE) / PGSIZE);
 }
 
 /* Worker thread for page cache */
 static void
-page_cache_kworkerd (void *aux) {
+page_cache_kworkerd (void *aux UNUSED) {
+	kworker = thread_current ();
+	kworker->pml4 = pml4_create ();
+	if (kworker->pml4 == NULL)
+		PANIC ("cannot create page cache address space");
+	sema_up (&kworker_ready);
+
+	for (;;) {
+		sema_down (&kworker_wake);
+
+		lock_acquire (cache_lock);
+		while (!list_empty (&requests)) {
+			struct ahead *a = list_entry (list_pop_front (&requests),
+					struct ahead, elem);
+			struct page *page = lookup (a->inode, a->idx);
+
+			if (page == NULL)
+				page = page_create (a->inode, a->idx);
+			free (a);
+			if (page == NULL || page->frame != NULL)
+				continue;
+
+			/* Only into free frames: reading ahead is not worth
+			 * evicting anything for. */
+			page->page_cache.ahead = true;
+			if (!vm_prefetch_page (page)) {
+				page->page_cache.ahead = false;
+				while (!list_empty (&requests))
+					free (list_entry (list_pop_front (&requests),
+								struct ahead, elem));
+			}
+		}
+		if (flush_wanted) {
+			flush_wanted = false;
+			flush ();
+		}
+		lock_release (cache_lock);
+	}
+}
+
+/* Returns the cached page at index IDX of INODE, or a null pointer
+ * if there is none. */
+static struct page *
+lookup (struct inode *inode, size_t idx) {
+	struct page key;
+	struct hash_elem *e;
+
+	key.page_cache.inode = inode;
+	key.page_cache.idx = idx;
+	e = hash_find (&cache, &key.page_cache.elem);
+	return e != NULL ? hash_entry (e, struct page, page_cache.elem) : NULL;
+}
+
+/* Adds page IDX of INODE to the cache, not yet resident.  Returns a
+ * null pointer if memory or slots are exhausted. */
+static struct page *
+page_create (struct inode *inode, size_t idx) {
+	struct page *page;
+	size_t slot;
+
+	ASSERT (lock_held_by_current_thread (cache_lock));
+
+	slot = bitmap_scan_and_flip (slots, 0, 1, false);
+	if (slot == BITMAP_ERROR) {
+		reclaim_slots ();
+		slot = bitmap_scan_and_flip (slots, 0, 1, false);
+		if (slot == BITMAP_ERROR)
+			return NULL;
+	}
+	page = malloc (sizeof *page);
+	if (page == NULL) {
+		bitmap_reset (slots, slot);
+		return NULL;
+	}
+
+	*page = (struct page) {
+		.va = CACHE_BASE + slot * PGSIZE,
+		.frame = NULL,
+	};
+	page_cache_initializer (page, VM_PAGE_CACHE, NULL);
+	page->page_cache.inode = inode;
+	page->page_cache.idx = idx;
+	hash_insert (&cache, &page->page_cache.elem);
+	return page;
+}
+
+/* Frees the slots of cached pages that have been evicted, which
+ * hold nothing but their place. */
+static void
+reclaim_slots (void) {
+	struct page *victims[64];
+	struct hash_iterator i;
+	size_t cnt = 0;
+	size_t n;
+
+	hash_first (&i, &cache);
+	while (cnt < sizeof victims / sizeof *victims && hash_next (&i)) {
+		struct page *page = hash_entry (hash_cur (&i), struct page,
+				page_cache.elem);
+		if (page->frame == NULL)
+			victims[cnt++] = page;
+	}
+	for (n = 0; n < cnt; n++) {
+		hash_delete (&cache, &victims[n]->page_cache.elem);
+		vm_dealloc_page (victims[n]);
+	}
+}
+
+/* Writes PAGE to its file if it, or any page sharing its frame, was
+ * written to since it was last written back. */
+static void
+write_back (struct page *page) {
+	struct page_cache *pc = &page->page_cache;
+	off_t ofs = pc->idx * PGSIZE;
+	off_t length = inode_length (pc->inode);
+
+	if (page->frame == NULL || !vm_frame_clean (page->frame) || ofs >= length)
+		return;
+	inode_write_direct (pc->inode, page->frame->kva,
+			length - ofs < PGSIZE ? length - ofs : PGSIZE, ofs);
+	vm_count_event (NULL, VM_WRITEBACK);
+}
+
+/* Asks the worker to read the pages after page IDX of INODE. */
+static void
+queue_ahead (struct inode *inode, size_t idx) {
+	size_t last = DIV_ROUND_UP (inode_length (inode), PGSIZE);
+	size_t n;
+
+	for (n = idx + 1; n < last && n <= idx + READ_AHEAD; n++) {
+		struct ahead *a = malloc (sizeof *a);
+
+		if (a == NULL)
+			break;
+		a->inode = inode;
+		a->idx = n;
+		list_push_back (&requests, &a->elem);
+	}
+	if (n > idx + 1)
+		sema_up (&kworker_wake);
+}
+
+/* Writes back every dirty page. */
+static void
+flush (void) {
+	struct hash_iterator i;
+
+	ASSERT (lock_held_by_current_thread (cache_lock));
+
+	hash_first (&i, &cache);
+	while (hash_next (&i))
+		write_back (hash_entry (hash_cur (&i), struct page, page_cache.elem));
+	dirty_cnt = 0;
+}
+
+/* Returns a hash of page E's inode and index. */
+static uint64_t
+page_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct page_cache *pc = &hash_entry (e, struct page,
+			page_cache.elem)->page_cache;
+	return hash_bytes (&pc->inode, sizeof pc->inode) ^ hash_int (pc->idx);
+}
+
+/* Returns true if page A precedes page B. */
+static bool
+page_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct page_cache *a = &hash_entry (a_, struct page,
+			page_cache.elem)->page_cache;
+	const struct page_cache *b = &hash_entry (b_, struct page,
+			page_cache.elem)->page_cache;
+
+	if (a->inode != b->inode)
+		return (uintptr_t) a->inode < (uintptr_t) b->inode;
+	return a->idx < b->idx;
 }
+#endif /* VM && EFILESYS */
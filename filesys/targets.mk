@@ -5,4 +5,7 @@ filesys_SRC += filesys/file.c		# Files.
 filesys_SRC += filesys/directory.c	# Directories.
 filesys_SRC += filesys/inode.c		# File headers.
 filesys_SRC += filesys/fsutil.c		# Utilities.
+filesys_SRC += filesys/mount.c		# Mount table.
+filesys_SRC += filesys/tmpfs.c		# In-memory file system.
+filesys_SRC += filesys/initramfs.c	# Boot-time read-only archive.
 filesys_SRC += filesys/page_cache.c		# Page cache.
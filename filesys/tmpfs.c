@@ -0,0 +1,493 @@
+/* tmpfs.c: File system that lives entirely in memory.
+ *
+ * Inodes and directories are plain kernel objects, and file data
+ * is kept in kernel pages that are allocated on first write, so
+ * nothing ever reaches a disk.  Files grow on write; unwritten
+ * parts read back as zeros.  Everything is lost at unmount. */
+
+#include "filesys/tmpfs.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* A mounted tmpfs. */
+struct tmpfs {
+	struct tmpfs_node *root;    /* Root directory. */
+	struct lock lock;           /* Protects every node below. */
+	size_t page_cnt;            /* Data pages in use. */
+	size_t page_limit;          /* Maximum data pages, 0 for none. */
+	int open_cnt;               /* Number of open files. */
+};
+
+/* A file or directory. */
+struct tmpfs_node {
+	struct tmpfs *fs;           /* Owning file system. */
+	struct tmpfs_node *parent;  /* Parent directory, null if removed. */
+	struct list_elem elem;      /* Element in parent's children. */
+	char name[NAME_MAX + 1];    /* Name within parent. */
+	bool is_dir;                /* Directory or regular file? */
+
+	struct list children;       /* Directory: entries. */
+
+	off_t length;               /* File: size in bytes. */
+	uint8_t **pages;            /* File: data pages, null for holes. */
+	size_t pages_len;           /* File: number of slots in PAGES. */
+	int open_cnt;               /* File: number of openers. */
+	int deny_write_cnt;         /* File: 0: writes ok, >0: deny writes. */
+};
+
+static void *tmpfs_file_reopen (void *);
+static void tmpfs_file_close (void *);
+static off_t tmpfs_file_read_at (void *, void *, off_t, off_t);
+static off_t tmpfs_file_write_at (void *, const void *, off_t, off_t);
+static off_t tmpfs_file_length (void *);
+static void tmpfs_file_deny_write (void *);
+static void tmpfs_file_allow_write (void *);
+
+static const struct file_operations tmpfs_file_ops = {
+	.reopen = tmpfs_file_reopen,
+	.close = tmpfs_file_close,
+	.read_at = tmpfs_file_read_at,
+	.write_at = tmpfs_file_write_at,
+	.length = tmpfs_file_length,
+	.deny_write = tmpfs_file_deny_write,
+	.allow_write = tmpfs_file_allow_write,
+};
+
+static bool tmpfs_create_file (void *, const char *, off_t);
+static bool tmpfs_mkdir (void *, const char *);
+static struct file *tmpfs_open (void *, const char *);
+static bool tmpfs_remove (void *, const char *);
+static bool tmpfs_unmount (void *);
+
+const struct fs_operations tmpfs_ops = {
+	.create = tmpfs_create_file,
+	.mkdir = tmpfs_mkdir,
+	.open = tmpfs_open,
+	.remove = tmpfs_remove,
+	.unmount = tmpfs_unmount,
+};
+
+static struct tmpfs_node *node_create (struct tmpfs *, struct tmpfs_node *dir,
+		const char *name, bool is_dir);
+static void node_free (struct tmpfs_node *);
+static bool reserve_page (struct tmpfs_node *, size_t page_idx);
+static struct tmpfs_node *lookup (struct tmpfs_node *dir, const char *name);
+static struct tmpfs_node *walk (struct tmpfs *, const char *path,
+		char last[NAME_MAX + 1]);
+
+/* Creates an empty tmpfs that may hold up to PAGE_LIMIT pages of
+ * file data, or any amount if PAGE_LIMIT is 0.  Returns a null
+ * pointer if memory is short. */
+void *
+tmpfs_create (size_t page_limit) {
+	struct tmpfs *fs = malloc (sizeof *fs);
+	if (fs == NULL)
+		return NULL;
+
+	lock_init (&fs->lock);
+	fs->page_cnt = 0;
+	fs->page_limit = page_limit;
+	fs->open_cnt = 0;
+	fs->root = node_create (fs, NULL, "", true);
+	if (fs->root == NULL) {
+		free (fs);
+		return NULL;
+	}
+	return fs;
+}
+
+/* File system operations. */
+
+/* Creates a regular file NAME that reads as INITIAL_SIZE zeros.
+ * No memory is committed for it until it is written. */
+static bool
+tmpfs_create_file (void *fs_, const char *name, off_t initial_size) {
+	struct tmpfs *fs = fs_;
+	struct tmpfs_node *dir, *node = NULL;
+	char last[NAME_MAX + 1];
+
+	if (initial_size < 0)
+		return false;
+	lock_acquire (&fs->lock);
+	dir = walk (fs, name, last);
+	if (dir != NULL && lookup (dir, last) == NULL)
+		node = node_create (fs, dir, last, false);
+	if (node != NULL)
+		node->length = initial_size;
+	lock_release (&fs->lock);
+
+	return node != NULL;
+}
+
+/* Creates an empty directory NAME. */
+static bool
+tmpfs_mkdir (void *fs_, const char *name) {
+	struct tmpfs *fs = fs_;
+	struct tmpfs_node *dir, *node = NULL;
+	char last[NAME_MAX + 1];
+
+	lock_acquire (&fs->lock);
+	dir = walk (fs, name, last);
+	if (dir != NULL && lookup (dir, last) == NULL)
+		node = node_create (fs, dir, last, true);
+	lock_release (&fs->lock);
+
+	return node != NULL;
+}
+
+/* Opens regular file NAME. */
+static struct file *
+tmpfs_open (void *fs_, const char *name) {
+	struct tmpfs *fs = fs_;
+	struct tmpfs_node *dir, *node = NULL;
+	char last[NAME_MAX + 1];
+
+	lock_acquire (&fs->lock);
+	dir = walk (fs, name, last);
+	if (dir != NULL)
+		node = lookup (dir, last);
+	if (node != NULL && !node->is_dir) {
+		node->open_cnt++;
+		fs->open_cnt++;
+	} else
+		node = NULL;
+	lock_release (&fs->lock);
+
+	return file_open_obj (&tmpfs_file_ops, node);
+}
+
+/* Removes NAME, which must be a file or an empty directory.
+ * An open file keeps its contents until it is last closed. */
+static bool
+tmpfs_remove (void *fs_, const char *name) {
+	struct tmpfs *fs = fs_;
+	struct tmpfs_node *dir, *node = NULL;
+	char last[NAME_MAX + 1];
+	bool success = false;
+
+	lock_acquire (&fs->lock);
+	dir = walk (fs, name, last);
+	if (dir != NULL)
+		node = lookup (dir, last);
+	if (node != NULL && (!node->is_dir || list_empty (&node->children))) {
+		list_remove (&node->elem);
+		node->parent = NULL;
+		if (node->is_dir || node->open_cnt == 0)
+			node_free (node);
+		success = true;
+	}
+	lock_release (&fs->lock);
+
+	return success;
+}
+
+/* Frees FS and all of its contents, unless a file is open. */
+static bool
+tmpfs_unmount (void *fs_) {
+	struct tmpfs *fs = fs_;
+	struct tmpfs_node *dir;
+
+	if (fs->open_cnt > 0)
+		return false;
+
+	/* Free the tree bottom-up without recursion. */
+	dir = fs->root;
+	while (dir != NULL) {
+		if (!list_empty (&dir->children)) {
+			struct tmpfs_node *child = list_entry (list_front (&dir->children),
+					struct tmpfs_node, elem);
+			if (child->is_dir)
+				dir = child;
+			else {
+				list_remove (&child->elem);
+				node_free (child);
+			}
+		} else {
+			struct tmpfs_node *parent = dir->parent;
+			if (parent != NULL)
+				list_remove (&dir->elem);
+			node_free (dir);
+			dir = parent;
+		}
+	}
+	ASSERT (fs->page_cnt == 0);
+	free (fs);
+	return true;
+}
+
+/* Open file operations. */
+
+static void *
+tmpfs_file_reopen (void *node_) {
+	struct tmpfs_node *node = node_;
+	struct tmpfs *fs = node->fs;
+
+	lock_acquire (&fs->lock);
+	node->open_cnt++;
+	fs->open_cnt++;
+	lock_release (&fs->lock);
+	return node;
+}
+
+static void
+tmpfs_file_close (void *node_) {
+	struct tmpfs_node *node = node_;
+	struct tmpfs *fs = node->fs;
+
+	lock_acquire (&fs->lock);
+	fs->open_cnt--;
+	if (--node->open_cnt == 0 && node->parent == NULL)
+		node_free (node);
+	lock_release (&fs->lock);
+}
+
+/* Reads up to SIZE bytes at OFFSET into BUFFER.
+ *
+ * BUFFER may be user memory, and a fault on it may come back into
+ * this file system, for a file mapped from it, so it is never
+ * touched with the lock held: data passes through a kernel bounce
+ * page one chunk at a time instead.  Writes do the same. */
+static off_t
+tmpfs_file_read_at (void *node_, void *buffer_, off_t size, off_t offset) {
+	struct tmpfs_node *node = node_;
+	uint8_t *buffer = buffer_;
+	uint8_t *bounce;
+	off_t bytes_read = 0;
+
+	if (offset < 0 || size <= 0)
+		return 0;
+	bounce = palloc_get_page (0);
+	if (bounce == NULL)
+		return 0;
+
+	while (size > 0) {
+		size_t page_idx = offset / PGSIZE;
+		int page_ofs = offset % PGSIZE;
+		int page_left = PGSIZE - page_ofs;
+		off_t node_left;
+		int chunk_size;
+
+		lock_acquire (&node->fs->lock);
+		node_left = node->length - offset;
+		if (node_left <= 0) {
+			lock_release (&node->fs->lock);
+			break;
+		}
+		chunk_size = node_left < page_left ? node_left : page_left;
+		if (size < chunk_size)
+			chunk_size = size;
+		if (page_idx < node->pages_len && node->pages[page_idx] != NULL)
+			memcpy (bounce, node->pages[page_idx] + page_ofs, chunk_size);
+		else
+			memset (bounce, 0, chunk_size);
+		lock_release (&node->fs->lock);
+
+		memcpy (buffer + bytes_read, bounce, chunk_size);
+		size -= chunk_size;
+		offset += chunk_size;
+		bytes_read += chunk_size;
+	}
+	palloc_free_page (bounce);
+
+	return bytes_read;
+}
+
+/* Writes SIZE bytes from BUFFER at OFFSET, growing the file as
+ * needed.  Returns fewer than SIZE bytes if the file system runs
+ * out of pages. */
+static off_t
+tmpfs_file_write_at (void *node_, const void *buffer_, off_t size,
+		off_t offset) {
+	struct tmpfs_node *node = node_;
+	struct tmpfs *fs = node->fs;
+	const uint8_t *buffer = buffer_;
+	uint8_t *bounce;
+	off_t bytes_written = 0;
+
+	/* The end of the write must be a valid offset. */
+	if (offset < 0 || size <= 0 || size > INT32_MAX - offset)
+		return 0;
+	bounce = palloc_get_page (0);
+	if (bounce == NULL)
+		return 0;
+
+	while (size > 0) {
+		size_t page_idx = offset / PGSIZE;
+		int page_ofs = offset % PGSIZE;
+		int page_left = PGSIZE - page_ofs;
+		int chunk_size = size < page_left ? size : page_left;
+		bool ok;
+
+		memcpy (bounce, buffer + bytes_written, chunk_size);
+
+		lock_acquire (&fs->lock);
+		ok = !node->deny_write_cnt && reserve_page (node, page_idx);
+		if (ok) {
+			memcpy (node->pages[page_idx] + page_ofs, bounce, chunk_size);
+			if (offset + chunk_size > node->length)
+				node->length = offset + chunk_size;
+		}
+		lock_release (&fs->lock);
+		if (!ok)
+			break;
+
+		size -= chunk_size;
+		offset += chunk_size;
+		bytes_written += chunk_size;
+	}
+	palloc_free_page (bounce);
+
+	return bytes_written;
+}
+
+/* Makes sure data page PAGE_IDX of NODE exists, growing its page
+ * pointers as needed.  Returns false if the file system is full or
+ * memory is exhausted.  The file system lock must be held. */
+static bool
+reserve_page (struct tmpfs_node *node, size_t page_idx) {
+	struct tmpfs *fs = node->fs;
+
+	if (page_idx >= node->pages_len) {
+		size_t len = node->pages_len ? node->pages_len : 1;
+		uint8_t **pages;
+
+		while (len <= page_idx)
+			len *= 2;
+		pages = realloc (node->pages, len * sizeof *pages);
+		if (pages == NULL)
+			return false;
+		memset (pages + node->pages_len, 0,
+				(len - node->pages_len) * sizeof *pages);
+		node->pages = pages;
+		node->pages_len = len;
+	}
+
+	if (node->pages[page_idx] == NULL) {
+		if (fs->page_limit != 0 && fs->page_cnt >= fs->page_limit)
+			return false;
+		node->pages[page_idx] = palloc_get_page (PAL_ZERO);
+		if (node->pages[page_idx] == NULL)
+			return false;
+		fs->page_cnt++;
+	}
+	return true;
+}
+
+static off_t
+tmpfs_file_length (void *node_) {
+	struct tmpfs_node *node = node_;
+	return node->length;
+}
+
+static void
+tmpfs_file_deny_write (void *node_) {
+	struct tmpfs_node *node = node_;
+
+	lock_acquire (&node->fs->lock);
+	node->deny_write_cnt++;
+	ASSERT (node->deny_write_cnt <= node->open_cnt);
+	lock_release (&node->fs->lock);
+}
+
+static void
+tmpfs_file_allow_write (void *node_) {
+	struct tmpfs_node *node = node_;
+
+	lock_acquire (&node->fs->lock);
+	ASSERT (node->deny_write_cnt > 0);
+	node->deny_write_cnt--;
+	lock_release (&node->fs->lock);
+}
+
+/* Helpers.  The file system lock must be held, except while the
+ * file system is being created or unmounted. */
+
+/* Creates a node NAME in directory DIR, or a parentless node if
+ * DIR is null.  Returns the new node, or a null pointer if memory
+ * is short. */
+static struct tmpfs_node *
+node_create (struct tmpfs *fs, struct tmpfs_node *dir, const char *name,
+		bool is_dir) {
+	struct tmpfs_node *node = calloc (1, sizeof *node);
+	if (node == NULL)
+		return NULL;
+
+	node->fs = fs;
+	node->parent = dir;
+	strlcpy (node->name, name, sizeof node->name);
+	node->is_dir = is_dir;
+	list_init (&node->children);
+	if (dir != NULL)
+		list_push_back (&dir->children, &node->elem);
+	return node;
+}
+
+/* Frees NODE, which must already be unlinked from its parent,
+ * along with its data pages. */
+static void
+node_free (struct tmpfs_node *node) {
+	size_t i;
+
+	for (i = 0; i < node->pages_len; i++)
+		if (node->pages[i] != NULL) {
+			palloc_free_page (node->pages[i]);
+			node->fs->page_cnt--;
+		}
+	free (node->pages);
+	free (node);
+}
+
+/* Returns the entry NAME of directory DIR, or a null pointer. */
+static struct tmpfs_node *
+lookup (struct tmpfs_node *dir, const char *name) {
+	struct list_elem *e;
+
+	for (e = list_begin (&dir->children); e != list_end (&dir->children);
+			e = list_next (e)) {
+		struct tmpfs_node *node = list_entry (e, struct tmpfs_node, elem);
+		if (!strcmp (node->name, name))
+			return node;
+	}
+	return NULL;
+}
+
+/* Resolves all but the last component of PATH, relative to the
+ * root of FS, and copies the last component into LAST.  Returns
+ * the directory that should contain LAST, or a null pointer if
+ * PATH is empty, a component is too long, or an intermediate
+ * component is missing or is not a directory. */
+static struct tmpfs_node *
+walk (struct tmpfs *fs, const char *path, char last[NAME_MAX + 1]) {
+	struct tmpfs_node *dir = fs->root;
+
+	for (;;) {
+		size_t len;
+
+		while (*path == '/')
+			path++;
+		len = strcspn (path, "/");
+		if (len == 0 || len > NAME_MAX)
+			return NULL;
+		memcpy (last, path, len);
+		last[len] = '\0';
+		path += len;
+
+		while (*path == '/')
+			path++;
+		if (*path == '\0')
+			return dir;
+
+		dir = lookup (dir, last);
+		if (dir == NULL || !dir->is_dir)
+			return NULL;
+	}
+}
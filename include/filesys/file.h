@@ -5,8 +5,24 @@
 
 struct inode;
 
+/* Operations on the object behind an open file.
+ * Disk files are backed by a struct inode; file systems mounted
+ * through filesys/mount.c supply their own table, so the file
+ * system calls work unchanged on them. */
+struct file_operations
+{
+	void *(*reopen)(void *obj);
+	void (*close)(void *obj);
+	off_t (*read_at)(void *obj, void *buffer, off_t size, off_t ofs);
+	off_t (*write_at)(void *obj, const void *buffer, off_t size, off_t ofs);
+	off_t (*length)(void *obj);
+	void (*deny_write)(void *obj);
+	void (*allow_write)(void *obj);
+};
+
 /* Opening and closing files. */
 struct file *file_open(struct inode *);
+struct file *file_open_obj(const struct file_operations *, void *obj);
 struct file *file_reopen(struct file *);
 struct file *file_duplicate(struct file *file);
 void file_close(struct file *);
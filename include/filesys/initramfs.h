@@ -0,0 +1,12 @@
+#ifndef FILESYS_INITRAMFS_H
+#define FILESYS_INITRAMFS_H
+
+#include <stdbool.h>
+
+struct file;
+
+void initramfs_init (void);
+bool initramfs_contains (const char *name);
+struct file *initramfs_open (const char *name);
+
+#endif /* filesys/initramfs.h */
@@ -0,0 +1,41 @@
+#ifndef FILESYS_MOUNT_H
+#define FILESYS_MOUNT_H
+
+#include <stdbool.h>
+#include "filesys/off_t.h"
+
+/* CHAN_NO value of mount() that requests a tmpfs instead of a
+ * disk.  DEV_NO is then the size limit in kB, or 0 for none. */
+#define MOUNT_TMPFS (-1)
+
+/* Maximum length of a mount point path. */
+#define MOUNT_PATH_MAX 63
+
+struct file;
+
+/* The function table of a mounted file system.
+ * NAME is always relative to the mount point, with leading
+ * slashes removed; it is empty for the mount point itself. */
+struct fs_operations {
+	bool (*create) (void *fs, const char *name, off_t initial_size);
+	bool (*mkdir) (void *fs, const char *name);
+	struct file *(*open) (void *fs, const char *name);
+	bool (*remove) (void *fs, const char *name);
+	/* Releases FS.  Returns false, leaving FS mounted, if it is
+	 * still in use. */
+	bool (*unmount) (void *fs);
+};
+
+/* A file system mounted at PATH. */
+struct mount;
+
+void mount_init (void);
+bool mount_add (const char *path, const struct fs_operations *, void *fs);
+bool mount_remove (const char *path);
+
+struct mount *mount_acquire (const char *name, const char **rest);
+void mount_release (struct mount *);
+const struct fs_operations *mount_ops (struct mount *);
+void *mount_fs (struct mount *);
+
+#endif /* filesys/mount.h */
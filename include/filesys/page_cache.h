@@ -1,12 +1,38 @@
+/* vm/vm.h includes this file in turn, once it has declared what
+ * is used here, so include it first. */
+#include "vm/vm.h"
+
 #ifndef FILESYS_PAGE_CACHE_H
 #define FILESYS_PAGE_CACHE_H
-#include "vm/vm.h"
+#include <hash.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "filesys/off_t.h"
 
 struct page;
+struct inode;
 enum vm_type;
 
-struct page_cache {};
+/* A page of a file on disk, held in memory.  Every process that
+ * maps the page, and every read() and write() of it, goes through
+ * the same frame. */
+struct page_cache {
+	struct inode *inode;        /* File it belongs to. */
+	size_t idx;                 /* Page index within the file. */
+	unsigned busy;              /* Users copying to or from it. */
+	bool ahead;                 /* Loaded by read-ahead? */
+	struct hash_elem elem;      /* Element in the cache. */
+};
 
-void page_cache_init (void);
+void pagecache_init (void);
 bool page_cache_initializer (struct page *page, enum vm_type type, void *kva);
+
+struct page *page_cache_get (struct inode *, size_t idx);
+void page_cache_put (struct page *, bool dirty);
+bool page_cache_resident (struct inode *, size_t idx);
+off_t page_cache_read (struct inode *, void *, off_t size, off_t offset);
+off_t page_cache_write (struct inode *, const void *, off_t size,
+		off_t offset);
+void page_cache_drop (struct inode *, bool write);
+void page_cache_flush (void);
 #endif
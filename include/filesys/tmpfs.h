@@ -0,0 +1,11 @@
+#ifndef FILESYS_TMPFS_H
+#define FILESYS_TMPFS_H
+
+#include <stddef.h>
+#include "filesys/mount.h"
+
+extern const struct fs_operations tmpfs_ops;
+
+void *tmpfs_create (size_t page_limit);
+
+#endif /* filesys/tmpfs.h */
@@ -18,7 +18,20 @@
  * conversion from a struct hash_elem back to a structure object
  * that contains it.  This is the same technique used in the
  * linked list implementation.  Refer to lib/kernel/list.h for a
- * detailed explanation. */
+ * detailed explanation.
+ *
+ * The table is resized incrementally, so that no single insertion
+ * or deletion has to move every element.  When the number of
+ * buckets should change, a new array of buckets is allocated and
+ * the old one is kept beside it; after that, each insertion,
+ * replacement or deletion moves the elements of a few old buckets
+ * into the new ones, until none are left.  Meanwhile, lookups
+ * search both.  The operation that starts a resize still
+ * initializes every new bucket, which is O(n), but that is only
+ * a store or two per bucket rather than rehashing each element.
+ *
+ * For small integer keys that need not be embedded in their
+ * objects, see lib/kernel/ohash.h. */
 
 #include <stdbool.h>
 #include <stddef.h>
@@ -59,6 +72,9 @@ struct hash {
 	size_t elem_cnt;            /* Number of elements in table. */
 	size_t bucket_cnt;          /* Number of buckets, a power of 2. */
 	struct list *buckets;       /* Array of `bucket_cnt' lists. */
+	size_t old_bucket_cnt;      /* Number of old buckets, while resizing. */
+	struct list *old_buckets;   /* Buckets being emptied, or null. */
+	size_t moved;               /* Old buckets emptied so far. */
 	hash_hash_func *hash;       /* Hash function. */
 	hash_less_func *less;       /* Comparison function. */
 	void *aux;                  /* Auxiliary data for `hash' and `less'. */
@@ -69,6 +85,7 @@ struct hash_iterator {
 	struct hash *hash;          /* The hash table. */
 	struct list *bucket;        /* Current bucket. */
 	struct hash_elem *elem;     /* Current hash element in current bucket. */
+	bool old;                   /* Is BUCKET one of the old buckets? */
 };
 
 /* Basic life cycle. */
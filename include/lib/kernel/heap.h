@@ -0,0 +1,79 @@
+#ifndef __LIB_KERNEL_HEAP_H
+#define __LIB_KERNEL_HEAP_H
+
+/* Pairing heap.
+ *
+ * A priority queue: it finds its least element in O(1) time,
+ * inserts in O(1), and removes the least or any other element in
+ * O(log n) amortized time.  Unlike struct rbtree, it does not keep
+ * the other elements in order, which makes it cheaper when only
+ * the least is ever wanted, as in a queue of timers.
+ *
+ * Like struct list, it needs no dynamically allocated memory: each
+ * structure that may be in a heap embeds a struct heap_elem member,
+ * and heap_entry converts a struct heap_elem back to the structure
+ * that contains it.  For example:
+ *
+ * struct foo {
+ *   struct heap_elem elem;
+ *   int64_t deadline;
+ *   ...other members...
+ * };
+ *
+ * struct heap foo_heap;
+ *
+ * heap_init (&foo_heap, foo_less, NULL);
+ * heap_push (&foo_heap, &f->elem);
+ * ...
+ * f = heap_entry (heap_pop (&foo_heap), struct foo, elem);
+ *
+ * Equal elements come out in no particular order. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Heap element. */
+struct heap_elem {
+	struct heap_elem *child;    /* Leftmost child, or null. */
+	struct heap_elem *next;     /* Next sibling, or null. */
+	struct heap_elem *prev;     /* Previous sibling, or the parent if
+	                               leftmost, or null at the root. */
+};
+
+/* Compares the value of two heap elements A and B, given
+   auxiliary data AUX.  Returns true if A is less than B, or
+   false if A is greater than or equal to B. */
+typedef bool heap_less_func (const struct heap_elem *a,
+                             const struct heap_elem *b,
+                             void *aux);
+
+/* Pairing heap. */
+struct heap {
+	struct heap_elem *root;     /* Least element, or null if empty. */
+	size_t elem_cnt;            /* Number of elements. */
+	heap_less_func *less;       /* Comparison function. */
+	void *aux;                  /* Auxiliary data for `less'. */
+};
+
+/* Converts pointer to heap element HEAP_ELEM into a pointer to
+   the structure that HEAP_ELEM is embedded inside.  Supply the
+   name of the outer structure STRUCT and the member name MEMBER
+   of the heap element.  See the big comment at the top of the
+   file for an example. */
+#define heap_entry(HEAP_ELEM, STRUCT, MEMBER)           \
+	((STRUCT *) ((uint8_t *) &(HEAP_ELEM)->child    \
+		- offsetof (STRUCT, MEMBER.child)))
+
+void heap_init (struct heap *, heap_less_func *, void *aux);
+
+void heap_push (struct heap *, struct heap_elem *);
+struct heap_elem *heap_min (struct heap *);
+struct heap_elem *heap_pop (struct heap *);
+void heap_remove (struct heap *, struct heap_elem *);
+void heap_update (struct heap *, struct heap_elem *);
+
+size_t heap_size (struct heap *);
+bool heap_empty (struct heap *);
+
+#endif /* lib/kernel/heap.h */
@@ -0,0 +1,57 @@
+#ifndef __LIB_KERNEL_OHASH_H
+#define __LIB_KERNEL_OHASH_H
+
+/* Open-addressing hash table.
+ *
+ * Maps 64-bit integer keys, such as page numbers or inode sector
+ * numbers, to pointers.  Unlike struct hash, nothing is embedded in
+ * the objects: the table holds the keys and values itself, in one
+ * array of slots, so that a lookup touches one or two cache lines
+ * instead of following a chain.
+ *
+ * Next to the slots is an array of control bytes, one per slot,
+ * which say whether the slot is empty, deleted, or full, and for a
+ * full slot hold 7 bits of its key's hash.  Slots are probed in
+ * groups of 8, whose control bytes are read as one 64-bit word and
+ * matched all at once with a few integer operations, the way SIMD
+ * hash tables do it with vector registers.  Only a slot whose 7
+ * bits match has its key compared.
+ *
+ * The table grows all at once, so it suits small and medium tables;
+ * for large ones, where a resize would stall, use struct hash,
+ * which resizes incrementally. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* A key and its value. */
+struct ohash_slot {
+	uint64_t key;
+	void *value;
+};
+
+/* Open-addressing hash table. */
+struct ohash {
+	size_t cnt;                 /* Number of keys in the table. */
+	size_t deleted;             /* Number of deleted slots. */
+	size_t slot_cnt;            /* Number of slots, a power of 2. */
+	uint8_t *ctrl;              /* Control byte of each slot. */
+	struct ohash_slot *slots;   /* Array of `slot_cnt' slots. */
+};
+
+/* Performs some operation on KEY and its VALUE, given auxiliary
+ * data AUX. */
+typedef void ohash_action_func (uint64_t key, void *value, void *aux);
+
+bool ohash_init (struct ohash *);
+void ohash_destroy (struct ohash *);
+
+bool ohash_insert (struct ohash *, uint64_t key, void *value);
+void *ohash_find (struct ohash *, uint64_t key);
+void *ohash_delete (struct ohash *, uint64_t key);
+
+void ohash_apply (struct ohash *, ohash_action_func *, void *aux);
+size_t ohash_size (struct ohash *);
+
+#endif /* lib/kernel/ohash.h */
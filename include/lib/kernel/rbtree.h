@@ -0,0 +1,101 @@
+#ifndef __LIB_KERNEL_RBTREE_H
+#define __LIB_KERNEL_RBTREE_H
+
+/* Red-black tree.
+ *
+ * A balanced binary search tree that keeps its elements sorted
+ * and inserts, removes, and finds the minimum in O(log n) time.
+ * Like struct list, it needs no dynamically allocated memory:
+ * each structure that may be in a tree embeds a struct rb_elem
+ * member, and rb_entry converts a struct rb_elem back to the
+ * structure that contains it.
+ *
+ * For example, a tree of `struct foo' ordered by `bar':
+ *
+ * struct foo {
+ *   struct rb_elem elem;
+ *   int bar;
+ *   ...other members...
+ * };
+ *
+ * static bool
+ * foo_less (const struct rb_elem *a, const struct rb_elem *b,
+ *           void *aux UNUSED) {
+ *   return rb_entry (a, struct foo, elem)->bar
+ *          < rb_entry (b, struct foo, elem)->bar;
+ * }
+ *
+ * struct rbtree foo_tree;
+ *
+ * rb_init (&foo_tree, foo_less, NULL);
+ *
+ * Elements are visited in order like so:
+ *
+ * struct rb_elem *e;
+ *
+ * for (e = rb_min (&foo_tree); e != NULL; e = rb_next (e)) {
+ *   struct foo *f = rb_entry (e, struct foo, elem);
+ *   ...do something with f...
+ * }
+ *
+ * Equal elements may be in a tree together; each new one goes
+ * after those already there, so a tree can serve as a FIFO
+ * priority queue. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Red-black tree element. */
+struct rb_elem {
+	struct rb_elem *parent;     /* Parent, or null at the root. */
+	struct rb_elem *left;       /* Lesser child, or null. */
+	struct rb_elem *right;      /* Greater child, or null. */
+	bool red;                   /* Red, or black? */
+};
+
+/* Compares the value of two tree elements A and B, given
+   auxiliary data AUX.  Returns true if A is less than B, or
+   false if A is greater than or equal to B. */
+typedef bool rb_less_func (const struct rb_elem *a,
+                           const struct rb_elem *b,
+                           void *aux);
+
+/* Red-black tree. */
+struct rbtree {
+	struct rb_elem *root;       /* Root, or null if empty. */
+	size_t elem_cnt;            /* Number of elements. */
+	rb_less_func *less;         /* Comparison function. */
+	void *aux;                  /* Auxiliary data for `less'. */
+};
+
+/* Converts pointer to tree element RB_ELEM into a pointer to
+   the structure that RB_ELEM is embedded inside.  Supply the
+   name of the outer structure STRUCT and the member name MEMBER
+   of the tree element.  See the big comment at the top of the
+   file for an example. */
+#define rb_entry(RB_ELEM, STRUCT, MEMBER)               \
+	((STRUCT *) ((uint8_t *) &(RB_ELEM)->parent     \
+		- offsetof (STRUCT, MEMBER.parent)))
+
+void rb_init (struct rbtree *, rb_less_func *, void *aux);
+
+/* Insertion and removal. */
+void rb_insert (struct rbtree *, struct rb_elem *);
+void rb_remove (struct rbtree *, struct rb_elem *);
+struct rb_elem *rb_pop_min (struct rbtree *);
+
+/* Search. */
+struct rb_elem *rb_find (struct rbtree *, const struct rb_elem *);
+
+/* In-order traversal. */
+struct rb_elem *rb_min (struct rbtree *);
+struct rb_elem *rb_max (struct rbtree *);
+struct rb_elem *rb_next (struct rb_elem *);
+struct rb_elem *rb_prev (struct rb_elem *);
+
+/* Tree properties. */
+size_t rb_size (struct rbtree *);
+bool rb_empty (struct rbtree *);
+
+#endif /* lib/kernel/rbtree.h */
@@ -36,6 +36,14 @@ enum {
 
 	SYS_MOUNT,
 	SYS_UMOUNT,
+
+	SYS_MADVISE,                /* Advise on the use of a memory range. */
+	SYS_VMSTAT,                 /* Report memory use. */
+	SYS_MLOCK,                  /* Lock a memory range into memory. */
+	SYS_MUNLOCK,                /* Unlock a memory range. */
+	SYS_MLOCKALL,               /* Lock all memory of the process. */
+	SYS_MUNLOCKALL,             /* Unlock all memory of the process. */
+	SYS_MINCORE,                /* Report which pages are in memory. */
 };
 
 #endif /* lib/syscall-nr.h */
@@ -13,6 +13,56 @@ typedef int pid_t;
 typedef int off_t;
 #define MAP_FAILED ((void *) NULL)
 
+/* Flag for mmap() that may be or'd into WRITABLE: load every page
+ * of the mapping before returning, so no access to it faults. */
+#define MAP_POPULATE 0x100
+
+/* ADVICE for madvise(). */
+#define MADV_NORMAL 0           /* No particular order. */
+#define MADV_RANDOM 1           /* Random order: no read-ahead. */
+#define MADV_SEQUENTIAL 2       /* In order: read ahead, drop behind. */
+#define MADV_WILLNEED 3         /* Will be used soon: start loading. */
+#define MADV_DONTNEED 4         /* Not needed for now: drop the pages. */
+
+/* FLAGS for mlockall(). */
+#define MCL_CURRENT 1           /* Lock what is mapped now. */
+#define MCL_FUTURE 2            /* Lock what is touched from now on. */
+
+/* Counts of paging events, in vmstat(). */
+struct vmevents {
+	size_t minor_faults;    /* Faults served without reading the disk. */
+	size_t major_faults;    /* Faults that read swap or a file. */
+	size_t evictions;       /* Pages evicted. */
+	size_t swap_outs;       /* Anonymous pages written to swap. */
+	size_t writebacks;      /* Modified file pages written back. */
+	size_t around_hits;     /* Pages loaded ahead of a fault, then used. */
+};
+
+/* Memory use of the calling process, from vmstat(), in pages. */
+struct vmstat {
+	size_t resident;        /* In memory. */
+	size_t active;          /* Of those, used repeatedly. */
+	size_t working_set;     /* Of those, used lately. */
+	size_t refaults;        /* Loaded again soon after eviction. */
+	size_t anon;            /* Resident anonymous pages. */
+	size_t file;            /* Resident file pages. */
+	size_t shared;          /* Resident pages another process maps. */
+	size_t swapped;         /* Anonymous pages in swap. */
+	struct vmevents events;     /* Of the calling process. */
+	struct vmevents sys_events; /* Of all processes. */
+};
+
+/* Bits of each page's byte from mincore(). */
+#define MINCORE_RESIDENT 0x01   /* In memory. */
+#define MINCORE_DIRTY 0x02      /* Written since loaded. */
+#define MINCORE_ACCESSED 0x04   /* Used since last looked at. */
+#define MINCORE_SWAPPED 0x08    /* Not in memory, but in swap. */
+#define MINCORE_LOCKED 0x10     /* Locked by mlock(). */
+
+/* CHAN_NO for mount() that mounts an in-memory tmpfs, whose size
+ * limit in kB is then given as DEV_NO (0 for none). */
+#define MOUNT_TMPFS (-1)
+
 /* Maximum characters in a filename written by readdir(). */
 #define READDIR_MAX_LEN 14
 
@@ -41,6 +91,13 @@ int dup2(int oldfd, int newfd);
 /* Project 3 and optionally project 4. */
 void *mmap (void *addr, size_t length, int writable, int fd, off_t offset);
 void munmap (void *addr);
+int madvise (void *addr, size_t length, int advice);
+int vmstat (struct vmstat *);
+int mlock (void *addr, size_t length);
+int munlock (void *addr, size_t length);
+int mlockall (int flags);
+int munlockall (void);
+int mincore (void *addr, size_t length, unsigned char *vec);
 
 /* Project 4 only. */
 bool chdir (const char *dir);
@@ -49,6 +106,8 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 int symlink (const char* target, const char* linkpath);
+int mount (const char *path, int chan_no, int dev_no);
+int umount (const char *path);
 
 static inline void* get_phys_addr (void *user_addr) {
 	void* pa;
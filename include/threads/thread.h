@@ -130,6 +130,7 @@ struct thread
 #ifdef VM
 	/* Table for whole virtual memory owned by thread. */
 	struct supplemental_page_table spt;
+	void *user_rsp; /* User stack pointer on entry to a system call. */
 #endif
 
 	/* Owned by thread.c. */
@@ -1,13 +1,27 @@
 #ifndef VM_ANON_H
 #define VM_ANON_H
+#include <bitmap.h>
 #include "vm/vm.h"
 struct page;
+struct zswap_entry;
 enum vm_type;
 
+/* Slot of a page that is not in swap. */
+#define SWAP_NONE BITMAP_ERROR
+
 struct anon_page {
+	size_t slot;                /* Swap slot holding it, or SWAP_NONE. */
+	struct zswap_entry *zentry; /* Compressed copy, or null. */
+	bool ahead;                 /* Being read ahead of a fault? */
 };
 
 void vm_anon_init (void);
 bool anon_initializer (struct page *page, enum vm_type type, void *kva);
+void anon_share (struct page *page);
+void anon_adopt (struct page *page);
+
+size_t swap_slot_write (const void *kva);
+void swap_slot_read (size_t slot, void *kva);
+void swap_slot_free (size_t slot);
 
 #endif
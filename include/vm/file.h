@@ -4,13 +4,26 @@
 #include "vm/vm.h"
 
 struct page;
+struct vma;
 enum vm_type;
 
+/* Flag or'd into do_mmap()'s WRITABLE: load the whole mapping
+ * up front.  Same value as in lib/user/syscall.h. */
+#define MAP_POPULATE 0x100
+
 struct file_page {
+	struct file *file;          /* Mapped file, owned by the area. */
+	off_t offset;               /* Offset of the page in FILE. */
+	size_t read_bytes;          /* Bytes of the page backed by FILE. */
 };
 
 void vm_file_init (void);
 bool file_backed_initializer (struct page *page, enum vm_type type, void *kva);
+void file_backed_writeback (struct vma *vma);
+#ifdef EFILESYS
+struct page *file_backed_cache_get (struct page *page);
+bool file_backed_cached (struct page *page);
+#endif
 void *do_mmap(void *addr, size_t length, int writable,
 		struct file *file, off_t offset);
 void do_munmap (void *va);
@@ -0,0 +1,6 @@
+#ifndef VM_HUGE_H
+#define VM_HUGE_H
+
+void huge_init (void);
+
+#endif /* vm/huge.h */
@@ -0,0 +1,11 @@
+#ifndef VM_PREFETCH_H
+#define VM_PREFETCH_H
+
+struct thread;
+
+void prefetch_init (void);
+void prefetch_queue (struct thread *owner, void *va);
+void prefetch_retry (void);
+void prefetch_cancel (struct thread *owner);
+
+#endif /* vm/prefetch.h */
@@ -1,7 +1,9 @@
 #ifndef VM_VM_H
 #define VM_VM_H
 #include <stdbool.h>
+#include <hash.h>
 #include "threads/palloc.h"
+#include "threads/synch.h"
 
 enum vm_type {
 	/* page not initialized */
@@ -20,6 +22,13 @@ enum vm_type {
 	VM_MARKER_0 = (1 << 3),
 	VM_MARKER_1 = (1 << 4),
 
+	/* Area that holds the user stack. */
+	VM_STACK = VM_MARKER_0,
+	/* File area whose changes stay with the process: a page shares
+	 * the page cache's frame until it is written, then gets a copy
+	 * and becomes anonymous. */
+	VM_PRIVATE = VM_MARKER_1,
+
 	/* DO NOT EXCEED THIS VALUE. */
 	VM_MARKER_END = (1 << 31),
 };
@@ -27,6 +36,7 @@ enum vm_type {
 #include "vm/uninit.h"
 #include "vm/anon.h"
 #include "vm/file.h"
+#include "vm/vma.h"
 #ifdef EFILESYS
 #include "filesys/page_cache.h"
 #endif
@@ -46,6 +56,14 @@ struct page {
 	struct frame *frame;   /* Back reference for frame */
 
 	/* Your implementation */
+	struct thread *owner;  /* Process whose address space holds it. */
+	bool writable;         /* May the process write to it? */
+	struct vma *vma;       /* Area it belongs to, or null. */
+	struct hash_elem spt_elem; /* Element in the page table's pages. */
+	struct list_elem vma_elem; /* Element in the area's pages. */
+	struct list_elem frame_elem; /* Element in the frame's pages. */
+	bool locked;           /* Kept resident by mlock()? */
+	bool around;           /* Loaded ahead of a fault, not used yet? */
 
 	/* Per-type data are binded into the union.
 	 * Each function automatically detects the current union */
@@ -62,7 +80,16 @@ struct page {
 /* The representation of "frame" */
 struct frame {
 	void *kva;
-	struct page *page;
+	struct list pages;     /* Pages mapped to it, by frame_elem. */
+	bool pinned;           /* Being filled or evicted? */
+	bool merged;           /* Shared by same-page merging? */
+	struct list_elem elem; /* Element in the free frame list. */
+
+	/* Page replacement, owned by vm.c. */
+	struct list *lru;      /* Replacement list it is on, or null. */
+	struct list_elem lru_elem; /* Element in LRU. */
+	bool referenced;       /* Used once on the inactive list? */
+	bool demoted;          /* Moved to inactive from active? */
 };
 
 /* The function table for page operations.
@@ -81,12 +108,79 @@ struct page_operations {
 #define destroy(page) \
 	if ((page)->operations->destroy) (page)->operations->destroy (page)
 
+/* Paging events.  Same order as the members of struct vmevents. */
+enum vm_event {
+	VM_MINOR_FAULT,        /* Fault served without reading the disk. */
+	VM_MAJOR_FAULT,        /* Fault that read swap or a file. */
+	VM_EVICTION,           /* Page evicted from its frame. */
+	VM_SWAP_OUT,           /* Anonymous page written to swap. */
+	VM_WRITEBACK,          /* Modified file page written back. */
+	VM_AROUND_HIT,         /* Page loaded ahead of a fault, then used. */
+	VM_EVENT_CNT
+};
+
 /* Representation of current process's memory space.
- * We don't want to force you to obey any specific design for this struct.
- * All designs up to you for this. */
+ * Mappings are described by areas (struct vma); a struct page is
+ * made for a page of an area only when it is first touched, and
+ * kept in PAGES from then on. */
 struct supplemental_page_table {
+	struct vma_tree vmas;  /* Areas, by address. */
+	struct hash pages;     /* Pages in use, by va. */
+
+	/* Held while pages of this table move in or out of frames:
+	 * by its process while it handles a fault, and by whoever
+	 * evicts one of its pages. */
+	struct lock lock;
+
+	size_t swap_next;      /* Swap slot for this process's next page. */
+	size_t refaults;       /* Pages loaded again soon after eviction. */
+	size_t stack_grow;     /* Pages the stack grew by last time. */
+	size_t locked;         /* Pages locked by mlock(). */
+	bool lock_future;      /* Lock pages as they are made? */
+	size_t events[VM_EVENT_CNT]; /* Paging events, by enum vm_event. */
 };
 
+/* Counts of paging events, as vmstat() reports them.  Same layout as
+ * in lib/user/syscall.h. */
+struct vmevents {
+	size_t minor_faults;
+	size_t major_faults;
+	size_t evictions;
+	size_t swap_outs;
+	size_t writebacks;
+	size_t around_hits;
+};
+
+/* Memory use of a process, as vmstat() reports it, in pages.  Same
+ * layout as in lib/user/syscall.h. */
+struct vmstat {
+	size_t resident;       /* In memory. */
+	size_t active;         /* Of those, on the active list. */
+	size_t working_set;    /* Of those, used lately. */
+	size_t refaults;       /* Loaded again soon after eviction. */
+	size_t anon;           /* Resident anonymous pages. */
+	size_t file;           /* Resident file pages. */
+	size_t shared;         /* Resident pages another process maps. */
+	size_t swapped;        /* Anonymous pages in swap. */
+	struct vmevents events;     /* Of this process. */
+	struct vmevents sys_events; /* Of all processes. */
+};
+
+/* Bits of a page's byte from mincore().  Same values as in
+ * lib/user/syscall.h. */
+#define MINCORE_RESIDENT 0x01  /* In memory. */
+#define MINCORE_DIRTY 0x02     /* Written since loaded. */
+#define MINCORE_ACCESSED 0x04  /* Used since last looked at. */
+#define MINCORE_SWAPPED 0x08   /* Not in memory, but in swap. */
+#define MINCORE_LOCKED 0x10    /* Locked by mlock(). */
+
+/* FLAGS for mlockall().  Same values as in lib/user/syscall.h. */
+#define MCL_CURRENT 1
+#define MCL_FUTURE 2
+
+extern size_t vm_stack_max;
+extern size_t vm_mlock_max;
+
 #include "threads/thread.h"
 void supplemental_page_table_init (struct supplemental_page_table *spt);
 bool supplemental_page_table_copy (struct supplemental_page_table *dst,
@@ -97,6 +191,32 @@ struct page *spt_find_page (struct supplemental_page_table *spt,
 bool spt_insert_page (struct supplemental_page_table *spt, struct page *page);
 void spt_remove_page (struct supplemental_page_table *spt, struct page *page);
 
+bool vm_map (void *start, size_t length, enum vm_type type, bool writable,
+		struct file *file, off_t offset, size_t read_bytes,
+		vm_initializer *init);
+void vm_unmap (struct supplemental_page_table *spt, struct vma *vma);
+bool vm_is_mapped (void *addr);
+void vm_populate (void *start, size_t length);
+bool vm_advise (void *start, size_t length, int advice);
+bool vm_mincore (void *start, size_t length, unsigned char *vec);
+bool vm_mlock (void *start, size_t length);
+bool vm_munlock (void *start, size_t length);
+bool vm_mlockall (int flags);
+void vm_munlockall (void);
+void vm_free_frame (struct page *page);
+bool vm_prefetch_page (struct page *page);
+bool vm_load_page (struct page *page);
+struct page *vm_frame_cached (struct frame *frame);
+bool vm_frame_clean (struct frame *frame);
+struct frame *vm_frame_at (size_t idx);
+size_t vm_frame_anon_pages (struct frame *frame, bool *merged);
+size_t vm_frame_merge (struct frame *keep, struct frame *dup);
+void vm_stat (struct vmstat *st);
+void vm_count_event (struct thread *owner, enum vm_event);
+void vm_print_stats (void);
+bool vm_stack_grow (void *addr, void *rsp);
+bool vm_frame_collapse (struct frame *frame);
+
 void vm_init (void);
 bool vm_try_handle_fault (struct intr_frame *f, void *addr, bool user,
 		bool write, bool not_present);
@@ -0,0 +1,70 @@
+/* vm/vm.h includes this file in turn, once it has declared what
+ * is used here, so include it first. */
+#include "vm/vm.h"
+
+#ifndef VM_VMA_H
+#define VM_VMA_H
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "filesys/off_t.h"
+
+struct file;
+
+/* How a process says it will use an area, through madvise().
+ * Same values as in lib/user/syscall.h. */
+#define MADV_NORMAL 0
+#define MADV_RANDOM 1
+#define MADV_SEQUENTIAL 2
+#define MADV_WILLNEED 3
+#define MADV_DONTNEED 4
+
+/* A virtual memory area: a run of pages [START, END) with the same
+ * backing store and permissions.  Pages of an area get a struct
+ * page only when they are first touched, so an area costs the same
+ * no matter how large it is. */
+struct vma {
+	void *start;                /* First page. */
+	void *end;                  /* One past the last page. */
+	enum vm_type type;          /* VM_ANON or VM_FILE, plus markers. */
+	bool writable;              /* May the process write to it? */
+
+	/* Initial contents: READ_BYTES bytes of FILE from OFFSET, then
+	 * zeros.  FILE is owned by the area, or null for zeros only. */
+	struct file *file;
+	off_t offset;
+	size_t read_bytes;
+	vm_initializer *init;       /* Loads a page on first touch. */
+	struct list pages;          /* Touched pages, by vma_elem. */
+
+	/* Fault-around: the last window, and its size in pages. */
+	void *ra_start, *ra_end;
+	size_t ra_window;
+	int advice;                 /* MADV_NORMAL, _RANDOM or _SEQUENTIAL. */
+
+	/* AVL tree links, owned by vma.c. */
+	struct vma *left, *right;
+	int height;
+};
+
+/* The areas of one address space, which never overlap. */
+struct vma_tree {
+	struct vma *root;
+	size_t cnt;                 /* Number of areas. */
+};
+
+struct vma *vma_create (void *start, void *end, enum vm_type type,
+		bool writable, struct file *file, off_t offset, size_t read_bytes,
+		vm_initializer *init);
+void vma_destroy (struct vma *);
+
+void vma_tree_init (struct vma_tree *);
+bool vma_insert (struct vma_tree *, struct vma *);
+void vma_remove (struct vma_tree *, struct vma *);
+struct vma *vma_find (struct vma_tree *, const void *va);
+struct vma *vma_lower_bound (struct vma_tree *, const void *va);
+bool vma_overlaps (struct vma_tree *, const void *start, const void *end);
+struct vma *vma_first (struct vma_tree *);
+struct vma *vma_next (struct vma_tree *, const struct vma *);
+
+#endif /* vm/vma.h */
@@ -0,0 +1,13 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+
+/* A page held compressed in memory. */
+struct zswap_entry;
+
+void zswap_init (void);
+struct zswap_entry *zswap_store (const void *kva);
+void zswap_load (struct zswap_entry *, void *kva);
+void zswap_get (struct zswap_entry *);
+void zswap_put (struct zswap_entry *);
+
+#endif /* vm/zswap.h */
@@ -15,9 +15,16 @@
 static struct list *find_bucket (struct hash *, struct hash_elem *);
 static struct hash_elem *find_elem (struct hash *, struct list *,
 		struct hash_elem *);
+static struct hash_elem *lookup (struct hash *, uint64_t hash,
+		struct hash_elem *);
 static void insert_elem (struct hash *, struct list *, struct hash_elem *);
 static void remove_elem (struct hash *, struct hash_elem *);
+static void clear_buckets (struct hash *, struct list *, size_t cnt,
+		hash_action_func *);
+static void apply_buckets (struct hash *, struct list *, size_t cnt,
+		hash_action_func *);
 static void rehash (struct hash *);
+static void migrate (struct hash *);
 
 /* Initializes hash table H to compute hash values using HASH and
    compare hash elements using LESS, given auxiliary data AUX. */
@@ -27,6 +34,9 @@ hash_init (struct hash *h,
 	h->elem_cnt = 0;
 	h->bucket_cnt = 4;
 	h->buckets = malloc (sizeof *h->buckets * h->bucket_cnt);
+	h->old_bucket_cnt = 0;
+	h->old_buckets = NULL;
+	h->moved = 0;
 	h->hash = hash;
 	h->less = less;
 	h->aux = aux;
@@ -49,10 +59,26 @@ hash_init (struct hash *h,
    whether done in DESTRUCTOR or elsewhere. */
 void
 hash_clear (struct hash *h, hash_action_func *destructor) {
+	if (h->old_buckets != NULL) {
+		clear_buckets (h, h->old_buckets, h->old_bucket_cnt, destructor);
+		free (h->old_buckets);
+		h->old_buckets = NULL;
+		h->old_bucket_cnt = 0;
+	}
+	clear_buckets (h, h->buckets, h->bucket_cnt, destructor);
+
+	h->elem_cnt = 0;
+}
+
+/* Empties the CNT buckets of H in BUCKETS, calling DESTRUCTOR, if
+   it is non-null, for each element. */
+static void
+clear_buckets (struct hash *h, struct list *buckets, size_t cnt,
+		hash_action_func *destructor) {
 	size_t i;
 
-	for (i = 0; i < h->bucket_cnt; i++) {
-		struct list *bucket = &h->buckets[i];
+	for (i = 0; i < cnt; i++) {
+		struct list *bucket = &buckets[i];
 
 		if (destructor != NULL)
 			while (!list_empty (bucket)) {
@@ -63,8 +89,6 @@ hash_clear (struct hash *h, hash_action_func *destructor) {
 
 		list_init (bucket);
 	}
-
-	h->elem_cnt = 0;
 }
 
 /* Destroys hash table H.
@@ -81,6 +105,7 @@ void
 hash_destroy (struct hash *h, hash_action_func *destructor) {
 	if (destructor != NULL)
 		hash_clear (h, destructor);
+	free (h->old_buckets);
 	free (h->buckets);
 }
 
@@ -90,11 +115,11 @@ hash_destroy (struct hash *h, hash_action_func *destructor) {
    without inserting NEW. */
 struct hash_elem *
 hash_insert (struct hash *h, struct hash_elem *new) {
-	struct list *bucket = find_bucket (h, new);
-	struct hash_elem *old = find_elem (h, bucket, new);
+	uint64_t hash = h->hash (new, h->aux);
+	struct hash_elem *old = lookup (h, hash, new);
 
 	if (old == NULL)
-		insert_elem (h, bucket, new);
+		insert_elem (h, &h->buckets[hash & (h->bucket_cnt - 1)], new);
 
 	rehash (h);
 
@@ -105,12 +130,12 @@ hash_insert (struct hash *h, struct hash_elem *new) {
    already in the table, which is returned. */
 struct hash_elem *
 hash_replace (struct hash *h, struct hash_elem *new) {
-	struct list *bucket = find_bucket (h, new);
-	struct hash_elem *old = find_elem (h, bucket, new);
+	uint64_t hash = h->hash (new, h->aux);
+	struct hash_elem *old = lookup (h, hash, new);
 
 	if (old != NULL)
 		remove_elem (h, old);
-	insert_elem (h, bucket, new);
+	insert_elem (h, &h->buckets[hash & (h->bucket_cnt - 1)], new);
 
 	rehash (h);
 
@@ -121,7 +146,7 @@ hash_replace (struct hash *h, struct hash_elem *new) {
    null pointer if no equal element exists in the table. */
 struct hash_elem *
 hash_find (struct hash *h, struct hash_elem *e) {
-	return find_elem (h, find_bucket (h, e), e);
+	return lookup (h, h->hash (e, h->aux), e);
 }
 
 /* Finds, removes, and returns an element equal to E in hash
@@ -133,7 +158,7 @@ hash_find (struct hash *h, struct hash_elem *e) {
    responsibility to deallocate them. */
 struct hash_elem *
 hash_delete (struct hash *h, struct hash_elem *e) {
-	struct hash_elem *found = find_elem (h, find_bucket (h, e), e);
+	struct hash_elem *found = lookup (h, h->hash (e, h->aux), e);
 	if (found != NULL) {
 		remove_elem (h, found);
 		rehash (h);
@@ -149,12 +174,22 @@ hash_delete (struct hash *h, struct hash_elem *e) {
    undefined behavior, whether done from ACTION or elsewhere. */
 void
 hash_apply (struct hash *h, hash_action_func *action) {
-	size_t i;
-
 	ASSERT (action != NULL);
 
-	for (i = 0; i < h->bucket_cnt; i++) {
-		struct list *bucket = &h->buckets[i];
+	if (h->old_buckets != NULL)
+		apply_buckets (h, h->old_buckets, h->old_bucket_cnt, action);
+	apply_buckets (h, h->buckets, h->bucket_cnt, action);
+}
+
+/* Calls ACTION for each element in the CNT buckets of H in
+   BUCKETS. */
+static void
+apply_buckets (struct hash *h, struct list *buckets, size_t cnt,
+		hash_action_func *action) {
+	size_t i;
+
+	for (i = 0; i < cnt; i++) {
+		struct list *bucket = &buckets[i];
 		struct list_elem *elem, *next;
 
 		for (elem = list_begin (bucket); elem != list_end (bucket); elem = next) {
@@ -187,7 +222,8 @@ hash_first (struct hash_iterator *i, struct hash *h) {
 	ASSERT (h != NULL);
 
 	i->hash = h;
-	i->bucket = i->hash->buckets;
+	i->old = h->old_buckets != NULL;
+	i->bucket = i->old ? h->old_buckets : h->buckets;
 	i->elem = list_elem_to_hash_elem (list_head (i->bucket));
 }
 
@@ -205,7 +241,13 @@ hash_next (struct hash_iterator *i) {
 
 	i->elem = list_elem_to_hash_elem (list_next (&i->elem->list_elem));
 	while (i->elem == list_elem_to_hash_elem (list_end (i->bucket))) {
-		if (++i->bucket >= i->hash->buckets + i->hash->bucket_cnt) {
+		if (i->old
+				&& ++i->bucket >= i->hash->old_buckets + i->hash->old_bucket_cnt) {
+			/* Old buckets done: on to the new ones. */
+			i->old = false;
+			i->bucket = i->hash->buckets;
+		} else if (!i->old
+				&& ++i->bucket >= i->hash->buckets + i->hash->bucket_cnt) {
 			i->elem = NULL;
 			break;
 		}
@@ -283,6 +325,20 @@ find_bucket (struct hash *h, struct hash_elem *e) {
 	return &h->buckets[bucket_idx];
 }
 
+/* Searches H for a hash element equal to E, whose hash value is
+   HASH: in its bucket and, while H is being resized, in its old
+   bucket too.  Returns it if found or a null pointer otherwise. */
+static struct hash_elem *
+lookup (struct hash *h, uint64_t hash, struct hash_elem *e) {
+	struct hash_elem *found;
+
+	found = find_elem (h, &h->buckets[hash & (h->bucket_cnt - 1)], e);
+	if (found == NULL && h->old_buckets != NULL)
+		found = find_elem (h, &h->old_buckets[hash & (h->old_bucket_cnt - 1)],
+				e);
+	return found;
+}
+
 /* Searches BUCKET in H for a hash element equal to E.  Returns
    it if found or a null pointer otherwise. */
 static struct hash_elem *
@@ -314,21 +370,30 @@ is_power_of_2 (size_t x) {
 #define BEST_ELEMS_PER_BUCKET 2 /* Ideal elems/bucket. */
 #define MAX_ELEMS_PER_BUCKET  4 /* Elems/bucket > 4: increase # of buckets. */
 
+/* Old buckets emptied by each insertion, replacement or deletion
+   while resizing.  Growing starts when there are about two
+   elements for every old bucket, and the next resize is due only
+   once the element count has changed by about as many again, so
+   one would do; two leave room for a mix of both directions. */
+#define MIGRATE_BUCKETS 2
+
 /* Changes the number of buckets in hash table H to match the
-   ideal.  This function can fail because of an out-of-memory
-   condition, but that'll just make hash accesses less efficient;
-   we can still continue. */
+   ideal, a few buckets at a time: if H is being resized already,
+   carries on with that instead.  This function can fail because
+   of an out-of-memory condition, but that'll just make hash
+   accesses less efficient; we can still continue. */
 static void
 rehash (struct hash *h) {
-	size_t old_bucket_cnt, new_bucket_cnt;
-	struct list *new_buckets, *old_buckets;
+	size_t new_bucket_cnt;
+	struct list *new_buckets;
 	size_t i;
 
 	ASSERT (h != NULL);
 
-	/* Save old bucket info for later use. */
-	old_buckets = h->buckets;
-	old_bucket_cnt = h->bucket_cnt;
+	if (h->old_buckets != NULL) {
+		migrate (h);
+		return;
+	}
 
 	/* Calculate the number of buckets to use now.
 	   We want one bucket for about every BEST_ELEMS_PER_BUCKET.
@@ -341,7 +406,7 @@ rehash (struct hash *h) {
 		new_bucket_cnt = turn_off_least_1bit (new_bucket_cnt);
 
 	/* Don't do anything if the bucket count wouldn't change. */
-	if (new_bucket_cnt == old_bucket_cnt)
+	if (new_bucket_cnt == h->bucket_cnt)
 		return;
 
 	/* Allocate new buckets and initialize them as empty. */
@@ -355,27 +420,38 @@ rehash (struct hash *h) {
 	for (i = 0; i < new_bucket_cnt; i++)
 		list_init (&new_buckets[i]);
 
-	/* Install new bucket info. */
+	/* Install new bucket info, keeping the old buckets until they
+	   are empty. */
+	h->old_buckets = h->buckets;
+	h->old_bucket_cnt = h->bucket_cnt;
+	h->moved = 0;
 	h->buckets = new_buckets;
 	h->bucket_cnt = new_bucket_cnt;
 
-	/* Move each old element into the appropriate new bucket. */
-	for (i = 0; i < old_bucket_cnt; i++) {
-		struct list *old_bucket;
-		struct list_elem *elem, *next;
+	migrate (h);
+}
 
-		old_bucket = &old_buckets[i];
-		for (elem = list_begin (old_bucket);
-				elem != list_end (old_bucket); elem = next) {
-			struct list *new_bucket
-				= find_bucket (h, list_elem_to_hash_elem (elem));
-			next = list_next (elem);
-			list_remove (elem);
-			list_push_front (new_bucket, elem);
+/* Moves the elements of the next MIGRATE_BUCKETS old buckets of H,
+   which is being resized, into the new buckets.  Frees the old
+   buckets once they are all empty. */
+static void
+migrate (struct hash *h) {
+	size_t i;
+
+	for (i = 0; i < MIGRATE_BUCKETS && h->moved < h->old_bucket_cnt; i++) {
+		struct list *old_bucket = &h->old_buckets[h->moved++];
+
+		while (!list_empty (old_bucket)) {
+			struct list_elem *elem = list_pop_front (old_bucket);
+			list_push_front (find_bucket (h, list_elem_to_hash_elem (elem)), elem);
 		}
 	}
 
-	free (old_buckets);
+	if (h->moved == h->old_bucket_cnt) {
+		free (h->old_buckets);
+		h->old_buckets = NULL;
+		h->old_bucket_cnt = 0;
+	}
 }
 
 /* Inserts E into BUCKET (in hash table H). */
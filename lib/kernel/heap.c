@@ -0,0 +1,171 @@
+/* Pairing heap.
+
+   See heap.h for basic information.
+
+   The heap is a tree in which no element is less than its parent,
+   so the least element is the root.  Each element's children are
+   a list, linked through `next' and `prev', that hangs off its
+   `child'.
+
+   Two heaps are merged by making the root with the greater value
+   the leftmost child of the other, so inserting is one merge.
+   Removing the root leaves its children, which are merged in two
+   passes: first in pairs from left to right, then the pairs from
+   right to left into one.  Fredman et al., "The Pairing Heap: A
+   New Form of Self-Adjusting Heap", show that this takes O(log n)
+   amortized time. */
+
+#include "heap.h"
+#include "../debug.h"
+
+static struct heap_elem *meld (struct heap *, struct heap_elem *,
+		struct heap_elem *);
+static struct heap_elem *merge_pairs (struct heap *, struct heap_elem *);
+
+/* Initializes HEAP as an empty heap that orders its elements
+   using LESS, given auxiliary data AUX. */
+void
+heap_init (struct heap *heap, heap_less_func *less, void *aux) {
+	ASSERT (heap != NULL);
+	ASSERT (less != NULL);
+
+	heap->root = NULL;
+	heap->elem_cnt = 0;
+	heap->less = less;
+	heap->aux = aux;
+}
+
+/* Inserts ELEM into HEAP. */
+void
+heap_push (struct heap *heap, struct heap_elem *elem) {
+	ASSERT (elem != NULL);
+
+	elem->child = elem->next = elem->prev = NULL;
+	heap->root = heap->root != NULL ? meld (heap, heap->root, elem) : elem;
+	heap->elem_cnt++;
+}
+
+/* Returns the least element of HEAP, or a null pointer if HEAP is
+   empty. */
+struct heap_elem *
+heap_min (struct heap *heap) {
+	return heap->root;
+}
+
+/* Removes and returns the least element of HEAP, which must not
+   be empty. */
+struct heap_elem *
+heap_pop (struct heap *heap) {
+	struct heap_elem *min = heap->root;
+
+	ASSERT (min != NULL);
+
+	heap->root = merge_pairs (heap, min->child);
+	heap->elem_cnt--;
+	return min;
+}
+
+/* Removes ELEM, which must be in HEAP, from HEAP. */
+void
+heap_remove (struct heap *heap, struct heap_elem *elem) {
+	struct heap_elem *children;
+
+	ASSERT (elem != NULL);
+
+	if (elem == heap->root) {
+		heap_pop (heap);
+		return;
+	}
+
+	/* Cut ELEM's subtree out of its parent's children, then put
+	   its children back into the heap. */
+	if (elem->prev->child == elem)
+		elem->prev->child = elem->next;
+	else
+		elem->prev->next = elem->next;
+	if (elem->next != NULL)
+		elem->next->prev = elem->prev;
+
+	children = merge_pairs (heap, elem->child);
+	if (children != NULL)
+		heap->root = meld (heap, heap->root, children);
+	heap->elem_cnt--;
+}
+
+/* Moves ELEM, which is in HEAP, to its place after its value has
+   changed. */
+void
+heap_update (struct heap *heap, struct heap_elem *elem) {
+	heap_remove (heap, elem);
+	heap_push (heap, elem);
+}
+
+/* Returns the number of elements in HEAP. */
+size_t
+heap_size (struct heap *heap) {
+	return heap->elem_cnt;
+}
+
+/* Returns true if HEAP is empty, false otherwise. */
+bool
+heap_empty (struct heap *heap) {
+	return heap->root == NULL;
+}
+
+/* Merges the heaps rooted at A and B, neither of which has
+   siblings or a parent, and returns the root of the result. */
+static struct heap_elem *
+meld (struct heap *heap, struct heap_elem *a, struct heap_elem *b) {
+	if (heap->less (b, a, heap->aux)) {
+		struct heap_elem *t = a;
+		a = b;
+		b = t;
+	}
+
+	b->prev = a;
+	b->next = a->child;
+	if (a->child != NULL)
+		a->child->prev = b;
+	a->child = b;
+	return a;
+}
+
+/* Merges FIRST and its next siblings, if any, into one heap and
+   returns its root, or a null pointer if FIRST is null. */
+static struct heap_elem *
+merge_pairs (struct heap *heap, struct heap_elem *first) {
+	struct heap_elem *pairs = NULL;
+	struct heap_elem *root = NULL;
+
+	/* Merge pairs from left to right, stacking each result on
+	   PAIRS through `next', so the rightmost ends up on top. */
+	while (first != NULL) {
+		struct heap_elem *a = first;
+		struct heap_elem *b = a->next;
+		struct heap_elem *m;
+
+		if (b != NULL) {
+			first = b->next;
+			a->next = b->next = NULL;
+			m = meld (heap, a, b);
+		} else {
+			first = NULL;
+			m = a;
+		}
+		m->next = pairs;
+		pairs = m;
+	}
+
+	/* Merge the pairs from right to left. */
+	while (pairs != NULL) {
+		struct heap_elem *m = pairs;
+
+		pairs = m->next;
+		m->next = NULL;
+		root = root != NULL ? meld (heap, root, m) : m;
+	}
+
+	if (root != NULL)
+		root->prev = NULL;
+	return root;
+}
@@ -0,0 +1,276 @@
+/* Open-addressing hash table.
+
+   See ohash.h for basic information. */
+
+#include "ohash.h"
+#include "../debug.h"
+#include "threads/malloc.h"
+
+/* Control bytes.  A full slot's is the low 7 bits of its key's
+   hash, so only the special values have the top bit set. */
+#define CTRL_EMPTY   0x80       /* Never used since last resize. */
+#define CTRL_DELETED 0xfe       /* Used, then deleted. */
+
+/* Slots probed together, whose control bytes fit in a word. */
+#define GROUP 8
+
+/* A word of GROUP control bytes, and masks over them. */
+typedef uint64_t group_t;
+#define LSBS 0x0101010101010101ULL  /* Low bit of each byte. */
+#define MSBS 0x8080808080808080ULL  /* High bit of each byte. */
+
+/* Returned by find_slot() when there is no such slot. */
+#define NO_SLOT ((size_t) -1)
+
+/* At most this fraction of slots are full or deleted. */
+#define MAX_LOAD_NUM 7
+#define MAX_LOAD_DEN 8
+
+static uint64_t hash_key (uint64_t key);
+static group_t load_group (const struct ohash *, size_t idx);
+static group_t match_byte (group_t, uint8_t);
+static group_t match_empty (group_t);
+static group_t match_free (group_t);
+static size_t first_match (group_t);
+static size_t find_slot (const struct ohash *, uint64_t key, uint64_t hash);
+static size_t find_free (const struct ohash *, uint64_t hash);
+static bool alloc_slots (struct ohash *, size_t slot_cnt);
+static bool resize (struct ohash *);
+
+/* Initializes H as an empty table.  Returns false if memory is
+   exhausted. */
+bool
+ohash_init (struct ohash *h) {
+	h->cnt = 0;
+	h->deleted = 0;
+	return alloc_slots (h, GROUP);
+}
+
+/* Destroys H.  Values are the caller's to free. */
+void
+ohash_destroy (struct ohash *h) {
+	free (h->ctrl);
+	free (h->slots);
+}
+
+/* Maps KEY to VALUE in H.  Returns false, changing nothing, if KEY
+   is in H already or memory is exhausted. */
+bool
+ohash_insert (struct ohash *h, uint64_t key, void *value) {
+	uint64_t hash = hash_key (key);
+	size_t idx;
+
+	if (find_slot (h, key, hash) != NO_SLOT)
+		return false;
+	if ((h->cnt + h->deleted + 1) * MAX_LOAD_DEN > h->slot_cnt * MAX_LOAD_NUM
+			&& !resize (h))
+		return false;
+
+	idx = find_free (h, hash);
+	if (h->ctrl[idx] == CTRL_DELETED)
+		h->deleted--;
+	h->ctrl[idx] = hash & 0x7f;
+	h->slots[idx].key = key;
+	h->slots[idx].value = value;
+	h->cnt++;
+	return true;
+}
+
+/* Returns the value of KEY in H, or a null pointer if KEY is not
+   in H. */
+void *
+ohash_find (struct ohash *h, uint64_t key) {
+	size_t idx = find_slot (h, key, hash_key (key));
+	return idx != NO_SLOT ? h->slots[idx].value : NULL;
+}
+
+/* Removes KEY from H and returns its value, or a null pointer if
+   KEY was not in H. */
+void *
+ohash_delete (struct ohash *h, uint64_t key) {
+	size_t idx = find_slot (h, key, hash_key (key));
+
+	if (idx == NO_SLOT)
+		return NULL;
+
+	/* Lookups stop at a group with an empty slot, so if this one
+	   has one, no lookup can have passed through it to a later
+	   group, and the slot may be empty too. */
+	if (match_empty (load_group (h, idx & ~(size_t) (GROUP - 1))) != 0)
+		h->ctrl[idx] = CTRL_EMPTY;
+	else {
+		h->ctrl[idx] = CTRL_DELETED;
+		h->deleted++;
+	}
+	h->cnt--;
+	return h->slots[idx].value;
+}
+
+/* Calls ACTION for each key in H and its value, in arbitrary
+   order.  ACTION must not change H. */
+void
+ohash_apply (struct ohash *h, ohash_action_func *action, void *aux) {
+	size_t i;
+
+	ASSERT (action != NULL);
+
+	for (i = 0; i < h->slot_cnt; i++)
+		if (!(h->ctrl[i] & 0x80))
+			action (h->slots[i].key, h->slots[i].value, aux);
+}
+
+/* Returns the number of keys in H. */
+size_t
+ohash_size (struct ohash *h) {
+	return h->cnt;
+}
+
+/* Returns a hash of KEY.  Keys such as page numbers differ mostly
+   in their low bits, so the bits are mixed throughout. */
+static uint64_t
+hash_key (uint64_t key) {
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdULL;
+	key ^= key >> 33;
+	key *= 0xc4ceb9fe1a85ec53ULL;
+	key ^= key >> 33;
+	return key;
+}
+
+/* Returns the control bytes of the group that starts at slot IDX
+   of H. */
+static group_t
+load_group (const struct ohash *h, size_t idx) {
+	const uint8_t *ctrl = h->ctrl + idx;
+	group_t g = 0;
+	size_t i;
+
+	/* Compiles to a single load. */
+	for (i = 0; i < GROUP; i++)
+		g |= (group_t) ctrl[i] << (8 * i);
+	return g;
+}
+
+/* Returns a mask with the high bit set in each byte of G equal to
+   B.  It may also be set, rarely, in a byte just above a matching
+   one; callers compare keys anyway. */
+static group_t
+match_byte (group_t g, uint8_t b) {
+	group_t x = g ^ (LSBS * b);
+	return (x - LSBS) & ~x & MSBS;
+}
+
+/* Returns a mask with the high bit set in each byte of G that is
+   CTRL_EMPTY: the only control byte with the high bit set and bit
+   1 clear. */
+static group_t
+match_empty (group_t g) {
+	return g & ~(g << 6) & MSBS;
+}
+
+/* Returns a mask with the high bit set in each byte of G that is
+   CTRL_EMPTY or CTRL_DELETED. */
+static group_t
+match_free (group_t g) {
+	return g & MSBS;
+}
+
+/* Returns the index, within its group, of the first byte whose
+   high bit MASK has set.  MASK must not be 0. */
+static size_t
+first_match (group_t mask) {
+	return __builtin_ctzll (mask) / 8;
+}
+
+/* Returns the slot of H that holds KEY, whose hash is HASH, or
+   NO_SLOT if there is none.  Groups are probed in a triangular
+   sequence, which visits each once, since there is a power of 2 of
+   them. */
+static size_t
+find_slot (const struct ohash *h, uint64_t key, uint64_t hash) {
+	size_t mask = h->slot_cnt / GROUP - 1;
+	size_t group = (hash >> 7) & mask;
+	size_t step;
+
+	for (step = 1; step <= mask + 1; step++) {
+		size_t base = group * GROUP;
+		group_t g = load_group (h, base);
+		group_t m;
+
+		for (m = match_byte (g, hash & 0x7f); m != 0; m &= m - 1) {
+			size_t idx = base + first_match (m);
+			if (h->ctrl[idx] == (hash & 0x7f) && h->slots[idx].key == key)
+				return idx;
+		}
+		if (match_empty (g) != 0)
+			break;
+		group = (group + step) & mask;
+	}
+	return NO_SLOT;
+}
+
+/* Returns the first empty or deleted slot of H on the probe
+   sequence of HASH.  There must be one. */
+static size_t
+find_free (const struct ohash *h, uint64_t hash) {
+	size_t mask = h->slot_cnt / GROUP - 1;
+	size_t group = (hash >> 7) & mask;
+	size_t step;
+
+	for (step = 1; ; step++) {
+		size_t base = group * GROUP;
+		group_t m = match_free (load_group (h, base));
+
+		if (m != 0)
+			return base + first_match (m);
+		group = (group + step) & mask;
+	}
+}
+
+/* Gives H SLOT_CNT empty slots.  Returns false if memory is
+   exhausted. */
+static bool
+alloc_slots (struct ohash *h, size_t slot_cnt) {
+	size_t i;
+
+	h->ctrl = malloc (slot_cnt);
+	h->slots = malloc (sizeof *h->slots * slot_cnt);
+	if (h->ctrl == NULL || h->slots == NULL) {
+		free (h->ctrl);
+		free (h->slots);
+		return false;
+	}
+	for (i = 0; i < slot_cnt; i++)
+		h->ctrl[i] = CTRL_EMPTY;
+	h->slot_cnt = slot_cnt;
+	return true;
+}
+
+/* Rebuilds H with room for at least twice as many keys as it has,
+   which also drops its deleted slots.  Returns false, leaving H
+   as it was, if memory is exhausted. */
+static bool
+resize (struct ohash *h) {
+	struct ohash old = *h;
+	size_t slot_cnt = GROUP;
+	size_t i;
+
+	while (slot_cnt * MAX_LOAD_NUM < (h->cnt + 1) * 2 * MAX_LOAD_DEN)
+		slot_cnt *= 2;
+	if (!alloc_slots (h, slot_cnt)) {
+		*h = old;
+		return false;
+	}
+
+	h->deleted = 0;
+	for (i = 0; i < old.slot_cnt; i++)
+		if (!(old.ctrl[i] & 0x80)) {
+			uint64_t hash = hash_key (old.slots[i].key);
+			size_t idx = find_free (h, hash);
+
+			h->ctrl[idx] = hash & 0x7f;
+			h->slots[idx] = old.slots[i];
+		}
+	ohash_destroy (&old);
+	return true;
+}
@@ -0,0 +1,374 @@
+/* Red-black tree.
+
+   See rbtree.h for basic information.
+
+   Besides being a binary search tree, the tree keeps these rules,
+   with null children counted as black:
+
+   1. A red element has no red child.
+
+   2. Every path from an element down to a null child passes
+      through the same number of black elements.
+
+   So the longest path from the root is at most twice as long as
+   the shortest, and the tree's height is O(log n).  Insertion
+   and removal restore the rules by recoloring and rotating,
+   following Cormen et al., "Introduction to Algorithms". */
+
+#include "rbtree.h"
+#include "../debug.h"
+
+static void rotate_left (struct rbtree *, struct rb_elem *);
+static void rotate_right (struct rbtree *, struct rb_elem *);
+static void transplant (struct rbtree *, struct rb_elem *old,
+		struct rb_elem *new);
+static void insert_fixup (struct rbtree *, struct rb_elem *);
+static void remove_fixup (struct rbtree *, struct rb_elem *,
+		struct rb_elem *parent);
+
+/* Returns true if E is red, false if it is black or null. */
+static inline bool
+is_red (const struct rb_elem *e) {
+	return e != NULL && e->red;
+}
+
+/* Returns the least element of the subtree rooted at E. */
+static inline struct rb_elem *
+subtree_min (struct rb_elem *e) {
+	while (e->left != NULL)
+		e = e->left;
+	return e;
+}
+
+/* Returns the greatest element of the subtree rooted at E. */
+static inline struct rb_elem *
+subtree_max (struct rb_elem *e) {
+	while (e->right != NULL)
+		e = e->right;
+	return e;
+}
+
+/* Initializes TREE as an empty tree that orders its elements
+   using LESS, given auxiliary data AUX. */
+void
+rb_init (struct rbtree *tree, rb_less_func *less, void *aux) {
+	ASSERT (tree != NULL);
+	ASSERT (less != NULL);
+
+	tree->root = NULL;
+	tree->elem_cnt = 0;
+	tree->less = less;
+	tree->aux = aux;
+}
+
+/* Inserts ELEM into TREE, after any elements equal to it. */
+void
+rb_insert (struct rbtree *tree, struct rb_elem *elem) {
+	struct rb_elem *parent = NULL;
+	struct rb_elem **link = &tree->root;
+
+	ASSERT (elem != NULL);
+
+	while (*link != NULL) {
+		parent = *link;
+		if (tree->less (elem, parent, tree->aux))
+			link = &parent->left;
+		else
+			link = &parent->right;
+	}
+
+	elem->parent = parent;
+	elem->left = elem->right = NULL;
+	elem->red = true;
+	*link = elem;
+	tree->elem_cnt++;
+
+	insert_fixup (tree, elem);
+}
+
+/* Removes ELEM, which must be in TREE, from TREE. */
+void
+rb_remove (struct rbtree *tree, struct rb_elem *elem) {
+	struct rb_elem *child, *parent;
+	bool removed_red;
+
+	ASSERT (elem != NULL);
+	ASSERT (tree->elem_cnt > 0);
+
+	if (elem->left == NULL || elem->right == NULL) {
+		/* At most one child, which takes ELEM's place. */
+		child = elem->left != NULL ? elem->left : elem->right;
+		parent = elem->parent;
+		removed_red = elem->red;
+		transplant (tree, elem, child);
+	} else {
+		/* Two children: ELEM's successor, which has no left child,
+		   takes ELEM's place and color, and the successor's right
+		   child takes the successor's. */
+		struct rb_elem *next = subtree_min (elem->right);
+
+		removed_red = next->red;
+		child = next->right;
+		if (next->parent == elem)
+			parent = next;
+		else {
+			parent = next->parent;
+			transplant (tree, next, child);
+			next->right = elem->right;
+			next->right->parent = next;
+		}
+		transplant (tree, elem, next);
+		next->left = elem->left;
+		next->left->parent = next;
+		next->red = elem->red;
+	}
+	tree->elem_cnt--;
+
+	if (!removed_red)
+		remove_fixup (tree, child, parent);
+}
+
+/* Removes and returns the least element of TREE, which must not
+   be empty.  Of equal elements, the one inserted first is
+   returned. */
+struct rb_elem *
+rb_pop_min (struct rbtree *tree) {
+	struct rb_elem *min = rb_min (tree);
+
+	ASSERT (min != NULL);
+	rb_remove (tree, min);
+	return min;
+}
+
+/* Returns the first element of TREE equal to ELEM, or a null
+   pointer if there is none. */
+struct rb_elem *
+rb_find (struct rbtree *tree, const struct rb_elem *elem) {
+	struct rb_elem *e = tree->root;
+	struct rb_elem *found = NULL;
+
+	while (e != NULL) {
+		if (tree->less (e, elem, tree->aux))
+			e = e->right;
+		else {
+			/* E is not less than ELEM: it may be the one, but an
+			   equal element may also lie to its left. */
+			if (!tree->less (elem, e, tree->aux))
+				found = e;
+			e = e->left;
+		}
+	}
+	return found;
+}
+
+/* Returns the least element of TREE, or a null pointer if TREE
+   is empty. */
+struct rb_elem *
+rb_min (struct rbtree *tree) {
+	return tree->root != NULL ? subtree_min (tree->root) : NULL;
+}
+
+/* Returns the greatest element of TREE, or a null pointer if
+   TREE is empty. */
+struct rb_elem *
+rb_max (struct rbtree *tree) {
+	return tree->root != NULL ? subtree_max (tree->root) : NULL;
+}
+
+/* Returns the element after ELEM in its tree, or a null pointer
+   if ELEM is the last. */
+struct rb_elem *
+rb_next (struct rb_elem *elem) {
+	ASSERT (elem != NULL);
+
+	if (elem->right != NULL)
+		return subtree_min (elem->right);
+	while (elem->parent != NULL && elem == elem->parent->right)
+		elem = elem->parent;
+	return elem->parent;
+}
+
+/* Returns the element before ELEM in its tree, or a null pointer
+   if ELEM is the first. */
+struct rb_elem *
+rb_prev (struct rb_elem *elem) {
+	ASSERT (elem != NULL);
+
+	if (elem->left != NULL)
+		return subtree_max (elem->left);
+	while (elem->parent != NULL && elem == elem->parent->left)
+		elem = elem->parent;
+	return elem->parent;
+}
+
+/* Returns the number of elements in TREE. */
+size_t
+rb_size (struct rbtree *tree) {
+	return tree->elem_cnt;
+}
+
+/* Returns true if TREE is empty, false otherwise. */
+bool
+rb_empty (struct rbtree *tree) {
+	return tree->root == NULL;
+}
+
+/* Makes E's right child take E's place, with E as its left
+   child. */
+static void
+rotate_left (struct rbtree *tree, struct rb_elem *e) {
+	struct rb_elem *r = e->right;
+
+	e->right = r->left;
+	if (r->left != NULL)
+		r->left->parent = e;
+	transplant (tree, e, r);
+	r->left = e;
+	e->parent = r;
+}
+
+/* Makes E's left child take E's place, with E as its right
+   child. */
+static void
+rotate_right (struct rbtree *tree, struct rb_elem *e) {
+	struct rb_elem *l = e->left;
+
+	e->left = l->right;
+	if (l->right != NULL)
+		l->right->parent = e;
+	transplant (tree, e, l);
+	l->right = e;
+	e->parent = l;
+}
+
+/* Puts NEW, which may be null, where OLD is in TREE as its
+   parent's child.  OLD's own links are left alone. */
+static void
+transplant (struct rbtree *tree, struct rb_elem *old, struct rb_elem *new) {
+	if (old->parent == NULL)
+		tree->root = new;
+	else if (old == old->parent->left)
+		old->parent->left = new;
+	else
+		old->parent->right = new;
+	if (new != NULL)
+		new->parent = old->parent;
+}
+
+/* Restores rule 1 after E, which is red, was inserted into TREE. */
+static void
+insert_fixup (struct rbtree *tree, struct rb_elem *e) {
+	while (is_red (e->parent)) {
+		/* E's parent is red, so not the root, so E has a
+		   grandparent. */
+		struct rb_elem *parent = e->parent;
+		struct rb_elem *grandparent = parent->parent;
+
+		if (parent == grandparent->left) {
+			struct rb_elem *uncle = grandparent->right;
+
+			if (is_red (uncle)) {
+				/* Push the grandparent's black down a level and
+				   carry on from the grandparent. */
+				parent->red = uncle->red = false;
+				grandparent->red = true;
+				e = grandparent;
+				continue;
+			}
+			if (e == parent->right) {
+				rotate_left (tree, parent);
+				e = parent;
+				parent = e->parent;
+			}
+			parent->red = false;
+			grandparent->red = true;
+			rotate_right (tree, grandparent);
+		} else {
+			struct rb_elem *uncle = grandparent->left;
+
+			if (is_red (uncle)) {
+				parent->red = uncle->red = false;
+				grandparent->red = true;
+				e = grandparent;
+				continue;
+			}
+			if (e == parent->left) {
+				rotate_right (tree, parent);
+				e = parent;
+				parent = e->parent;
+			}
+			parent->red = false;
+			grandparent->red = true;
+			rotate_left (tree, grandparent);
+		}
+	}
+	tree->root->red = false;
+}
+
+/* Restores rule 2 after a black element was removed from TREE
+   and E, which may be null, took its place as a child of PARENT.
+   Paths through E are short one black element. */
+static void
+remove_fixup (struct rbtree *tree, struct rb_elem *e,
+		struct rb_elem *parent) {
+	while (e != tree->root && !is_red (e)) {
+		/* E's sibling has a black element more on each path, so it
+		   is not null. */
+		if (e == parent->left) {
+			struct rb_elem *sibling = parent->right;
+
+			if (sibling->red) {
+				sibling->red = false;
+				parent->red = true;
+				rotate_left (tree, parent);
+				sibling = parent->right;
+			}
+			if (!is_red (sibling->left) && !is_red (sibling->right)) {
+				/* Take a black off the sibling's paths too and
+				   carry on from the parent. */
+				sibling->red = true;
+				e = parent;
+				parent = e->parent;
+				continue;
+			}
+			if (!is_red (sibling->right)) {
+				sibling->left->red = false;
+				sibling->red = true;
+				rotate_right (tree, sibling);
+				sibling = parent->right;
+			}
+			sibling->red = parent->red;
+			parent->red = false;
+			sibling->right->red = false;
+			rotate_left (tree, parent);
+		} else {
+			struct rb_elem *sibling = parent->left;
+
+			if (sibling->red) {
+				sibling->red = false;
+				parent->red = true;
+				rotate_right (tree, parent);
+				sibling = parent->left;
+			}
+			if (!is_red (sibling->left) && !is_red (sibling->right)) {
+				sibling->red = true;
+				e = parent;
+				parent = e->parent;
+				continue;
+			}
+			if (!is_red (sibling->left)) {
+				sibling->right->red = false;
+				sibling->red = true;
+				rotate_left (tree, sibling);
+				sibling = parent->left;
+			}
+			sibling->red = parent->red;
+			parent->red = false;
+			sibling->left->red = false;
+			rotate_right (tree, parent);
+		}
+		e = tree->root;
+	}
+	if (e != NULL)
+		e->red = false;
+}
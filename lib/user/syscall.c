@@ -155,6 +155,41 @@ munmap (void *addr) {
 	syscall1 (SYS_MUNMAP, addr);
 }
 
+int
+madvise (void *addr, size_t length, int advice) {
+	return syscall3 (SYS_MADVISE, addr, length, advice);
+}
+
+int
+vmstat (struct vmstat *st) {
+	return syscall1 (SYS_VMSTAT, st);
+}
+
+int
+mlock (void *addr, size_t length) {
+	return syscall2 (SYS_MLOCK, addr, length);
+}
+
+int
+munlock (void *addr, size_t length) {
+	return syscall2 (SYS_MUNLOCK, addr, length);
+}
+
+int
+mlockall (int flags) {
+	return syscall1 (SYS_MLOCKALL, flags);
+}
+
+int
+munlockall (void) {
+	return syscall0 (SYS_MUNLOCKALL);
+}
+
+int
+mincore (void *addr, size_t length, unsigned char *vec) {
+	return syscall3 (SYS_MINCORE, addr, length, vec);
+}
+
 bool
 chdir (const char *dir) {
 	return syscall1 (SYS_CHDIR, dir);
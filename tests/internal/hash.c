@@ -0,0 +1,257 @@
+/* Test program for lib/kernel/hash.c and lib/kernel/ohash.c.
+
+   Checks both hash tables against an array of flags through a
+   random sequence of insertions and deletions that makes them
+   grow and shrink, then times each, reporting the total and the
+   worst single insertion in CPU cycles.  The worst case is what
+   incremental resizing is for, so struct hash is also timed with
+   each resize forced to finish within the insertion that started
+   it, as the table used to do: that one, like struct ohash, stalls
+   whenever it grows, while incremental resizing should not.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <hash.h>
+#include <ohash.h>
+#include <random.h>
+#include <stdio.h>
+#include "threads/test.h"
+
+/* Number of keys. */
+#define KEY_CNT 16384
+
+/* Number of random operations in the correctness test. */
+#define OP_CNT (KEY_CNT * 16)
+
+/* A hash table element. */
+struct value
+  {
+    struct hash_elem elem;      /* Hash table element. */
+    uint64_t key;               /* Key. */
+    bool present;               /* In the tables? */
+  };
+
+static struct value values[KEY_CNT];
+
+static uint64_t value_hash (const struct hash_elem *, void *);
+static bool value_less (const struct hash_elem *, const struct hash_elem *,
+                        void *);
+static void test_random (void);
+static void verify (struct hash *, struct ohash *, size_t cnt);
+static void bench (void);
+static void insert_one_shot (struct hash *, struct hash_elem *);
+static uint64_t rdtsc (void);
+
+/* Test the hash table implementations. */
+void
+test (void)
+{
+  test_random ();
+  bench ();
+  printf ("hash: PASS\n");
+}
+
+/* Inserts and deletes random keys in both tables, checking every
+   result, first mostly inserting and then mostly deleting. */
+static void
+test_random (void)
+{
+  struct hash h;
+  struct ohash o;
+  size_t cnt = 0;
+  int op;
+
+  printf ("testing random insertions and deletions:");
+  ASSERT (hash_init (&h, value_hash, value_less, NULL));
+  ASSERT (ohash_init (&o));
+  for (op = 0; op < KEY_CNT; op++)
+    {
+      values[op].key = op;
+      values[op].present = false;
+    }
+
+  for (op = 0; op < OP_CNT; op++)
+    {
+      struct value *v = &values[random_ulong () % KEY_CNT];
+      bool insert = random_ulong () % 3 != 0;
+
+      if (op >= OP_CNT / 2)
+        insert = !insert;
+      if (insert)
+        {
+          ASSERT ((hash_insert (&h, &v->elem) == NULL) == !v->present);
+          ASSERT (ohash_insert (&o, v->key, v) == !v->present);
+          if (!v->present)
+            cnt++;
+          v->present = true;
+        }
+      else
+        {
+          struct value key;
+
+          key.key = v->key;
+          ASSERT ((hash_delete (&h, &key.elem) != NULL) == v->present);
+          ASSERT (ohash_delete (&o, v->key) == (v->present ? v : NULL));
+          if (v->present)
+            cnt--;
+          v->present = false;
+        }
+
+      if (op % (OP_CNT / 16) == 0)
+        {
+          printf (" %zu", cnt);
+          verify (&h, &o, cnt);
+        }
+    }
+  verify (&h, &o, cnt);
+
+  hash_destroy (&h, NULL);
+  ohash_destroy (&o);
+  printf (" done\n");
+}
+
+/* Verifies that H and O both hold exactly the CNT values that are
+   marked present. */
+static void
+verify (struct hash *h, struct ohash *o, size_t cnt)
+{
+  struct hash_iterator i;
+  size_t seen = 0;
+  int k;
+
+  ASSERT (hash_size (h) == cnt);
+  ASSERT (ohash_size (o) == cnt);
+
+  hash_first (&i, h);
+  while (hash_next (&i))
+    {
+      ASSERT (hash_entry (hash_cur (&i), struct value, elem)->present);
+      seen++;
+    }
+  ASSERT (seen == cnt);
+
+  for (k = 0; k < KEY_CNT; k++)
+    {
+      struct value key;
+
+      key.key = k;
+      ASSERT ((hash_find (h, &key.elem) != NULL) == values[k].present);
+      ASSERT (ohash_find (o, k) == (values[k].present ? &values[k] : NULL));
+    }
+}
+
+/* Times KEY_CNT insertions, then as many successful lookups, in
+   each table. */
+static void
+bench (void)
+{
+  struct hash h;
+  struct ohash o;
+  uint64_t start, t, worst;
+  int k;
+
+  ASSERT (hash_init (&h, value_hash, value_less, NULL));
+  worst = 0;
+  start = rdtsc ();
+  for (k = 0; k < KEY_CNT; k++)
+    {
+      t = rdtsc ();
+      hash_insert (&h, &values[k].elem);
+      t = rdtsc () - t;
+      if (t > worst)
+        worst = t;
+    }
+  printf ("hash:  %d inserts in %llu cycles, worst %llu\n", KEY_CNT,
+          (unsigned long long) (rdtsc () - start),
+          (unsigned long long) worst);
+  start = rdtsc ();
+  for (k = 0; k < KEY_CNT; k++)
+    ASSERT (hash_find (&h, &values[k].elem) != NULL);
+  printf ("hash:  %d lookups in %llu cycles\n", KEY_CNT,
+          (unsigned long long) (rdtsc () - start));
+  hash_destroy (&h, NULL);
+
+  ASSERT (hash_init (&h, value_hash, value_less, NULL));
+  worst = 0;
+  start = rdtsc ();
+  for (k = 0; k < KEY_CNT; k++)
+    {
+      t = rdtsc ();
+      insert_one_shot (&h, &values[k].elem);
+      t = rdtsc () - t;
+      if (t > worst)
+        worst = t;
+    }
+  printf ("hash (one-shot resize): %d inserts in %llu cycles, worst %llu\n",
+          KEY_CNT, (unsigned long long) (rdtsc () - start),
+          (unsigned long long) worst);
+  hash_destroy (&h, NULL);
+
+  ASSERT (ohash_init (&o));
+  worst = 0;
+  start = rdtsc ();
+  for (k = 0; k < KEY_CNT; k++)
+    {
+      t = rdtsc ();
+      ohash_insert (&o, k, &values[k]);
+      t = rdtsc () - t;
+      if (t > worst)
+        worst = t;
+    }
+  printf ("ohash: %d inserts in %llu cycles, worst %llu\n", KEY_CNT,
+          (unsigned long long) (rdtsc () - start),
+          (unsigned long long) worst);
+  start = rdtsc ();
+  for (k = 0; k < KEY_CNT; k++)
+    ASSERT (ohash_find (&o, k) == &values[k]);
+  printf ("ohash: %d lookups in %llu cycles\n", KEY_CNT,
+          (unsigned long long) (rdtsc () - start));
+  ohash_destroy (&o);
+}
+
+/* Inserts E into H, then finishes any resize that is under way
+   before returning, so that the whole resize is charged to the
+   insertion that started it.  Each hash_replace() of E with
+   itself moves a few more old buckets. */
+static void
+insert_one_shot (struct hash *h, struct hash_elem *e)
+{
+  hash_insert (h, e);
+  while (h->old_buckets != NULL)
+    hash_replace (h, e);
+}
+
+/* Returns the CPU's time stamp counter. */
+static uint64_t
+rdtsc (void)
+{
+  uint32_t lo, hi;
+
+  asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((uint64_t) hi << 32) | lo;
+}
+
+/* Returns a hash of value E's key. */
+static uint64_t
+value_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct value *v = hash_entry (e, struct value, elem);
+
+  return hash_bytes (&v->key, sizeof v->key);
+}
+
+/* Returns true if value A's key is less than value B's, false
+   otherwise. */
+static bool
+value_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct value *a = hash_entry (a_, struct value, elem);
+  const struct value *b = hash_entry (b_, struct value, elem);
+
+  return a->key < b->key;
+}
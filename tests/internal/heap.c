@@ -0,0 +1,148 @@
+/* Test program for lib/kernel/heap.c.
+
+   Pushes values in random order, some of them more than once,
+   changes and removes some in random order, and checks that the
+   rest come out of the heap in order.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <heap.h>
+#include <random.h>
+#include <stdio.h>
+#include "threads/test.h"
+
+/* Maximum number of elements in a heap that we will test. */
+#define MAX_SIZE 64
+
+/* A heap element. */
+struct value
+  {
+    struct heap_elem elem;      /* Heap element. */
+    int value;                  /* Item value. */
+    bool present;               /* In the heap? */
+  };
+
+static void shuffle (struct value *[], size_t);
+static bool value_less (const struct heap_elem *, const struct heap_elem *,
+                        void *);
+static void verify_min (struct heap *, struct value[], int size);
+
+/* Test the pairing heap implementation. */
+void
+test (void)
+{
+  int size;
+
+  printf ("testing various size heaps:");
+  for (size = 0; size < MAX_SIZE; size++)
+    {
+      int repeat;
+
+      printf (" %d", size);
+      for (repeat = 0; repeat < 10; repeat++)
+        {
+          static struct value values[MAX_SIZE];
+          static struct value *order[MAX_SIZE];
+          struct heap heap;
+          int i, last;
+
+          /* Push values 0...SIZE/2, most of them twice, in random
+             order. */
+          for (i = 0; i < size; i++)
+            {
+              values[i].value = i / 2;
+              values[i].present = true;
+              order[i] = &values[i];
+            }
+          shuffle (order, size);
+          heap_init (&heap, value_less, NULL);
+          for (i = 0; i < size; i++)
+            heap_push (&heap, &order[i]->elem);
+          ASSERT (heap_size (&heap) == (size_t) size);
+          verify_min (&heap, values, size);
+
+          /* Change a quarter of the values and remove another
+             quarter, in random order. */
+          shuffle (order, size);
+          for (i = 0; i < size / 4; i++)
+            {
+              order[i]->value = random_ulong () % (size + 1);
+              heap_update (&heap, &order[i]->elem);
+              verify_min (&heap, values, size);
+            }
+          for (; i < size / 2; i++)
+            {
+              heap_remove (&heap, &order[i]->elem);
+              order[i]->present = false;
+              verify_min (&heap, values, size);
+            }
+          ASSERT (heap_size (&heap) == (size_t) (size - (size / 2 - size / 4)));
+
+          /* Pop the rest in order. */
+          last = -1;
+          while (!heap_empty (&heap))
+            {
+              struct value *v = heap_entry (heap_pop (&heap), struct value,
+                                            elem);
+              ASSERT (v->present);
+              ASSERT (v->value >= last);
+              v->present = false;
+              last = v->value;
+            }
+          for (i = 0; i < size; i++)
+            ASSERT (!values[i].present);
+          ASSERT (heap_min (&heap) == NULL);
+        }
+    }
+
+  printf (" done\n");
+  printf ("heap: PASS\n");
+}
+
+/* Shuffles the CNT elements in ARRAY into random order. */
+static void
+shuffle (struct value **array, size_t cnt)
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      size_t j = i + random_ulong () % (cnt - i);
+      struct value *t = array[j];
+      array[j] = array[i];
+      array[i] = t;
+    }
+}
+
+/* Returns true if value A is less than value B, false
+   otherwise. */
+static bool
+value_less (const struct heap_elem *a_, const struct heap_elem *b_,
+            void *aux UNUSED)
+{
+  const struct value *a = heap_entry (a_, struct value, elem);
+  const struct value *b = heap_entry (b_, struct value, elem);
+
+  return a->value < b->value;
+}
+
+/* Verifies that the least element of HEAP has the least value of
+   the SIZE VALUES that are present. */
+static void
+verify_min (struct heap *heap, struct value values[], int size)
+{
+  struct heap_elem *min = heap_min (heap);
+  int i;
+
+  for (i = 0; i < size; i++)
+    if (values[i].present)
+      {
+        ASSERT (min != NULL);
+        ASSERT (heap_entry (min, struct value, elem)->value
+                <= values[i].value);
+      }
+}
@@ -0,0 +1,195 @@
+/* Test program for lib/kernel/rbtree.c.
+
+   Inserts values in random order, some of them more than once,
+   and removes them in random order, checking after each step
+   that the tree keeps its values in order, equal ones in the
+   order they were inserted, and keeps the red-black rules.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <rbtree.h>
+#include <random.h>
+#include <stdio.h>
+#include "threads/test.h"
+
+/* Maximum number of elements in a tree that we will test. */
+#define MAX_SIZE 64
+
+/* A tree element. */
+struct value
+  {
+    struct rb_elem elem;        /* Tree element. */
+    int value;                  /* Item value. */
+    int seq;                    /* Order of insertion. */
+  };
+
+static void shuffle (struct value *[], size_t);
+static bool value_less (const struct rb_elem *, const struct rb_elem *,
+                        void *);
+static void verify_tree (struct rbtree *, size_t size);
+static int black_height (const struct rb_elem *);
+
+/* Test the red-black tree implementation. */
+void
+test (void)
+{
+  int size;
+
+  printf ("testing various size trees:");
+  for (size = 0; size < MAX_SIZE; size++)
+    {
+      int repeat;
+
+      printf (" %d", size);
+      for (repeat = 0; repeat < 10; repeat++)
+        {
+          static struct value values[MAX_SIZE];
+          static struct value *order[MAX_SIZE];
+          struct rbtree tree;
+          int i;
+
+          /* Put values 0...SIZE/2, most of them twice, in random
+             order in ORDER. */
+          for (i = 0; i < size; i++)
+            {
+              values[i].value = i / 2;
+              order[i] = &values[i];
+            }
+          shuffle (order, size);
+
+          /* Build the tree. */
+          rb_init (&tree, value_less, NULL);
+          for (i = 0; i < size; i++)
+            {
+              order[i]->seq = i;
+              rb_insert (&tree, &order[i]->elem);
+              verify_tree (&tree, i + 1);
+            }
+
+          /* Find each value. */
+          for (i = 0; i < size; i++)
+            {
+              struct value key;
+              struct rb_elem *e;
+
+              key.value = values[i].value;
+              e = rb_find (&tree, &key.elem);
+              ASSERT (e != NULL);
+              ASSERT (rb_entry (e, struct value, elem)->value == key.value);
+              ASSERT (rb_prev (e) == NULL
+                      || rb_entry (rb_prev (e), struct value,
+                                   elem)->value < key.value);
+            }
+          if (size > 0)
+            {
+              struct value key;
+
+              key.value = size;
+              ASSERT (rb_find (&tree, &key.elem) == NULL);
+            }
+
+          /* Remove half the values in random order, then pop the
+             rest in order. */
+          shuffle (order, size);
+          for (i = 0; i < size / 2; i++)
+            {
+              rb_remove (&tree, &order[i]->elem);
+              verify_tree (&tree, size - i - 1);
+            }
+          for (i = size / 2; i < size; i++)
+            {
+              struct rb_elem *min = rb_min (&tree);
+
+              ASSERT (rb_pop_min (&tree) == min);
+              verify_tree (&tree, size - i - 1);
+            }
+          ASSERT (rb_empty (&tree));
+        }
+    }
+
+  printf (" done\n");
+  printf ("rbtree: PASS\n");
+}
+
+/* Shuffles the CNT elements in ARRAY into random order. */
+static void
+shuffle (struct value **array, size_t cnt)
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      size_t j = i + random_ulong () % (cnt - i);
+      struct value *t = array[j];
+      array[j] = array[i];
+      array[i] = t;
+    }
+}
+
+/* Returns true if value A is less than value B, false
+   otherwise. */
+static bool
+value_less (const struct rb_elem *a_, const struct rb_elem *b_,
+            void *aux UNUSED)
+{
+  const struct value *a = rb_entry (a_, struct value, elem);
+  const struct value *b = rb_entry (b_, struct value, elem);
+
+  return a->value < b->value;
+}
+
+/* Verifies that TREE holds SIZE elements in order, forward and
+   backward, and keeps the red-black rules. */
+static void
+verify_tree (struct rbtree *tree, size_t size)
+{
+  struct rb_elem *e, *prev = NULL;
+  size_t i;
+
+  ASSERT (rb_size (tree) == size);
+  ASSERT (rb_empty (tree) == (size == 0));
+  ASSERT (tree->root == NULL
+          || (tree->root->parent == NULL && !tree->root->red));
+  black_height (tree->root);
+
+  for (i = 0, e = rb_min (tree); e != NULL; i++, e = rb_next (e))
+    {
+      ASSERT (rb_prev (e) == prev);
+      if (prev != NULL)
+        {
+          struct value *a = rb_entry (prev, struct value, elem);
+          struct value *b = rb_entry (e, struct value, elem);
+          ASSERT (a->value < b->value
+                  || (a->value == b->value && a->seq < b->seq));
+        }
+      prev = e;
+    }
+  ASSERT (i == size);
+  ASSERT (prev == rb_max (tree));
+}
+
+/* Verifies that no red element under E has a red child and that
+   every path from E down has the same number of black elements,
+   which is returned. */
+static int
+black_height (const struct rb_elem *e)
+{
+  int left, right;
+
+  if (e == NULL)
+    return 1;
+  ASSERT (e->left == NULL || e->left->parent == e);
+  ASSERT (e->right == NULL || e->right->parent == e);
+  ASSERT (!e->red
+          || ((e->left == NULL || !e->left->red)
+              && (e->right == NULL || !e->right->red)));
+
+  left = black_height (e->left);
+  right = black_height (e->right);
+  ASSERT (left == right);
+  return left + !e->red;
+}
@@ -31,6 +31,7 @@
 #include "tests/threads/tests.h"
 #ifdef VM
 #include "vm/vm.h"
+#include "vm/ksm.h"
 #endif
 #ifdef FILESYS
 #include "devices/disk.h"
@@ -51,11 +52,17 @@ bool power_off_when_done;
 
 bool thread_tests;
 
+/* Write-Protect enable in kernel mode. */
+#define CR0_WP 0x00010000
+
 static void bss_init (void);
 static void paging_init (uint64_t mem_end);
 
 static char **read_command_line (void);
 static char **parse_options (char **argv);
+#ifdef FILESYS
+static void parse_ramdisk (char *value);
+#endif
 static void run_actions (char **argv);
 static void usage (void);
 
@@ -165,6 +172,14 @@ paging_init (uint64_t mem_end) {
 
 	// reload cr3
 	pml4_activate(0);
+
+#ifdef VM
+	/* Make the kernel honor read-only user mappings as well, so that
+	 * a system call writing to user memory takes the same write
+	 * faults as the process itself would. */
+	asm volatile ("movq %%cr0, %%rax; orq %0, %%rax; movq %%rax, %%cr0"
+			: : "i" (CR0_WP) : "rax", "memory");
+#endif
 }
 
 /* Breaks the kernel command line into words and returns them as
@@ -216,6 +231,8 @@ parse_options (char **argv) {
 #ifdef FILESYS
 		else if (!strcmp (name, "-f"))
 			format_filesys = true;
+		else if (!strcmp (name, "-ramdisk"))
+			parse_ramdisk (value);
 #endif
 		else if (!strcmp (name, "-rs"))
 			random_init (atoi (value));
@@ -226,6 +243,12 @@ parse_options (char **argv) {
 			user_page_limit = atoi (value);
 		else if (!strcmp (name, "-threads-tests"))
 			thread_tests = true;
+#endif
+#ifdef VM
+		else if (!strcmp (name, "-stack"))
+			vm_stack_max = atoi (value) * 1024;
+		else if (!strcmp (name, "-mlock"))
+			vm_mlock_max = atoi (value) * 1024;
 #endif
 		else
 			PANIC ("unknown option `%s' (use -h for help)", name);
@@ -234,6 +257,23 @@ parse_options (char **argv) {
 	return argv;
 }
 
+#ifdef FILESYS
+/* Parses the value of "-ramdisk=ROLE:SIZE", which replaces the
+   fs, scratch or swap disk by a SIZE kB RAM disk. */
+static void
+parse_ramdisk (char *value) {
+	char *save_ptr;
+	char *role = value != NULL ? strtok_r (value, ":", &save_ptr) : NULL;
+	char *size = role != NULL ? strtok_r (NULL, "", &save_ptr) : NULL;
+	int kb = size != NULL ? atoi (size) : 0;
+
+	if (kb <= 0)
+		PANIC ("-ramdisk requires ROLE:SIZE (use -h for help)");
+	if (!disk_set_ramdisk (role, (disk_sector_t) kb * (1024 / DISK_SECTOR_SIZE)))
+		PANIC ("unknown ramdisk role `%s' (use -h for help)", role);
+}
+#endif
+
 /* Runs the task specified in ARGV[1]. */
 static void
 run_task (char **argv) {
@@ -324,10 +364,18 @@ usage (void) {
 			"  -h                 Print this help message and power off.\n"
 			"  -q                 Power off VM after actions or on panic.\n"
 			"  -f                 Format file system disk during startup.\n"
+#ifdef FILESYS
+			"  -ramdisk=ROLE:KB   Use a KB kB RAM disk as the fs, scratch or\n"
+			"                     swap disk instead of the IDE disk.\n"
+#endif
 			"  -rs=SEED           Set random number seed to SEED.\n"
 			"  -mlfqs             Use multi-level feedback queue scheduler.\n"
 #ifdef USERPROG
 			"  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+			"  -stack=KB          Limit user stacks to KB kB (default 1024).\n"
+			"  -mlock=KB          Let a process lock KB kB (default 1024).\n"
 #endif
 			);
 	power_off ();
@@ -362,4 +410,8 @@ print_stats (void) {
 #ifdef USERPROG
 	exception_print_stats ();
 #endif
+#ifdef VM
+	vm_print_stats ();
+	ksm_print_stats ();
+#endif
 }
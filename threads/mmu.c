@@ -8,6 +8,27 @@
 #include "threads/mmu.h"
 #include "intrinsic.h"
 
+/* Replaces the huge page that *PDE maps by a page table mapping the
+ * same pages, with the same permissions and accessed and dirty bits,
+ * so that one of them can change on its own.  Returns false if out
+ * of memory. */
+static bool
+huge_split (uint64_t *pde) {
+	uint64_t *pt = palloc_get_page (0);
+	uint64_t base = *pde & ~HUGE_PGMASK;
+	uint64_t flags = *pde & PTE_FLAGS & ~PTE_PS;
+
+	if (pt == NULL)
+		return false;
+	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++)
+		pt[i] = (base + i * PGSIZE) | flags;
+	*pde = vtop (pt) | PTE_U | PTE_W | PTE_P;
+	return true;
+}
+
+/* A huge page's entry stands for all of its pages, so when asked not
+ * to create, returns the page directory entry itself.  To create is
+ * to be about to change the page at VA, so the huge page is split. */
 static uint64_t *
 pgdir_walk (uint64_t *pdp, const uint64_t va, int create) {
 	int idx = PDX (va);
@@ -22,6 +43,11 @@ pgdir_walk (uint64_t *pdp, const uint64_t va, int create) {
 					return NULL;
 			} else
 				return NULL;
+		} else if (pdp[idx] & PTE_PS) {
+			if (!create)
+				return &pdp[idx];
+			if (!huge_split (&pdp[idx]))
+				return NULL;
 		}
 		return (uint64_t *) ptov (PTE_ADDR (pdp[idx]) + 8 * PTX (va));
 	}
@@ -122,7 +148,7 @@ pgdir_for_each (uint64_t *pdp, pte_for_each_func *func, void *aux,
 		unsigned pml4_index, unsigned pdp_index) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
+		if ((((uint64_t) pte) & PTE_P) && !(pdp[i] & PTE_PS))
 			if (!pt_for_each ((uint64_t *) PTE_ADDR (pte), func, aux,
 					pml4_index, pdp_index, i))
 				return false;
@@ -169,7 +195,8 @@ static void
 pgdir_destroy (uint64_t *pdp) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
+		/* A huge page is not a page table. */
+		if ((((uint64_t) pte) & PTE_P) && !(pdp[i] & PTE_PS))
 			pt_destroy (PTE_ADDR (pte));
 	}
 	palloc_free_page ((void *) pdp);
@@ -216,6 +243,9 @@ pml4_get_page (uint64_t *pml4, const void *uaddr) {
 
 	uint64_t *pte = pml4e_walk (pml4, (uint64_t) uaddr, 0);
 
+	if (pte && (*pte & PTE_P) && (*pte & PTE_PS))
+		return ptov (*pte & ~HUGE_PGMASK)
+			+ ((uint64_t) uaddr & HUGE_PGMASK);
 	if (pte && (*pte & PTE_P))
 		return ptov (PTE_ADDR (*pte)) + pg_ofs (uaddr);
 	return NULL;
@@ -243,9 +273,57 @@ pml4_set_page (uint64_t *pml4, void *upage, void *kpage, bool rw) {
 	return pte != NULL;
 }
 
+/* Maps the HUGE_PGSIZE bytes at user virtual address UPAGE to
+ * those at kernel virtual address KPAGE with a single huge page
+ * entry in PML4, both aligned to HUGE_PGSIZE, read/write if RW.
+ * Pages mapped there before are replaced, and the page table that
+ * held them is freed.  Returns true if successful, false if memory
+ * allocation failed. */
+bool
+pml4_set_huge_page (uint64_t *pml4, void *upage, void *kpage, bool rw) {
+	uint64_t va = (uint64_t) upage;
+	uint64_t *pdpe, *pde, *pt = NULL;
+
+	ASSERT ((va & HUGE_PGMASK) == 0);
+	ASSERT ((vtop (kpage) & HUGE_PGMASK) == 0);
+	ASSERT (is_user_vaddr (upage));
+	ASSERT (pml4 != base_pml4);
+
+	/* Walk down to the page directory, making sure a page table
+	 * exists there too, so that only the last level is left. */
+	if (pml4e_walk (pml4, va, 1) == NULL)
+		return false;
+	pdpe = ptov (PTE_ADDR (pml4[PML4 (va)]));
+	pde = (uint64_t *) ptov (PTE_ADDR (pdpe[PDPE (va)])) + PDX (va);
+
+	if (!(*pde & PTE_PS))
+		pt = ptov (PTE_ADDR (*pde));
+	*pde = vtop (kpage) | PTE_PS | PTE_P | (rw ? PTE_W : 0) | PTE_U;
+	if (rcr3 () == vtop (pml4)) {
+		/* Any page still mapped by the old page table may be in the
+		 * TLB, not just the first. */
+		if (pt != NULL)
+			for (unsigned i = 1; i < PGSIZE / sizeof (uint64_t); i++)
+				if (pt[i] & PTE_P)
+					invlpg (va + i * PGSIZE);
+		invlpg (va);
+	}
+	if (pt != NULL)
+		palloc_free_page (pt);
+	return true;
+}
+
+/* Returns true if UPAGE is mapped by a huge page in PML4. */
+bool
+pml4_is_huge (uint64_t *pml4, const void *upage) {
+	uint64_t *pte = pml4e_walk (pml4, (uint64_t) upage, false);
+	return pte != NULL && (*pte & PTE_P) && (*pte & PTE_PS);
+}
+
 /* Marks user virtual page UPAGE "not present" in page
  * directory PD.  Later accesses to the page will fault.  Other
- * bits in the page table entry are preserved.
+ * bits in the page table entry are preserved.  A huge page that
+ * UPAGE is part of is split, leaving the other pages mapped.
  * UPAGE need not be mapped. */
 void
 pml4_clear_page (uint64_t *pml4, void *upage) {
@@ -254,6 +332,11 @@ pml4_clear_page (uint64_t *pml4, void *upage) {
 	ASSERT (is_user_vaddr (upage));
 
 	pte = pml4e_walk (pml4, (uint64_t) upage, false);
+	if (pte != NULL && (*pte & PTE_P) && (*pte & PTE_PS)) {
+		pte = pml4e_walk (pml4, (uint64_t) upage, true);
+		if (pte == NULL)
+			PANIC ("out of memory splitting a huge page");
+	}
 
 	if (pte != NULL && (*pte & PTE_P) != 0) {
 		*pte &= ~PTE_P;
@@ -273,7 +356,7 @@ pml4_is_dirty (uint64_t *pml4, const void *vpage) {
 }
 
 /* Set the dirty bit to DIRTY in the PTE for virtual page VPAGE
- * in PML4. */
+ * in PML4.  For a huge page, this is the bit of all its pages. */
 void
 pml4_set_dirty (uint64_t *pml4, const void *vpage, bool dirty) {
 	uint64_t *pte = pml4e_walk (pml4, (uint64_t) vpage, false);
@@ -299,7 +382,7 @@ pml4_is_accessed (uint64_t *pml4, const void *vpage) {
 }
 
 /* Sets the accessed bit to ACCESSED in the PTE for virtual page
-   VPAGE in PD. */
+   VPAGE in PD.  For a huge page, this is the bit of all its pages. */
 void
 pml4_set_accessed (uint64_t *pml4, const void *vpage, bool accessed) {
 	uint64_t *pte = pml4e_walk (pml4, (uint64_t) vpage, false);
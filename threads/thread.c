@@ -452,6 +452,10 @@ init_thread(struct thread *t, const char *name, int priority)
 	list_init(&t->fdt);			 // 파일 디스크립터 테이블
 
 #endif
+#ifdef VM
+	/* 프로세스가 아닌 스레드도 종료 시 spt를 정리하므로 lock은 미리 초기화 */
+	lock_init(&t->spt.lock);
+#endif
 }
 
 /* Chooses and returns the next thread to be scheduled.  Should
@@ -287,8 +287,8 @@ __do_fork(void *aux)
 
 	process_activate(curr);
 #ifdef VM
-	supplemental_page_table_init(&current->spt);
-	if (!supplemental_page_table_copy(&current->spt, &parent->spt))
+	supplemental_page_table_init(&curr->spt);
+	if (!supplemental_page_table_copy(&curr->spt, &parent->spt))
 		goto error;
 #else
 	if (!pml4_for_each(parent->pml4, duplicate_pte, parent)) // 가상 메모리 영역 복제
@@ -325,6 +325,9 @@ int process_exec(void *f_name)
 
 	/* We first kill the current context */
 	process_cleanup();
+#ifdef VM
+	supplemental_page_table_init(&thread_current()->spt);
+#endif
 
 	/* And then load the binary */
 	success = load(file_name, &_if);
@@ -817,14 +820,6 @@ install_page(void *upage, void *kpage, bool writable)
  * If you want to implement the function for only project 2, implement it on the
  * upper block. */
 
-static bool
-lazy_load_segment(struct page *page, void *aux)
-{
-	/* TODO: Load the segment from the file */
-	/* TODO: This called when the first page fault occurs on address VA. */
-	/* TODO: VA is available when calling this function. */
-}
-
 /* Loads a segment starting at offset OFS in FILE at address
  * UPAGE.  In total, READ_BYTES + ZERO_BYTES bytes of virtual
  * memory are initialized, as follows:
@@ -847,25 +842,28 @@ load_segment(struct file *file, off_t ofs, uint8_t *upage,
 	ASSERT(pg_ofs(upage) == 0);
 	ASSERT(ofs % PGSIZE == 0);
 
-	while (read_bytes > 0 || zero_bytes > 0)
-	{
-		/* Do calculate how to fill this page.
-		 * We will read PAGE_READ_BYTES bytes from FILE
-		 * and zero the final PAGE_ZERO_BYTES bytes. */
-		size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
-		size_t page_zero_bytes = PGSIZE - page_read_bytes;
+	/* 파일 내용이 있는 페이지들은 private 파일 영역으로 등록한다. 페이지는
+	 * 처음 접근될 때 페이지 캐시의 프레임을 복사 없이 읽기 전용으로 공유하고,
+	 * 쓰기가 일어나면 복사본을 받아 익명 페이지가 된다.
+	 * 나머지 bss는 익명 영역으로 등록한다. vma가 파일을 소유하므로 reopen 한다. */
+	size_t file_span = ROUND_UP(read_bytes, PGSIZE);
 
-		/* TODO: Set up aux to pass information to the lazy_load_segment. */
-		void *aux = NULL;
-		if (!vm_alloc_page_with_initializer(VM_ANON, upage,
-											writable, lazy_load_segment, aux))
+	if (read_bytes > 0)
+	{
+		struct file *seg_file = file_reopen(file);
+		if (seg_file == NULL)
 			return false;
-
-		/* Advance. */
-		read_bytes -= page_read_bytes;
-		zero_bytes -= page_zero_bytes;
-		upage += PGSIZE;
+		if (!vm_map(upage, file_span, VM_FILE | VM_PRIVATE, writable,
+					seg_file, ofs, read_bytes, NULL))
+		{
+			file_close(seg_file);
+			return false;
+		}
 	}
+	if (file_span < read_bytes + zero_bytes &&
+		!vm_map(upage + file_span, read_bytes + zero_bytes - file_span,
+				VM_ANON, writable, NULL, 0, 0, NULL))
+		return false;
 	return true;
 }
 
@@ -876,11 +874,15 @@ setup_stack(struct intr_frame *if_)
 	bool success = false;
 	void *stack_bottom = (void *)(((uint8_t *)USER_STACK) - PGSIZE);
 
-	/* TODO: Map the stack on stack_bottom and claim the page immediately.
-	 * TODO: If success, set the rsp accordingly.
-	 * TODO: You should mark the page is stack */
-	/* TODO: Your code goes here */
-
+	/* 스택 영역을 VM_STACK으로 표시해 등록하고, 인자를 바로 써야 하므로
+	 * 첫 페이지는 즉시 할당한다. */
+	if (vm_map(stack_bottom, PGSIZE, VM_ANON | VM_STACK, true, NULL, 0, 0,
+			   NULL) &&
+		vm_claim_page(stack_bottom))
+	{
+		if_->rsp = USER_STACK;
+		success = true;
+	}
 	return success;
 }
 #endif /* VM */
@@ -13,12 +13,16 @@
 #include "userprog/syscall.h"
 #include "threads/malloc.h"
 #include "intrinsic.h"
+#ifdef VM
+#include "vm/vm.h"
+#endif
 
 void syscall_entry(void);
 void syscall_handler(struct intr_frame *);
 
 /* User Memory */
 void check_address(void *addr);
+void check_buffer(void *buffer, size_t size);
 
 /* System Calls */
 void halt();
@@ -36,6 +40,20 @@ int write(int fd, void *buffer, unsigned size);
 unsigned tell(int fd);
 void seek(int fd, unsigned position);
 int dup2(int oldfd, int newfd);
+bool mkdir(const char *dir);
+int mount(const char *path, int chan_no, int dev_no);
+int umount(const char *path);
+#ifdef VM
+void *mmap(void *addr, size_t length, int writable, int fd, off_t offset);
+void munmap(void *addr);
+int madvise(void *addr, size_t length, int advice);
+int vmstat(struct vmstat *st);
+int mlock(void *addr, size_t length);
+int munlock(void *addr, size_t length);
+int mlockall(int flags);
+int munlockall(void);
+int mincore(void *addr, size_t length, unsigned char *vec);
+#endif
 
 /* filesys lock */
 struct lock fd_lock;
@@ -72,7 +90,11 @@ void syscall_init(void)
 void syscall_handler(struct intr_frame *f)
 {
 	uint64_t sys_no = f->R.rax;
-	if (sys_no >= 0x0 && sys_no <= 0x18)
+#ifdef VM
+	/* 커널 모드에서 난 페이지 폴트의 스택 성장 판단에 유저 rsp가 필요 */
+	thread_current()->user_rsp = (void *)f->rsp;
+#endif
+	if (sys_no >= 0x0 && sys_no <= SYS_MINCORE)
 	{
 		switch (sys_no)
 		{
@@ -121,6 +143,46 @@ void syscall_handler(struct intr_frame *f)
 		case SYS_DUP2:
 			f->R.rax = dup2(f->R.rdi, f->R.rsi);
 			break;
+		case SYS_MKDIR:
+			f->R.rax = mkdir((const char *)f->R.rdi);
+			break;
+		case SYS_MOUNT:
+			f->R.rax = mount((const char *)f->R.rdi, f->R.rsi, f->R.rdx);
+			break;
+		case SYS_UMOUNT:
+			f->R.rax = umount((const char *)f->R.rdi);
+			break;
+#ifdef VM
+		case SYS_MMAP:
+			f->R.rax = (uint64_t)mmap((void *)f->R.rdi, f->R.rsi, f->R.rdx,
+									  f->R.r10, f->R.r8);
+			break;
+		case SYS_MUNMAP:
+			munmap((void *)f->R.rdi);
+			break;
+		case SYS_MADVISE:
+			f->R.rax = madvise((void *)f->R.rdi, f->R.rsi, f->R.rdx);
+			break;
+		case SYS_VMSTAT:
+			f->R.rax = vmstat((struct vmstat *)f->R.rdi);
+			break;
+		case SYS_MLOCK:
+			f->R.rax = mlock((void *)f->R.rdi, f->R.rsi);
+			break;
+		case SYS_MUNLOCK:
+			f->R.rax = munlock((void *)f->R.rdi, f->R.rsi);
+			break;
+		case SYS_MLOCKALL:
+			f->R.rax = mlockall(f->R.rdi);
+			break;
+		case SYS_MUNLOCKALL:
+			f->R.rax = munlockall();
+			break;
+		case SYS_MINCORE:
+			f->R.rax = mincore((void *)f->R.rdi, f->R.rsi,
+							   (unsigned char *)f->R.rdx);
+			break;
+#endif
 		}
 	}
 }
@@ -130,11 +192,40 @@ void syscall_handler(struct intr_frame *f)
 void check_address(void *addr)
 {
 	struct thread *t = thread_current();
-	if (!is_user_vaddr(addr) || addr == NULL ||
-		pml4_get_page(t->pml4, addr) == NULL)
-	{
+	if (!is_user_vaddr(addr) || addr == NULL)
 		exit(-1);
-	}
+#ifdef VM
+	/* 아직 올라오지 않은 페이지도 매핑된 영역 안이면 유효한 주소,
+	 * rsp 바로 아래의 스택 주소라면 스택을 키워서 유효하게 만듦.
+	 * 페이지는 여기서 만들지 않고 실제로 접근할 때 만든다. */
+	if (!vm_is_mapped(addr) &&
+		!vm_stack_grow(addr, t->user_rsp))
+		exit(-1);
+#else
+	if (pml4_get_page(t->pml4, addr) == NULL)
+		exit(-1);
+#endif
+}
+
+/* [User Memory] check_buffer:
+   buffer부터 size 바이트가 걸친 모든 페이지가 user mode에서 접근 가능한지 확인.
+   첫 바이트와 끝 바이트만 보면 사이에 매핑되지 않은 페이지가 있을 때
+   커널 모드에서 폴트가 나므로 페이지마다 확인한다. */
+void check_buffer(void *buffer, size_t size)
+{
+	uint8_t *start = buffer;
+	uint8_t *last = start + size - 1;
+	uint8_t *page;
+
+	if (size == 0)
+		return;
+	if (last < start)
+		exit(-1);
+	check_address(start);
+	for (page = (uint8_t *)pg_round_down(start) + PGSIZE;
+		 page <= (uint8_t *)pg_round_down(last); page += PGSIZE)
+		check_address(page);
+	check_address(last);
 }
 
 /* [System call] halt:
@@ -378,6 +469,129 @@ int dup2(int oldfd, int newfd)
 	return newfd;
 }
 
+/* [System call] mkdir:
+ * dir 디렉터리 생성 (마운트된 파일 시스템에서만 지원) */
+bool mkdir(const char *dir)
+{
+	check_address(dir);
+	return filesys_mkdir(dir);
+}
+
+/* [System call] mount:
+ * path에 파일 시스템을 마운트, 성공 시 0 반환
+ * chan_no가 MOUNT_TMPFS이면 dev_no kB 크기 제한의 tmpfs를 마운트 */
+int mount(const char *path, int chan_no, int dev_no)
+{
+	check_address(path);
+	return filesys_mount(path, chan_no, dev_no) ? 0 : -1;
+}
+
+/* [System call] umount:
+ * path에 마운트된 파일 시스템 해제, 성공 시 0 반환 */
+int umount(const char *path)
+{
+	check_address(path);
+	return filesys_umount(path) ? 0 : -1;
+}
+
+#ifdef VM
+/* [System call] mmap:
+ * fd의 파일을 offset부터 length 바이트만큼 addr에 매핑, 실패 시 NULL 반환
+ * 페이지는 처음 접근될 때 파일에서 읽어온다 */
+void *mmap(void *addr, size_t length, int writable, int fd, off_t offset)
+{
+	struct file_elem *file_elem = fd_get_file_elem(fd);
+
+	/* stdin, stdout은 매핑할 수 없음 */
+	if (!file_elem || file_elem->type != FD_FILE || !file_elem->file)
+		return NULL;
+	return do_mmap(addr, length, writable, file_elem->file, offset);
+}
+
+/* [System call] munmap:
+ * addr에서 시작하는 매핑 해제, 수정된 페이지는 파일에 기록 */
+void munmap(void *addr)
+{
+	do_munmap(addr);
+}
+
+/* [System call] madvise:
+ * addr부터 length 바이트를 어떻게 사용할지 커널에 알림, 성공 시 0 반환
+ * 매핑되지 않은 범위가 있거나 advice를 모르면 -1 반환 */
+int madvise(void *addr, size_t length, int advice)
+{
+	return vm_advise(addr, length, advice) ? 0 : -1;
+}
+
+/* [System call] vmstat:
+ * 현재 프로세스의 메모리 사용량(상주 페이지, 워킹셋 추정치 등)과
+ * 프로세스별/시스템 전체 페이징 이벤트(폴트, 축출, 스왑 아웃 등) 횟수를 st에 기록
+ * spt 락을 잡은 채 유저 메모리에 쓰면 페이지 폴트 시 교착되므로 복사본을 채운 뒤 복사 */
+int vmstat(struct vmstat *st)
+{
+	struct vmstat copy;
+
+	check_buffer(st, sizeof *st);
+	vm_stat(&copy);
+	*st = copy;
+	return 0;
+}
+
+/* [System call] mlock:
+ * addr부터 length 바이트의 페이지를 메모리에 올리고 축출되지 않도록 고정, 성공 시 0 반환
+ * 매핑되지 않은 범위가 있거나 프로세스별 한도를 넘으면 -1 반환 */
+int mlock(void *addr, size_t length)
+{
+	return vm_mlock(addr, length) ? 0 : -1;
+}
+
+/* [System call] munlock:
+ * addr부터 length 바이트의 페이지 고정을 해제, 성공 시 0 반환 */
+int munlock(void *addr, size_t length)
+{
+	return vm_munlock(addr, length) ? 0 : -1;
+}
+
+/* [System call] mlockall:
+ * MCL_CURRENT면 지금 매핑된 모든 페이지를, MCL_FUTURE면 앞으로 만들어질 페이지를 고정
+ * flags가 잘못되었거나 한도를 넘으면 -1 반환 */
+int mlockall(int flags)
+{
+	return vm_mlockall(flags) ? 0 : -1;
+}
+
+/* [System call] munlockall:
+ * 프로세스의 모든 페이지 고정을 해제하고 MCL_FUTURE도 취소 */
+int munlockall(void)
+{
+	vm_munlockall();
+	return 0;
+}
+
+/* [System call] mincore:
+ * addr부터 length 바이트의 각 페이지 상태(MINCORE_* 비트)를 vec에 한 바이트씩 기록, 성공 시 0 반환
+ * spt 락을 잡은 채 유저 메모리에 쓰지 않도록 커널 버퍼에 나눠 받은 뒤 복사 */
+int mincore(void *addr, size_t length, unsigned char *vec)
+{
+	unsigned char buf[64];
+	size_t pages = length / PGSIZE + (length % PGSIZE != 0);
+	size_t i, j, n;
+
+	if (pages == 0)
+		return vm_mincore(addr, 0, buf) ? 0 : -1;
+	check_buffer(vec, pages);
+	for (i = 0; i < pages; i += n)
+	{
+		n = pages - i < sizeof buf ? pages - i : sizeof buf;
+		if (!vm_mincore((uint8_t *)addr + i * PGSIZE, n * PGSIZE, buf))
+			return -1;
+		for (j = 0; j < n; j++)
+			vec[i + j] = buf[j];
+	}
+	return 0;
+}
+#endif
+
 /* fd를 해당 file_elem에 연결하고 fd_elem 구조체 반환 */
 struct fd_elem *register_fd(struct file_elem *file_elem, int fd)
 {
@@ -1,7 +1,38 @@
-/* anon.c: Implementation of page for non-disk image (a.k.a. anonymous page). */
+/* anon.c: Implementation of page for non-disk image (a.k.a. anonymous page).
+ *
+ * Anonymous pages are evicted to the swap disk, one page to a slot
+ * of SECTORS_PER_SLOT consecutive sectors, each written and read
+ * with a single disk request.  Swap is handed out in clusters of
+ * SWAP_CLUSTER slots: a process keeps filling the cluster it
+ * started while the slots there are free, so pages it evicts
+ * together end up next to each other.  On a fault, the following
+ * slots are read ahead while they hold pages of the same area,
+ * which is likely what the process touches next.
+ *
+ * Pages that compress well are not written out at all at first,
+ * but kept compressed in memory by zswap.c, which sends them on to
+ * the slots here only when its pool is full.
+ *
+ * After fork, parent and child may share a slot; SWAP_REFS counts
+ * the pages that refer to each one. */
 
+#include <bitmap.h>
+#include <string.h>
 #include "vm/vm.h"
+#include "vm/zswap.h"
 #include "devices/disk.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Sectors of one swap slot. */
+#define SECTORS_PER_SLOT (PGSIZE / DISK_SECTOR_SIZE)
+
+/* Slots in a cluster. */
+#define SWAP_CLUSTER 16
+
+/* Most pages read ahead after a swap-in fault. */
+#define SWAP_READ_AHEAD 8
 
 /* DO NOT MODIFY BELOW LINE */
 static struct disk *swap_disk;
@@ -17,36 +48,269 @@ static const struct page_operations anon_ops = {
 	.type = VM_ANON,
 };
 
+static struct bitmap *swap_map;     /* Slots in use. */
+static struct page **swap_pages;    /* A page held in each slot. */
+static unsigned *swap_refs;         /* Pages referring to each slot. */
+static size_t slot_cnt;
+static struct lock swap_lock;       /* Protects the tables above. */
+
+static size_t slot_alloc (struct supplemental_page_table *);
+static void slot_put (size_t slot, struct page *);
+static void read_ahead (struct page *, size_t slot);
+
 /* Initialize the data for anonymous pages */
 void
 vm_anon_init (void) {
-	/* TODO: Set up the swap_disk. */
-	swap_disk = NULL;
+	swap_disk = disk_get (1, 1);
+	lock_init (&swap_lock);
+	zswap_init ();
+	if (swap_disk == NULL)
+		return;
+
+	slot_cnt = disk_size (swap_disk) / SECTORS_PER_SLOT;
+	swap_map = bitmap_create (slot_cnt);
+	swap_pages = calloc (slot_cnt, sizeof *swap_pages);
+	swap_refs = calloc (slot_cnt, sizeof *swap_refs);
+	if (swap_map == NULL || swap_pages == NULL || swap_refs == NULL)
+		PANIC ("swap table creation failed");
 }
 
 /* Initialize the file mapping */
 bool
-anon_initializer (struct page *page, enum vm_type type, void *kva) {
+anon_initializer (struct page *page, enum vm_type type UNUSED, void *kva) {
+	/* A page with no initializer starts out zeroed; otherwise the
+	 * initializer fills all of it.  Look before the union is
+	 * overwritten. */
+	bool zero = page->uninit.init == NULL;
+	struct anon_page *anon_page = &page->anon;
+
 	/* Set up the handler */
 	page->operations = &anon_ops;
 
+	anon_page->slot = SWAP_NONE;
+	anon_page->zentry = NULL;
+	anon_page->ahead = false;
+	if (zero)
+		memset (kva, 0, PGSIZE);
+	return true;
+}
+
+/* Turns PAGE, a page of a private file area that has just been
+ * given a frame of its own, into an anonymous page, so that what
+ * the process writes to it goes to swap and never to the file. */
+void
+anon_adopt (struct page *page) {
 	struct anon_page *anon_page = &page->anon;
+
+	page->operations = &anon_ops;
+	anon_page->slot = SWAP_NONE;
+	anon_page->zentry = NULL;
+	anon_page->ahead = false;
 }
 
 /* Swap in the page by read contents from the swap disk. */
 static bool
 anon_swap_in (struct page *page, void *kva) {
 	struct anon_page *anon_page = &page->anon;
+	size_t slot = anon_page->slot;
+
+	if (anon_page->zentry != NULL) {
+		zswap_load (anon_page->zentry, kva);
+		zswap_put (anon_page->zentry);
+		anon_page->zentry = NULL;
+		anon_page->ahead = false;
+		return true;
+	}
+
+	ASSERT (slot != SWAP_NONE);
+
+	disk_read_multiple (swap_disk, slot * SECTORS_PER_SLOT, kva,
+			SECTORS_PER_SLOT);
+	slot_put (slot, page);
+	anon_page->slot = SWAP_NONE;
+
+	if (anon_page->ahead)
+		anon_page->ahead = false;
+	else
+		read_ahead (page, slot);
+	return true;
 }
 
 /* Swap out the page by writing contents to the swap disk. */
 static bool
 anon_swap_out (struct page *page) {
 	struct anon_page *anon_page = &page->anon;
+	struct list_elem *e;
+	size_t slot;
+
+	/* Resident pages hold no copy, so a page sharing the frame that
+	 * has one just got it: refer to the same copy. */
+	for (e = list_begin (&page->frame->pages);
+			e != list_end (&page->frame->pages); e = list_next (e)) {
+		struct page *sibling = list_entry (e, struct page, frame_elem);
+
+		if (sibling != page && page_get_type (sibling) == VM_ANON
+				&& (sibling->anon.slot != SWAP_NONE
+					|| sibling->anon.zentry != NULL)) {
+			anon_page->slot = sibling->anon.slot;
+			anon_page->zentry = sibling->anon.zentry;
+			anon_share (page);
+			return true;
+		}
+	}
+
+	anon_page->zentry = zswap_store (page->frame->kva);
+	if (anon_page->zentry != NULL) {
+		vm_count_event (page->owner, VM_SWAP_OUT);
+		return true;
+	}
+
+	if (swap_disk == NULL)
+		return false;
+	slot = slot_alloc (&page->owner->spt);
+	if (slot == SWAP_NONE)
+		return false;
+
+	disk_write_multiple (swap_disk, slot * SECTORS_PER_SLOT, page->frame->kva,
+			SECTORS_PER_SLOT);
+	lock_acquire (&swap_lock);
+	swap_pages[slot] = page;
+	lock_release (&swap_lock);
+	anon_page->slot = slot;
+	vm_count_event (page->owner, VM_SWAP_OUT);
+	return true;
 }
 
 /* Destroy the anonymous page. PAGE will be freed by the caller. */
 static void
 anon_destroy (struct page *page) {
 	struct anon_page *anon_page = &page->anon;
+
+	if (anon_page->zentry != NULL)
+		zswap_put (anon_page->zentry);
+	if (anon_page->slot != SWAP_NONE)
+		slot_put (anon_page->slot, page);
+	vm_free_frame (page);
+}
+
+/* Notes that PAGE, a copy of another page's struct, refers to the
+ * same swap slot or compressed copy, if any. */
+void
+anon_share (struct page *page) {
+	size_t slot = page->anon.slot;
+
+	if (page->anon.zentry != NULL)
+		zswap_get (page->anon.zentry);
+	if (slot != SWAP_NONE) {
+		lock_acquire (&swap_lock);
+		swap_refs[slot]++;
+		lock_release (&swap_lock);
+	}
+}
+
+/* Writes the page at KVA to a free swap slot of its own, for
+ * zswap.c.  Returns the slot, or SWAP_NONE if swap is full. */
+size_t
+swap_slot_write (const void *kva) {
+	size_t slot;
+
+	if (swap_disk == NULL)
+		return SWAP_NONE;
+	slot = slot_alloc (NULL);
+	if (slot != SWAP_NONE)
+		disk_write_multiple (swap_disk, slot * SECTORS_PER_SLOT, kva,
+				SECTORS_PER_SLOT);
+	return slot;
+}
+
+/* Reads swap slot SLOT into the page at KVA. */
+void
+swap_slot_read (size_t slot, void *kva) {
+	disk_read_multiple (swap_disk, slot * SECTORS_PER_SLOT, kva,
+			SECTORS_PER_SLOT);
+}
+
+/* Frees SLOT, which swap_slot_write() returned. */
+void
+swap_slot_free (size_t slot) {
+	slot_put (slot, NULL);
+}
+
+/* Allocates a swap slot for a page of the process whose table is
+ * SPT, or of no process if SPT is null: the slot after the one it
+ * got last if that is free, else the start of an empty cluster,
+ * else any free slot.  Returns SWAP_NONE if swap is full. */
+static size_t
+slot_alloc (struct supplemental_page_table *spt) {
+	size_t slot = spt != NULL ? spt->swap_next : SWAP_NONE;
+
+	lock_acquire (&swap_lock);
+	if (slot >= slot_cnt || slot % SWAP_CLUSTER == 0
+			|| bitmap_test (swap_map, slot)) {
+		size_t c;
+
+		slot = SWAP_NONE;
+		for (c = 0; c + SWAP_CLUSTER <= slot_cnt; c += SWAP_CLUSTER)
+			if (bitmap_none (swap_map, c, SWAP_CLUSTER)) {
+				slot = c;
+				break;
+			}
+		if (slot == SWAP_NONE)
+			slot = bitmap_scan (swap_map, 0, 1, false);
+	}
+	if (slot != SWAP_NONE) {
+		bitmap_mark (swap_map, slot);
+		swap_refs[slot] = 1;
+	}
+	lock_release (&swap_lock);
+
+	if (spt != NULL)
+		spt->swap_next = slot != SWAP_NONE ? slot + 1 : SWAP_NONE;
+	return slot;
+}
+
+/* Drops PAGE's reference to swap slot SLOT, freeing the slot if
+ * it was the last one. */
+static void
+slot_put (size_t slot, struct page *page) {
+	lock_acquire (&swap_lock);
+	ASSERT (bitmap_test (swap_map, slot));
+	ASSERT (swap_refs[slot] > 0);
+	if (--swap_refs[slot] == 0)
+		bitmap_reset (swap_map, slot);
+	if (swap_pages[slot] == page)
+		swap_pages[slot] = NULL;
+	lock_release (&swap_lock);
+}
+
+/* Brings in the pages in the slots after SLOT, which held PAGE, as
+ * long as they belong to the same area and memory is not short.
+ * The caller holds the lock of PAGE's table, so those pages stay
+ * put. */
+static void
+read_ahead (struct page *page, size_t slot) {
+	size_t n;
+
+	if (page->vma == NULL || page->vma->advice == MADV_RANDOM)
+		return;
+
+	for (n = slot + 1; n < slot_cnt && n <= slot + SWAP_READ_AHEAD; n++) {
+		struct page *next;
+
+		/* A page of another process may be freed as soon as the
+		 * lock is dropped, so compare while holding it. */
+		lock_acquire (&swap_lock);
+		next = swap_pages[n];
+		if (next != NULL && next->vma != page->vma)
+			next = NULL;
+		lock_release (&swap_lock);
+		if (next == NULL)
+			break;
+
+		next->anon.ahead = true;
+		if (!vm_prefetch_page (next)) {
+			next->anon.ahead = false;
+			break;
+		}
+	}
 }
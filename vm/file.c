@@ -1,10 +1,27 @@
 /* file.c: Implementation of memory backed file object (mmaped object). */
 
+#include <stdlib.h>
+#include <string.h>
 #include "vm/vm.h"
+#include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
 
 static bool file_backed_swap_in (struct page *page, void *kva);
 static bool file_backed_swap_out (struct page *page);
 static void file_backed_destroy (struct page *page);
+static bool page_dirty (struct page *);
+static int compare_offset (const void *, const void *);
+static size_t write_run (struct page **, size_t cnt, void *bounce);
+#ifdef EFILESYS
+static struct inode *cache_index (struct page *, size_t *idx);
+#endif
+
+/* Most pages written back with one request when an area goes
+ * away.  64 kB is 128 sectors, well under DISK_MAX_SECTORS. */
+#define WRITEBACK_RUN 16
 
 /* DO NOT MODIFY this struct */
 static const struct page_operations file_ops = {
@@ -21,38 +38,298 @@ vm_file_init (void) {
 
 /* Initialize the file backed page */
 bool
-file_backed_initializer (struct page *page, enum vm_type type, void *kva) {
+file_backed_initializer (struct page *page, enum vm_type type UNUSED,
+		void *kva) {
+	/* An initializer, if any, fills the page itself, so look before
+	 * the union is overwritten. */
+	bool load = page->uninit.init == NULL;
+	struct vma *vma = page->vma;
+	size_t page_ofs = (uint8_t *) page->va - (uint8_t *) vma->start;
+	struct file_page *file_page = &page->file;
+
+	ASSERT (vma != NULL && vma->file != NULL);
+
 	/* Set up the handler */
 	page->operations = &file_ops;
 
-	struct file_page *file_page = &page->file;
+	file_page->file = vma->file;
+	file_page->offset = vma->offset + page_ofs;
+	file_page->read_bytes = 0;
+	if (page_ofs < vma->read_bytes)
+		file_page->read_bytes = vma->read_bytes - page_ofs < PGSIZE
+			? vma->read_bytes - page_ofs : PGSIZE;
+
+	return load ? file_backed_swap_in (page, kva) : true;
 }
 
 /* Swap in the page by read contents from the file. */
 static bool
 file_backed_swap_in (struct page *page, void *kva) {
-	struct file_page *file_page UNUSED = &page->file;
+	struct file_page *file_page = &page->file;
+	off_t read;
+
+	/* A frame of the page cache is full already. */
+	if (vm_frame_cached (page->frame) != NULL)
+		return true;
+
+	read = file_read_at (file_page->file, kva, file_page->read_bytes,
+			file_page->offset);
+
+	/* Past the end of the file reads as zeros. */
+	if (read < 0)
+		return false;
+	memset ((uint8_t *) kva + read, 0, PGSIZE - read);
+
+	/* A copy of its own: from now on it is the process's. */
+	if (page->vma != NULL && (page->vma->type & VM_PRIVATE))
+		anon_adopt (page);
+	return true;
 }
 
 /* Swap out the page by writeback contents to the file. */
 static bool
 file_backed_swap_out (struct page *page) {
-	struct file_page *file_page UNUSED = &page->file;
+	struct file_page *file_page = &page->file;
+
+	/* Only what the file held is written back: a mapping never
+	 * makes the file longer. */
+	if (page_dirty (page)) {
+		vm_count_event (page->owner, VM_WRITEBACK);
+		return file_write_at (file_page->file, page->frame->kva,
+				file_page->read_bytes, file_page->offset)
+			== (off_t) file_page->read_bytes;
+	}
+	return true;
 }
 
 /* Destory the file backed page. PAGE will be freed by the caller. */
 static void
 file_backed_destroy (struct page *page) {
-	struct file_page *file_page UNUSED = &page->file;
+	if (page->frame == NULL)
+		return;
+
+	file_backed_swap_out (page);
+	vm_free_frame (page);
+}
+
+/* Writes back the modified resident pages of VMA, a file mapping
+ * whose table the caller has locked, before it goes away.  Clean
+ * pages cost nothing.  Dirty ones go in order of file offset, and
+ * pages that are next to each other in the file are written with
+ * one request, which the file system turns into multi-sector disk
+ * transfers.  Pages written are marked clean, so destroying them
+ * afterwards writes nothing more. */
+void
+file_backed_writeback (struct vma *vma) {
+	struct page **dirty;
+	struct list_elem *e;
+	void *bounce;
+	size_t cnt = 0;
+	size_t i;
+
+	for (e = list_begin (&vma->pages); e != list_end (&vma->pages);
+			e = list_next (e))
+		if (page_dirty (list_entry (e, struct page, vma_elem)))
+			cnt++;
+	if (cnt == 0)
+		return;
+
+	/* Short of memory, leave each page to write itself back when it
+	 * is destroyed. */
+	dirty = malloc (cnt * sizeof *dirty);
+	if (dirty == NULL)
+		return;
+	cnt = 0;
+	for (e = list_begin (&vma->pages); e != list_end (&vma->pages);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, vma_elem);
+		if (page_dirty (page))
+			dirty[cnt++] = page;
+	}
+	qsort (dirty, cnt, sizeof *dirty, compare_offset);
+
+	/* Without a bounce buffer every run is a single page, written
+	 * straight from its frame. */
+	bounce = cnt > 1 ? palloc_get_multiple (0, WRITEBACK_RUN) : NULL;
+	for (i = 0; i < cnt;)
+		i += write_run (dirty + i, cnt - i, bounce);
+	if (bounce != NULL)
+		palloc_free_multiple (bounce, WRITEBACK_RUN);
+	free (dirty);
+}
+
+/* Writes back the run of pages at the start of PAGES, CNT pages
+ * sorted by offset, that are consecutive in their file, as one
+ * write through BOUNCE, which holds WRITEBACK_RUN pages, or if
+ * BOUNCE is null, just the first page.  Returns the number of pages
+ * written. */
+static size_t
+write_run (struct page **pages, size_t cnt, void *bounce) {
+	struct file_page *first = &pages[0]->file;
+	size_t max = bounce != NULL ? WRITEBACK_RUN : 1;
+	size_t n, i;
+
+	for (n = 1; n < cnt && n < max; n++) {
+		struct file_page *prev = &pages[n - 1]->file;
+		if (prev->read_bytes != PGSIZE
+				|| pages[n]->file.offset != prev->offset + PGSIZE)
+			break;
+	}
+
+	if (n == 1)
+		file_write_at (first->file, pages[0]->frame->kva, first->read_bytes,
+				first->offset);
+	else {
+		for (i = 0; i < n; i++)
+			memcpy ((uint8_t *) bounce + i * PGSIZE, pages[i]->frame->kva,
+					pages[i]->file.read_bytes);
+		file_write_at (first->file, bounce,
+				(n - 1) * PGSIZE + pages[n - 1]->file.read_bytes, first->offset);
+	}
+
+	/* A page that failed to write would fail again on destroy. */
+	for (i = 0; i < n; i++) {
+		pml4_set_dirty (pages[i]->owner->pml4, pages[i]->va, false);
+		vm_count_event (pages[i]->owner, VM_WRITEBACK);
+	}
+	return n;
+}
+
+/* Returns true if PAGE is a resident file page whose process wrote
+ * to the part of it backed by the file, and which must write that
+ * back itself: the page cache writes back the frames it shares. */
+static bool
+page_dirty (struct page *page) {
+	return VM_TYPE (page->operations->type) == VM_FILE
+		&& page->frame != NULL && page->file.read_bytes > 0
+		&& pml4_is_dirty (page->owner->pml4, page->va)
+		&& vm_frame_cached (page->frame) == NULL;
+}
+
+#ifdef EFILESYS
+/* Returns the page cache page holding the contents of PAGE, a page
+ * of the current process, resident and pinned, or a null pointer if
+ * PAGE is not the part of a file on disk that the page cache could
+ * hold. */
+struct page *
+file_backed_cache_get (struct page *page) {
+	size_t idx;
+	struct inode *inode = cache_index (page, &idx);
+
+	return inode != NULL ? page_cache_get (inode, idx) : NULL;
+}
+
+/* Returns true if the page cache holds the contents of PAGE in
+ * memory, so that file_backed_cache_get() would not read the disk. */
+bool
+file_backed_cached (struct page *page) {
+	size_t idx;
+	struct inode *inode = cache_index (page, &idx);
+
+	return inode != NULL && page_cache_resident (inode, idx);
+}
+
+/* Returns the inode whose page *IDX the page cache would hold the
+ * contents of PAGE in, or a null pointer if it would not. */
+static struct inode *
+cache_index (struct page *page, size_t *idx) {
+	struct file *file;
+	struct inode *inode;
+	off_t offset;
+	size_t read_bytes;
+
+	if (page_get_type (page) != VM_FILE)
+		return NULL;
+	if (VM_TYPE (page->operations->type) == VM_UNINIT) {
+		struct vma *vma = page->vma;
+		size_t page_ofs = (uint8_t *) page->va - (uint8_t *) vma->start;
+
+		if (page->uninit.init != NULL || page_ofs >= vma->read_bytes)
+			return NULL;
+		file = vma->file;
+		offset = vma->offset + page_ofs;
+		read_bytes = vma->read_bytes - page_ofs < PGSIZE
+			? vma->read_bytes - page_ofs : PGSIZE;
+	} else {
+		if (page->file.read_bytes == 0)
+			return NULL;
+		file = page->file.file;
+		offset = page->file.offset;
+		read_bytes = page->file.read_bytes;
+	}
+
+	inode = file_get_inode (file);
+	if (inode == NULL || pg_ofs (offset) != 0)
+		return NULL;
+	/* A private area must see zeros past the part of the file it
+	 * maps, as in the last page of an ELF data segment, which runs
+	 * into the bss.  Only at the end of the file does the page cache
+	 * hold those. */
+	if ((page->vma->type & VM_PRIVATE) && read_bytes < PGSIZE
+			&& offset + (off_t) read_bytes < file_length (file))
+		return NULL;
+	*idx = offset / PGSIZE;
+	return inode;
+}
+#endif
+
+/* Orders pages, given as pointers to struct page pointers, by file
+ * offset. */
+static int
+compare_offset (const void *a_, const void *b_) {
+	const struct page *a = *(struct page * const *) a_;
+	const struct page *b = *(struct page * const *) b_;
+
+	return a->file.offset < b->file.offset ? -1
+		: a->file.offset > b->file.offset;
 }
 
-/* Do the mmap */
+/* Do the mmap.  With MAP_POPULATE in WRITABLE, the pages are
+ * loaded before returning instead of on first touch. */
 void *
 do_mmap (void *addr, size_t length, int writable,
 		struct file *file, off_t offset) {
+	bool populate = (writable & MAP_POPULATE) != 0;
+	off_t file_len;
+	struct file *mapped;
+	size_t read_bytes;
+
+	writable &= ~MAP_POPULATE;
+
+	if (addr == NULL || pg_ofs (addr) != 0 || length == 0
+			|| offset < 0 || pg_ofs (offset) != 0)
+		return NULL;
+
+	file_len = file_length (file);
+	if (file_len <= 0)
+		return NULL;
+	read_bytes = offset < file_len ? (size_t) (file_len - offset) : 0;
+	if (read_bytes > length)
+		read_bytes = length;
+
+	/* The mapping outlives the caller's descriptor. */
+	mapped = file_reopen (file);
+	if (mapped == NULL)
+		return NULL;
+	if (!vm_map (addr, length, VM_FILE, writable, mapped, offset, read_bytes,
+				NULL)) {
+		file_close (mapped);
+		return NULL;
+	}
+	if (populate)
+		vm_populate (addr, length);
+	return addr;
 }
 
 /* Do the munmap */
 void
 do_munmap (void *addr) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct vma *vma;
+
+	lock_acquire (&spt->lock);
+	vma = vma_find (&spt->vmas, addr);
+	if (vma != NULL && vma->start == addr && VM_TYPE (vma->type) == VM_FILE)
+		vm_unmap (spt, vma);
+	lock_release (&spt->lock);
 }
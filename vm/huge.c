@@ -0,0 +1,46 @@
+/* huge.c: Collapsing pages into huge pages.
+ *
+ * A process that first writes to a block of zeros as large and as
+ * aligned as a huge page gets a huge page for all of it at once.
+ * Blocks filled a page at a time, or brought back from swap, end up
+ * in as many frames as pages, each taking a TLB entry of its own.
+ * A low-priority kernel thread walks the frame table for the first
+ * page of such a block and, once every page of it is resident and
+ * its own, copies them into one huge page.
+ *
+ * A huge page is split again, in the page table only, as soon as one
+ * of its pages is mapped differently: written to after fork, merged,
+ * evicted or unmapped. */
+
+#include "vm/huge.h"
+#include "devices/timer.h"
+#include "threads/thread.h"
+#include "vm/vm.h"
+
+/* Frames looked at between naps, and how long each nap lasts. */
+#define HUGE_BATCH 64
+#define HUGE_NAP (TIMER_FREQ / 10)
+
+static void hugepaged (void *aux);
+
+/* Starts the collapsing thread. */
+void
+huge_init (void) {
+	thread_create ("hugepaged", PRI_MIN, hugepaged, NULL);
+}
+
+/* Collapsing thread.  Tries every frame in turn, napping between
+ * batches so that it costs little. */
+static void
+hugepaged (void *aux UNUSED) {
+	for (;;) {
+		struct frame *frame;
+		size_t i;
+
+		for (i = 0; (frame = vm_frame_at (i)) != NULL; i++) {
+			if (i % HUGE_BATCH == 0)
+				timer_sleep (HUGE_NAP);
+			vm_frame_collapse (frame);
+		}
+	}
+}
@@ -0,0 +1,130 @@
+/* ksm.c: Same-page merging.
+ *
+ * Processes often hold anonymous pages with the same contents:
+ * zeroed buffers, tables that each fork child builds alike.  A
+ * low-priority kernel thread walks the frame table, and whenever it
+ * finds two frames of anonymous pages with equal contents, moves the
+ * pages of one to the other, read-only, and frees the first.  A page
+ * that is written to later gets a copy of its own through the same
+ * write-protect fault that undoes sharing after fork.
+ *
+ * Pages that change all the time are not worth merging, since they
+ * would be copied again right away.  So a frame is only considered
+ * once its checksum is the same as in the previous pass.  Candidates
+ * go in a table by checksum, rebuilt every pass, in which a later
+ * frame with the same checksum finds them; vm_frame_merge() compares
+ * the actual contents. */
+
+#include "vm/ksm.h"
+#include <hash.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "vm/vm.h"
+
+/* Frames looked at between naps, and how long each nap lasts. */
+#define KSM_BATCH 32
+#define KSM_NAP (TIMER_FREQ / 10)
+
+/* A candidate frame and its checksum. */
+struct candidate {
+	uint64_t sum;
+	struct frame *frame;
+};
+
+static size_t frame_cnt;
+static uint64_t *sums;              /* Checksum of each frame last pass. */
+static struct candidate *table;     /* Open-addressed, by checksum. */
+static size_t table_mask;
+
+static size_t pages_merged;         /* Pages merged so far. */
+static size_t frames_saved;         /* Frames saved, as of last pass. */
+
+static void ksmd (void *aux);
+static size_t scan_frame (size_t idx);
+
+/* Starts the merging thread. */
+void
+ksm_init (void) {
+	size_t size = 1;
+
+	while (vm_frame_at (frame_cnt) != NULL)
+		frame_cnt++;
+	/* At most FRAME_CNT candidates: keep the table half empty. */
+	while (size < 2 * frame_cnt)
+		size *= 2;
+	table_mask = size - 1;
+	sums = calloc (frame_cnt, sizeof *sums);
+	table = calloc (size, sizeof *table);
+	if (sums == NULL || table == NULL)
+		PANIC ("same-page merging tables allocation failed");
+
+	thread_create ("ksmd", PRI_MIN, ksmd, NULL);
+}
+
+/* Prints merging statistics. */
+void
+ksm_print_stats (void) {
+	printf ("KSM: %zu pages merged, %zu bytes saved\n", pages_merged,
+			frames_saved * PGSIZE);
+}
+
+/* Merging thread.  Scans the frame table over and over, napping
+ * between batches so that it costs little even when nothing is
+ * running at a higher priority. */
+static void
+ksmd (void *aux UNUSED) {
+	for (;;) {
+		size_t saved = 0;
+		size_t i;
+
+		memset (table, 0, (table_mask + 1) * sizeof *table);
+		for (i = 0; i < frame_cnt; i++) {
+			if (i % KSM_BATCH == 0)
+				timer_sleep (KSM_NAP);
+			saved += scan_frame (i);
+		}
+		frames_saved = saved;
+	}
+}
+
+/* Looks at the frame at IDX: merges it with an earlier candidate of
+ * this pass if they are equal, or else makes it a candidate itself.
+ * Returns the frames it saves. */
+static size_t
+scan_frame (size_t idx) {
+	struct frame *frame = vm_frame_at (idx);
+	struct candidate *c;
+	size_t cnt, moved;
+	uint64_t sum;
+	bool merged;
+
+	cnt = vm_frame_anon_pages (frame, &merged);
+	if (cnt == 0) {
+		sums[idx] = 0;
+		return 0;
+	}
+
+	/* Read without locks: the merge compares again, safely. */
+	sum = hash_bytes (frame->kva, PGSIZE);
+	if (sum != sums[idx] && !merged) {
+		/* Changed since the last pass: likely to change again. */
+		sums[idx] = sum;
+		return 0;
+	}
+	sums[idx] = sum;
+
+	for (c = &table[sum & table_mask]; c->frame != NULL;
+			c = &table[(c - table + 1) & table_mask])
+		if (c->sum == sum && (moved = vm_frame_merge (c->frame, frame)) > 0) {
+			pages_merged += moved;
+			return moved;
+		}
+	c->sum = sum;
+	c->frame = frame;
+	return merged ? cnt - 1 : 0;
+}
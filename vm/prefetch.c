@@ -0,0 +1,151 @@
+/* prefetch.c: Loading pages in the background.
+ *
+ * Fault-around asks for pages it expects a process to touch soon
+ * but whose contents must come from disk.  A kernel thread loads
+ * them into free frames while the process runs on, so that the
+ * process finds them mapped instead of waiting on the disk in a
+ * fault of its own.  Requests are only hints: they are dropped when
+ * the queue is full, when memory is short, or when the page has
+ * been loaded in the meantime.
+ *
+ * A request whose process is busy with its page table, as it is
+ * while it faults and queues requests, is parked until that
+ * process lets go of it, rather than retried in a loop. */
+
+#include "vm/prefetch.h"
+#include <debug.h>
+#include <list.h>
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "vm/vm.h"
+
+/* Most requests waiting at once. */
+#define PREFETCH_MAX 256
+
+/* A page to load. */
+struct prefetch {
+	struct list_elem elem;      /* Element in queue. */
+	struct thread *owner;       /* Process to load it for. */
+	void *va;                   /* Its address there. */
+};
+
+static struct list queue;
+static struct list parked;       /* Requests whose owner was busy. */
+static size_t queue_len;         /* Requests in QUEUE and PARKED. */
+static struct lock queue_lock;
+static struct condition queue_nonempty;
+
+static void prefetchd (void *aux);
+static void drop_requests (struct list *, struct thread *owner);
+
+/* Starts the prefetch thread. */
+void
+prefetch_init (void) {
+	list_init (&queue);
+	list_init (&parked);
+	lock_init (&queue_lock);
+	cond_init (&queue_nonempty);
+	thread_create ("prefetchd", PRI_DEFAULT, prefetchd, NULL);
+}
+
+/* Asks for the page at VA in OWNER's address space to be loaded. */
+void
+prefetch_queue (struct thread *owner, void *va) {
+	struct prefetch *p = malloc (sizeof *p);
+
+	if (p == NULL)
+		return;
+	p->owner = owner;
+	p->va = va;
+
+	lock_acquire (&queue_lock);
+	if (queue_len < PREFETCH_MAX) {
+		list_push_back (&queue, &p->elem);
+		queue_len++;
+		cond_signal (&queue_nonempty, &queue_lock);
+		p = NULL;
+	}
+	lock_release (&queue_lock);
+	free (p);
+}
+
+/* Puts the requests parked because their owner was busy back in
+ * the queue.  Called by a process after it releases its page table
+ * lock, having maybe held it while the prefetch thread tried it. */
+void
+prefetch_retry (void) {
+	lock_acquire (&queue_lock);
+	if (!list_empty (&parked)) {
+		while (!list_empty (&parked))
+			list_push_back (&queue, list_pop_front (&parked));
+		cond_signal (&queue_nonempty, &queue_lock);
+	}
+	lock_release (&queue_lock);
+}
+
+/* Drops OWNER's requests.  OWNER must hold its page table lock,
+ * which the prefetch thread holds while it serves a request, so
+ * none is in progress either when this returns. */
+void
+prefetch_cancel (struct thread *owner) {
+	ASSERT (lock_held_by_current_thread (&owner->spt.lock));
+
+	lock_acquire (&queue_lock);
+	drop_requests (&queue, owner);
+	drop_requests (&parked, owner);
+	lock_release (&queue_lock);
+}
+
+/* Drops OWNER's requests in LIST.  The queue lock must be held. */
+static void
+drop_requests (struct list *list, struct thread *owner) {
+	struct list_elem *e;
+
+	for (e = list_begin (list); e != list_end (list);) {
+		struct prefetch *p = list_entry (e, struct prefetch, elem);
+
+		if (p->owner == owner) {
+			e = list_remove (e);
+			queue_len--;
+			free (p);
+		} else
+			e = list_next (e);
+	}
+}
+
+/* Serves requests in order.  The owner's page table is only tried,
+ * while the queue lock keeps the owner from cancelling: waiting for
+ * it there could deadlock with prefetch_cancel(), and after
+ * dropping the queue lock the owner might be gone. */
+static void
+prefetchd (void *aux UNUSED) {
+	lock_acquire (&queue_lock);
+	for (;;) {
+		struct prefetch *p;
+		struct page *page;
+
+		while (list_empty (&queue))
+			cond_wait (&queue_nonempty, &queue_lock);
+
+		p = list_entry (list_pop_front (&queue), struct prefetch, elem);
+		if (!lock_try_acquire (&p->owner->spt.lock)) {
+			/* Its owner is busy faulting: park it until the owner
+			 * calls prefetch_retry(). */
+			list_push_back (&parked, &p->elem);
+			continue;
+		}
+		queue_len--;
+		lock_release (&queue_lock);
+
+		/* Only pages with contents to load are queued, but this one
+		 * may have been loaded or dropped since. */
+		page = spt_find_page (&p->owner->spt, p->va);
+		if (page != NULL && page->frame == NULL)
+			vm_prefetch_page (page);
+		lock_release (&p->owner->spt.lock);
+		free (p);
+
+		lock_acquire (&queue_lock);
+	}
+}
@@ -1,8 +1,96 @@
 /* vm.c: Generic interface for virtual memory objects. */
 
+#include <round.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/vaddr.h"
 #include "vm/vm.h"
+#include "vm/huge.h"
 #include "vm/inspect.h"
+#include "vm/ksm.h"
+#include "vm/prefetch.h"
+
+/* Frame table: one entry for every page of the user pool.  Frames
+ * not holding any page are on FREE_FRAMES; the others are on one of
+ * the replacement lists below.
+ *
+ * FRAME_LOCK protects the table, but is never held across I/O: a
+ * frame being filled or evicted is pinned instead, so unrelated
+ * faults only contend for the short time it takes to pick a frame. */
+static struct frame *frames;
+static size_t frame_cnt;
+static struct list free_frames;
+static size_t free_cnt;
+static struct lock frame_lock;
+
+/* Replacement lists, least recently moved first.  A frame starts out
+ * on INACTIVE and moves to ACTIVE when it is found used twice in a
+ * row there; victims come from INACTIVE only.  So a page touched
+ * once, as in a scan through a large file, never pushes out pages
+ * that are used over and over.  ACTIVE frames not used since the
+ * last look go back to INACTIVE whenever it is below its target. */
+static struct list active_frames;
+static struct list inactive_frames;
+static size_t active_cnt;
+static size_t inactive_cnt;
+static size_t inactive_target;
+
+/* Ghosts: the pages evicted most recently, at most FRAME_CNT of
+ * them, by owner and address.  A page faulted back in while it is
+ * still a ghost would have stayed resident had its list been larger,
+ * so the inactive target grows if it was evicted without ever being
+ * active, and shrinks if it had been, in the manner of ARC.  Owners
+ * are only compared, never followed, so ghosts may outlive them. */
+struct ghost {
+	struct hash_elem elem;      /* Element in ghosts. */
+	struct list_elem list_elem; /* Element in ghost_list. */
+	struct thread *owner;
+	void *va;
+	bool demoted;               /* Was it on the active list? */
+};
+static struct hash ghosts;
+static struct list ghost_list;      /* Oldest first. */
+static size_t ghost_cnt[2];         /* Ghosts by DEMOTED. */
+
+/* The swap daemon keeps between FREE_LOW and 2 * FREE_LOW frames
+ * free by evicting up to EVICT_BATCH frames at a time, so that a
+ * fault rarely has to wait for a page to be written out. */
+#define EVICT_BATCH 16
+static size_t free_low;
+static struct semaphore swapd_wake;
+static bool swapd_awake;
+
+static void frame_table_init (void);
+static void swapd (void *aux);
+
+/* Largest size of a user stack, in bytes. */
+size_t vm_stack_max = 1 << 20;
+
+/* Most memory a process may lock with mlock(), in bytes.  However
+ * many processes lock memory, half the frames stay evictable:
+ * LOCKED_CNT counts the locked pages, under FRAME_LOCK. */
+size_t vm_mlock_max = 1 << 20;
+static size_t locked_cnt;
+
+/* The stack grows by twice as many pages each time, up to this many,
+ * so that a deep recursion takes a few faults instead of one for
+ * every page. */
+#define STACK_GROW_MAX 32
+
+/* Paging events of all processes, by enum vm_event. */
+static size_t sys_events[VM_EVENT_CNT];
+
+/* Pages in a huge page. */
+#define HUGE_PAGE_CNT (HUGE_PGSIZE / PGSIZE)
+
+/* A page of zeros, mapped read-only wherever a process reads
+ * anonymous memory it has never written.  It lives in the kernel
+ * pool, outside the frame table, and is never freed. */
+static void *zero_page;
 
 /* Initializes the virtual memory subsystem by invoking each subsystem's
  * intialize codes. */
@@ -15,7 +103,13 @@ vm_init (void) {
 #endif
 	register_inspect_intr ();
 	/* DO NOT MODIFY UPPER LINES. */
-	/* TODO: Your code goes here. */
+	frame_table_init ();
+	zero_page = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+	sema_init (&swapd_wake, 0);
+	thread_create ("swapd", PRI_DEFAULT, swapd, NULL);
+	prefetch_init ();
+	ksm_init ();
+	huge_init ();
 }
 
 /* Get the type of the page. This function is useful if you want to know the
@@ -36,6 +130,70 @@ page_get_type (struct page *page) {
 static struct frame *vm_get_victim (void);
 static bool vm_do_claim_page (struct page *page);
 static struct frame *vm_evict_frame (void);
+static bool frame_claim (struct page *, struct frame *);
+static void frame_write_out (struct frame *);
+static void frame_release (struct frame *);
+static void frame_free (struct frame *);
+static bool frame_accessed (struct frame *);
+static bool frame_dirty (struct frame *);
+static void lru_move (struct frame *, struct list *);
+static void lru_refill (void);
+static void ghost_add (struct page *, bool demoted);
+static void ghost_refault (struct page *);
+static uint64_t ghost_hash (const struct hash_elem *, void *);
+static bool ghost_less (const struct hash_elem *, const struct hash_elem *,
+		void *);
+static bool frame_anon (struct frame *);
+static bool lock_owners (struct frame *, struct frame *except);
+static void unlock_owners (struct frame *, struct list_elem *end,
+		struct frame *except);
+static bool owner_seen (struct frame *, struct page *);
+static bool owner_maps (struct frame *, struct thread *);
+static void frame_unlink (struct page *);
+static struct page *frame_cache_page (struct frame *);
+#ifdef EFILESYS
+static bool frame_attach_cached (struct page *);
+#endif
+static bool stack_access (void *addr, void *rsp);
+static bool vm_stack_growth (void *addr);
+static struct frame *huge_alloc (void);
+static bool huge_claim (struct page *);
+static bool huge_collapse (struct supplemental_page_table *, uint8_t *base);
+static bool page_is_zero (struct page *);
+static bool range_mapped (struct supplemental_page_table *, void *start,
+		void *end);
+static unsigned char page_state (struct page *);
+static bool page_swapped (struct page *);
+static bool page_needs_io (struct page *);
+static void events_copy (struct vmevents *, const size_t *events);
+static bool page_lock (struct page *);
+static void page_unlock (struct page *);
+static bool page_fault_in (struct page *);
+static bool frame_locked (struct frame *);
+static bool page_from_file (struct page *);
+static void fault_around (struct page *);
+static void drop_behind (struct page *);
+static void will_need (struct supplemental_page_table *, struct vma *,
+		uint8_t *start, uint8_t *end);
+static void dont_need (struct supplemental_page_table *, struct vma *,
+		uint8_t *start, uint8_t *end);
+static struct page *spt_lookup (struct supplemental_page_table *, void *va);
+static struct thread *spt_owner (struct supplemental_page_table *);
+static bool page_maps_zero (struct page *);
+static bool vm_handle_wp (struct page *);
+static struct page *page_create (struct supplemental_page_table *,
+		struct vma *, void *va);
+static bool (*type_initializer (enum vm_type)) (struct page *, enum vm_type,
+		void *);
+static bool spt_copy (struct supplemental_page_table *,
+		struct supplemental_page_table *);
+static bool page_share (struct supplemental_page_table *, struct page *);
+static bool page_unshare (struct page *);
+static bool page_map (struct page *, bool writable);
+static uint64_t page_hash (const struct hash_elem *, void *);
+static bool page_less (const struct hash_elem *, const struct hash_elem *,
+		void *);
+static void page_destructor (struct hash_elem *, void *);
 
 /* Create the pending page object with initializer. If you want to create a
  * page, do not create it directly and make it through this function or
@@ -50,58 +208,817 @@ vm_alloc_page_with_initializer (enum vm_type type, void *upage, bool writable,
 
 	/* Check wheter the upage is already occupied or not. */
 	if (spt_find_page (spt, upage) == NULL) {
-		/* TODO: Create the page, fetch the initialier according to the VM type,
-		 * TODO: and then create "uninit" page struct by calling uninit_new. You
-		 * TODO: should modify the field after calling the uninit_new. */
+		struct page *page = malloc (sizeof *page);
+		if (page == NULL)
+			goto err;
+		uninit_new (page, pg_round_down (upage), init, type, aux,
+				type_initializer (type));
+		page->owner = thread_current ();
+		page->writable = writable;
+		page->vma = NULL;
+		page->locked = false;
+		page->around = false;
 
-		/* TODO: Insert the page into the spt. */
+		if (!spt_insert_page (spt, page)) {
+			free (page);
+			goto err;
+		}
+		return true;
 	}
 err:
 	return false;
 }
 
-/* Find VA from spt and return page. On error, return NULL. */
+/* Maps LENGTH bytes of pages from START into the current process as
+ * a single area of TYPE.  Pages are filled on first touch: READ_BYTES
+ * bytes come from FILE at OFFSET, through INIT if it is given, and
+ * the rest are zeros.  The area takes ownership of FILE on success.
+ * Fails if the range is not page-aligned user memory or overlaps
+ * an existing area. */
+bool
+vm_map (void *start, size_t length, enum vm_type type, bool writable,
+		struct file *file, off_t offset, size_t read_bytes,
+		vm_initializer *init) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	void *end = (uint8_t *) start + ROUND_UP (length, PGSIZE);
+	struct vma *vma;
+	bool success;
+
+	if (pg_ofs (start) != 0 || length == 0 || end <= start
+			|| !is_user_vaddr (start) || !is_user_vaddr ((uint8_t *) end - 1))
+		return false;
+
+	vma = vma_create (start, end, type, writable, file, offset, read_bytes,
+			init);
+	if (vma == NULL)
+		return false;
+	lock_acquire (&spt->lock);
+	success = vma_insert (&spt->vmas, vma);
+	lock_release (&spt->lock);
+	if (!success) {
+		vma->file = NULL;
+		vma_destroy (vma);
+	}
+	return success;
+}
+
+/* Returns true if ADDR lies in an area of the current process,
+ * whether or not its page has been touched. */
+bool
+vm_is_mapped (void *addr) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	bool mapped;
+
+	lock_acquire (&spt->lock);
+	mapped = vma_find (&spt->vmas, addr) != NULL;
+	lock_release (&spt->lock);
+	return mapped;
+}
+
+/* Removes area VMA and all its pages from SPT, writing back what
+ * needs to be written back. */
+void
+vm_unmap (struct supplemental_page_table *spt, struct vma *vma) {
+	if (VM_TYPE (vma->type) == VM_FILE)
+		file_backed_writeback (vma);
+	while (!list_empty (&vma->pages)) {
+		struct page *page = list_entry (list_front (&vma->pages),
+				struct page, vma_elem);
+		spt_remove_page (spt, page);
+	}
+	vma_remove (&spt->vmas, vma);
+	vma_destroy (vma);
+}
+
+/* Loads every page of START...START + LENGTH in the current process
+ * that is not resident yet, so that touching them will not fault.
+ * Stops early if a page cannot be loaded; the rest then load on
+ * first touch as usual. */
+void
+vm_populate (void *start, size_t length) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	uint8_t *end = (uint8_t *) start + ROUND_UP (length, PGSIZE);
+	uint8_t *va;
+
+	lock_acquire (&spt->lock);
+	for (va = start; va < end; va += PGSIZE) {
+		struct page *page = spt_find_page (spt, va);
+
+		if (page == NULL || (page->frame == NULL && !vm_do_claim_page (page)))
+			break;
+	}
+	lock_release (&spt->lock);
+}
+
+/* Takes ADVICE, one of the MADV_* values, on how the current
+ * process will use START...START + LENGTH.  The access-pattern
+ * advice applies to each area the range touches as a whole; areas
+ * are not split.  Returns false if START is not page-aligned, if
+ * ADVICE is unknown, or if part of the range is not mapped. */
+bool
+vm_advise (void *start, size_t length, int advice) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	uint8_t *end = (uint8_t *) start + ROUND_UP (length, PGSIZE);
+	struct vma *vma;
+
+	if (pg_ofs (start) != 0 || end < (uint8_t *) start
+			|| advice < MADV_NORMAL || advice > MADV_DONTNEED)
+		return false;
+
+	lock_acquire (&spt->lock);
+	if (!range_mapped (spt, start, end)) {
+		lock_release (&spt->lock);
+		return false;
+	}
+
+	for (vma = vma_lower_bound (&spt->vmas, start);
+			vma != NULL && (uint8_t *) vma->start < end;
+			vma = vma_next (&spt->vmas, vma)) {
+		uint8_t *lo = (uint8_t *) start > (uint8_t *) vma->start
+			? (uint8_t *) start : (uint8_t *) vma->start;
+		uint8_t *hi = end < (uint8_t *) vma->end ? end : (uint8_t *) vma->end;
+
+		switch (advice) {
+			case MADV_WILLNEED:
+				will_need (spt, vma, lo, hi);
+				break;
+			case MADV_DONTNEED:
+				dont_need (spt, vma, lo, hi);
+				break;
+			default:
+				vma->advice = advice;
+				vma->ra_window = 0;
+				break;
+		}
+	}
+	lock_release (&spt->lock);
+	prefetch_retry ();
+	return true;
+}
+
+/* Returns true if every page of START...END lies in an area of
+ * SPT. */
+static bool
+range_mapped (struct supplemental_page_table *spt, void *start, void *end) {
+	struct vma *vma;
+	uint8_t *va;
+
+	for (va = start; va < (uint8_t *) end; va = vma->end)
+		if ((vma = vma_find (&spt->vmas, va)) == NULL)
+			return false;
+	return true;
+}
+
+/* Stores in VEC, one byte for each page of START...START + LENGTH
+ * in the current process, the MINCORE_* bits that describe it.
+ * Returns false if START is not page-aligned or part of the range
+ * is not mapped. */
+bool
+vm_mincore (void *start, size_t length, unsigned char *vec) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	uint8_t *end = (uint8_t *) start + ROUND_UP (length, PGSIZE);
+	uint8_t *va;
+
+	if (pg_ofs (start) != 0 || end < (uint8_t *) start)
+		return false;
+
+	lock_acquire (&spt->lock);
+	if (!range_mapped (spt, start, end)) {
+		lock_release (&spt->lock);
+		return false;
+	}
+	for (va = start; va < end; va += PGSIZE)
+		*vec++ = page_state (spt_lookup (spt, va));
+	lock_release (&spt->lock);
+	return true;
+}
+
+/* Returns the MINCORE_* bits for PAGE, which may be a null pointer
+ * for a page never touched. */
+static unsigned char
+page_state (struct page *page) {
+	unsigned char state = 0;
+
+	if (page == NULL)
+		return 0;
+	if (page->frame != NULL) {
+		state |= MINCORE_RESIDENT;
+		if (pml4_is_dirty (page->owner->pml4, page->va))
+			state |= MINCORE_DIRTY;
+		if (pml4_is_accessed (page->owner->pml4, page->va))
+			state |= MINCORE_ACCESSED;
+	} else if (page_swapped (page))
+		state |= MINCORE_SWAPPED;
+	if (page->locked)
+		state |= MINCORE_LOCKED;
+	return state;
+}
+
+/* Returns true if PAGE, which has no frame, has contents in swap,
+ * on disk or compressed. */
+static bool
+page_swapped (struct page *page) {
+	return VM_TYPE (page->operations->type) == VM_ANON
+		&& (page->anon.slot != SWAP_NONE || page->anon.zentry != NULL);
+}
+
+/* Returns true if loading PAGE, which has no frame, has to read
+ * the disk: swap, or a file on disk whose page the page cache does
+ * not hold. */
+static bool
+page_needs_io (struct page *page) {
+	enum vm_type type = VM_TYPE (page->operations->type);
+
+	if (type == VM_ANON)
+		return page->anon.slot != SWAP_NONE && page->anon.zentry == NULL;
+	if (!page_from_file (page)
+			&& !(type == VM_FILE && page->file.read_bytes > 0))
+		return false;
+	if (file_get_inode (page->vma->file) == NULL)
+		return false;
+#ifdef EFILESYS
+	return !file_backed_cached (page);
+#else
+	return true;
+#endif
+}
+
+/* Locks the pages of START...START + LENGTH in the current process
+ * into memory: loads them and keeps them there until munlock() or
+ * until they are unmapped.  Writable pages also get a frame of their
+ * own, so that writing to them will not fault either.  Returns false
+ * if START is not page-aligned, if part of the range is not mapped,
+ * or if locking it would exceed the limit; or, having locked some
+ * pages, if memory runs out. */
+bool
+vm_mlock (void *start, size_t length) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	uint8_t *end = (uint8_t *) start + ROUND_UP (length, PGSIZE);
+	size_t cnt = 0;
+	bool success = true;
+	uint8_t *va;
+
+	if (pg_ofs (start) != 0 || end < (uint8_t *) start)
+		return false;
+
+	lock_acquire (&spt->lock);
+	if (!range_mapped (spt, start, end)) {
+		lock_release (&spt->lock);
+		return false;
+	}
+	for (va = start; va < end; va += PGSIZE) {
+		struct page *page = spt_lookup (spt, va);
+
+		if (page == NULL || !page->locked)
+			cnt++;
+	}
+
+	lock_acquire (&frame_lock);
+	if ((spt->locked + cnt) * PGSIZE > vm_mlock_max
+			|| locked_cnt + cnt > frame_cnt / 2)
+		success = false;
+	lock_release (&frame_lock);
+
+	for (va = start; success && va < end; va += PGSIZE) {
+		struct page *page = spt_find_page (spt, va);
+
+		success = page != NULL && page_lock (page) && page_fault_in (page);
+	}
+	lock_release (&spt->lock);
+	return success;
+}
+
+/* Unlocks the pages of START...START + LENGTH in the current
+ * process, so that they may be evicted again.  Returns false if
+ * START is not page-aligned or part of the range is not mapped. */
+bool
+vm_munlock (void *start, size_t length) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	uint8_t *end = (uint8_t *) start + ROUND_UP (length, PGSIZE);
+	uint8_t *va;
+
+	if (pg_ofs (start) != 0 || end < (uint8_t *) start)
+		return false;
+
+	lock_acquire (&spt->lock);
+	if (!range_mapped (spt, start, end)) {
+		lock_release (&spt->lock);
+		return false;
+	}
+	for (va = start; va < end; va += PGSIZE) {
+		struct page *page = spt_lookup (spt, va);
+
+		if (page != NULL)
+			page_unlock (page);
+	}
+	lock_release (&spt->lock);
+	return true;
+}
+
+/* Locks every page of the current process into memory, as
+ * vm_mlock() does: with MCL_CURRENT in FLAGS those of every area
+ * now, with MCL_FUTURE those made from now on, from their first
+ * touch.  Returns false if FLAGS is not valid or the limit is
+ * reached; pages locked so far stay locked. */
+bool
+vm_mlockall (int flags) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct vma *vma;
+	bool success = true;
+
+	if (flags == 0 || (flags & ~(MCL_CURRENT | MCL_FUTURE)) != 0)
+		return false;
+
+	lock_acquire (&spt->lock);
+	spt->lock_future = (flags & MCL_FUTURE) != 0;
+	if (flags & MCL_CURRENT)
+		for (vma = vma_first (&spt->vmas); success && vma != NULL;
+				vma = vma_next (&spt->vmas, vma)) {
+			uint8_t *va;
+
+			for (va = vma->start; success && va < (uint8_t *) vma->end;
+					va += PGSIZE) {
+				struct page *page = spt_find_page (spt, va);
+
+				success = page != NULL && page_lock (page)
+					&& page_fault_in (page);
+			}
+		}
+	lock_release (&spt->lock);
+	return success;
+}
+
+/* Unlocks every page of the current process and stops locking new
+ * ones. */
+void
+vm_munlockall (void) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct hash_iterator i;
+
+	lock_acquire (&spt->lock);
+	spt->lock_future = false;
+	hash_first (&i, &spt->pages);
+	while (hash_next (&i))
+		page_unlock (hash_entry (hash_cur (&i), struct page, spt_elem));
+	lock_release (&spt->lock);
+}
+
+/* Locks PAGE, of the current process, into memory, if the limits
+ * allow it.  The caller loads it.  Returns false if they do not. */
+static bool
+page_lock (struct page *page) {
+	struct supplemental_page_table *spt = &page->owner->spt;
+	bool success = true;
+
+	if (page->locked)
+		return true;
+
+	lock_acquire (&frame_lock);
+	if ((spt->locked + 1) * PGSIZE > vm_mlock_max
+			|| locked_cnt + 1 > frame_cnt / 2)
+		success = false;
+	else {
+		page->locked = true;
+		spt->locked++;
+		locked_cnt++;
+	}
+	lock_release (&frame_lock);
+	return success;
+}
+
+/* Unlocks PAGE.  Its frame goes back on the replacement lists, if
+ * vm_get_victim() took it off them and no other locked page keeps
+ * it there. */
+static void
+page_unlock (struct page *page) {
+	struct frame *frame = page->frame;
+
+	if (!page->locked)
+		return;
+
+	lock_acquire (&frame_lock);
+	page->locked = false;
+	page->owner->spt.locked--;
+	locked_cnt--;
+	if (frame != NULL && frame->lru == NULL && !frame->pinned
+			&& !frame_locked (frame))
+		lru_move (frame, &inactive_frames);
+	lock_release (&frame_lock);
+}
+
+/* Loads PAGE, of the current process, if it is not resident, and
+ * gives it a frame of its own if it is writable, as faults reading
+ * and writing it would.  Returns false if memory runs out. */
+static bool
+page_fault_in (struct page *page) {
+	if (page->frame == NULL && !page_maps_zero (page)
+			&& !vm_do_claim_page (page))
+		return false;
+	return !page->writable || vm_handle_wp (page);
+}
+
+/* Returns true if a page on FRAME is locked, so that it may not be
+ * evicted. */
+static bool
+frame_locked (struct frame *frame) {
+	struct list_elem *e;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e))
+		if (list_entry (e, struct page, frame_elem)->locked)
+			return true;
+	return false;
+}
+
+/* Find VA from spt and return page. On error, return NULL.
+ * A page inside an area that has not been touched yet gets its
+ * struct page here. */
 struct page *
-spt_find_page (struct supplemental_page_table *spt UNUSED, void *va UNUSED) {
-	struct page *page = NULL;
-	/* TODO: Fill this function. */
+spt_find_page (struct supplemental_page_table *spt, void *va) {
+	struct page *page;
+	struct vma *vma;
 
-	return page;
+	va = pg_round_down (va);
+	page = spt_lookup (spt, va);
+	if (page != NULL)
+		return page;
+
+	vma = vma_find (&spt->vmas, va);
+	return vma != NULL ? page_create (spt, vma, va) : NULL;
+}
+
+/* Returns the page of SPT at VA, a page address, if it has been
+ * touched, or a null pointer.  Unlike spt_find_page(), never makes
+ * a page. */
+static struct page *
+spt_lookup (struct supplemental_page_table *spt, void *va) {
+	struct page key;
+	struct hash_elem *e;
+
+	key.va = va;
+	e = hash_find (&spt->pages, &key.spt_elem);
+	return e != NULL ? hash_entry (e, struct page, spt_elem) : NULL;
 }
 
 /* Insert PAGE into spt with validation. */
 bool
-spt_insert_page (struct supplemental_page_table *spt UNUSED,
-		struct page *page UNUSED) {
-	int succ = false;
-	/* TODO: Fill this function. */
+spt_insert_page (struct supplemental_page_table *spt, struct page *page) {
+	ASSERT (pg_ofs (page->va) == 0);
 
-	return succ;
+	if (hash_insert (&spt->pages, &page->spt_elem) != NULL)
+		return false;
+	if (page->vma != NULL)
+		list_push_back (&page->vma->pages, &page->vma_elem);
+	return true;
 }
 
 void
 spt_remove_page (struct supplemental_page_table *spt, struct page *page) {
+	page_unlock (page);
+	hash_delete (&spt->pages, &page->spt_elem);
+	if (page->vma != NULL)
+		list_remove (&page->vma_elem);
 	vm_dealloc_page (page);
-	return true;
+}
+
+/* Makes the struct page for VA, which lies in VMA, and adds it to
+ * SPT.  Returns a null pointer if memory is exhausted. */
+static struct page *
+page_create (struct supplemental_page_table *spt, struct vma *vma,
+		void *va) {
+	struct page *page = malloc (sizeof *page);
+	if (page == NULL)
+		return NULL;
+
+	uninit_new (page, va, vma->init, vma->type, vma,
+			type_initializer (vma->type));
+	page->owner = spt_owner (spt);
+	page->writable = vma->writable;
+	page->vma = vma;
+	page->locked = false;
+	page->around = false;
+	if (!spt_insert_page (spt, page)) {
+		free (page);
+		return NULL;
+	}
+	/* Under mlockall(MCL_FUTURE), the fault that made it loads it. */
+	if (spt->lock_future)
+		page_lock (page);
+	return page;
+}
+
+/* Returns the process that SPT belongs to. */
+static struct thread *
+spt_owner (struct supplemental_page_table *spt) {
+	return (struct thread *) ((uint8_t *) spt - offsetof (struct thread, spt));
+}
+
+/* Returns the function that turns an uninit page into a page of
+ * TYPE. */
+static bool
+(*type_initializer (enum vm_type type)) (struct page *, enum vm_type, void *) {
+	switch (VM_TYPE (type)) {
+		case VM_ANON:
+			return anon_initializer;
+		case VM_FILE:
+			return file_backed_initializer;
+		default:
+			PANIC ("no initializer for page type %d", VM_TYPE (type));
+	}
 }
 
 /* Get the struct frame, that will be evicted. */
 static struct frame *
 vm_get_victim (void) {
 	struct frame *victim = NULL;
-	 /* TODO: The policy for eviction is up to you. */
+	struct frame *dirty = NULL;
+	size_t i, scan;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	lru_refill ();
+
+	/* A frame used once since it was loaded gets a second chance on
+	 * this list; used again, it is promoted.  Two rounds thus leave
+	 * only frames not used lately.  Writing a page out is slow, so
+	 * the first clean candidate wins and a dirty one is taken only
+	 * if there is none. */
+	scan = 2 * inactive_cnt;
+	for (i = 0; i < scan && victim == NULL && inactive_cnt > 0; i++) {
+		struct frame *frame = list_entry (list_front (&inactive_frames),
+				struct frame, lru_elem);
+
+		/* To the back, whatever becomes of it. */
+		list_push_back (&inactive_frames, list_pop_front (&inactive_frames));
+		if (frame->pinned)
+			continue;
+		if (frame_locked (frame)) {
+			/* Off the lists until munlock(). */
+			lru_move (frame, NULL);
+			continue;
+		}
+		if (frame_accessed (frame)) {
+			if (frame->referenced)
+				lru_move (frame, &active_frames);
+			else
+				frame->referenced = true;
+			continue;
+		}
+		if (frame_dirty (frame)) {
+			if (dirty == NULL)
+				dirty = frame;
+		} else if (lock_owners (frame, NULL))
+			victim = frame;
+	}
+	if (victim == NULL && dirty != NULL && dirty->lru == &inactive_frames
+			&& lock_owners (dirty, NULL))
+		victim = dirty;
 
+	if (victim != NULL) {
+		victim->pinned = true;
+		lru_move (victim, NULL);
+	}
 	return victim;
 }
 
+/* Moves frames not used lately from the front of the active list to
+ * the inactive list, until that reaches its target.  Used frames go
+ * round once more instead.  If every active frame was used and the
+ * inactive list is empty, the least recent is moved anyway. */
+static void
+lru_refill (void) {
+	size_t scan = active_cnt;
+	size_t i;
+
+	for (i = 0; i < scan && inactive_cnt < inactive_target; i++) {
+		struct frame *frame = list_entry (list_front (&active_frames),
+				struct frame, lru_elem);
+
+		if (frame_accessed (frame))
+			list_push_back (&active_frames, list_pop_front (&active_frames));
+		else
+			lru_move (frame, &inactive_frames);
+	}
+	if (inactive_cnt == 0 && active_cnt > 0)
+		lru_move (list_entry (list_front (&active_frames), struct frame,
+					lru_elem), &inactive_frames);
+}
+
+/* Moves FRAME to the back of LRU, one of the replacement lists, or
+ * takes it off them if LRU is null. */
+static void
+lru_move (struct frame *frame, struct list *lru) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	if (frame->lru == &active_frames)
+		active_cnt--;
+	else if (frame->lru == &inactive_frames)
+		inactive_cnt--;
+	if (frame->lru != NULL)
+		list_remove (&frame->lru_elem);
+
+	frame->demoted = lru == &inactive_frames && frame->lru == &active_frames;
+	frame->referenced = false;
+	frame->lru = lru;
+	if (lru == &active_frames)
+		active_cnt++;
+	else if (lru == &inactive_frames)
+		inactive_cnt++;
+	if (lru != NULL)
+		list_push_back (lru, &frame->lru_elem);
+}
+
+/* Remembers PAGE, which is being evicted from a frame that was
+ * DEMOTED from the active list or not, as a ghost.  The oldest
+ * ghost makes room if there are too many. */
+static void
+ghost_add (struct page *page, bool demoted) {
+	struct ghost *g;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	if (ghost_cnt[0] + ghost_cnt[1] >= frame_cnt) {
+		g = list_entry (list_pop_front (&ghost_list), struct ghost, list_elem);
+		hash_delete (&ghosts, &g->elem);
+		ghost_cnt[g->demoted]--;
+	} else if ((g = malloc (sizeof *g)) == NULL)
+		return;
+
+	g->owner = page->owner;
+	g->va = page->va;
+	g->demoted = demoted;
+	if (hash_insert (&ghosts, &g->elem) != NULL) {
+		/* Shared with a page of the same owner and address: only
+		 * possible after the owner went away. */
+		free (g);
+		return;
+	}
+	list_push_back (&ghost_list, &g->list_elem);
+	ghost_cnt[demoted]++;
+}
+
+/* Notes that PAGE is being loaded.  If it was evicted recently,
+ * resizes the inactive list in favor of the list it was evicted
+ * from, by more the fewer ghosts that list has. */
+static void
+ghost_refault (struct page *page) {
+	struct ghost key, *g;
+	struct hash_elem *e;
+	size_t delta, max = frame_cnt - frame_cnt / 8;
+
+	key.owner = page->owner;
+	key.va = page->va;
+
+	lock_acquire (&frame_lock);
+	e = hash_delete (&ghosts, &key.elem);
+	if (e != NULL) {
+		g = hash_entry (e, struct ghost, elem);
+		list_remove (&g->list_elem);
+		ghost_cnt[g->demoted]--;
+		delta = ghost_cnt[!g->demoted] / (ghost_cnt[g->demoted] + 1) + 1;
+		if (!g->demoted)
+			inactive_target = inactive_target + delta < max
+				? inactive_target + delta : max;
+		else
+			inactive_target = inactive_target > frame_cnt / 8 + delta
+				? inactive_target - delta : frame_cnt / 8;
+		page->owner->spt.refaults++;
+		free (g);
+	}
+	lock_release (&frame_lock);
+}
+
 /* Evict one page and return the corresponding frame.
  * Return NULL on error.*/
 static struct frame *
 vm_evict_frame (void) {
-	struct frame *victim UNUSED = vm_get_victim ();
-	/* TODO: swap out the victim and return the evicted frame. */
+	struct frame *victim;
 
-	return NULL;
+	lock_acquire (&frame_lock);
+	while ((victim = vm_get_victim ()) == NULL) {
+		/* Every frame is pinned or its owner is busy faulting.
+		 * Let them finish. */
+		lock_release (&frame_lock);
+		thread_yield ();
+		lock_acquire (&frame_lock);
+	}
+	lock_release (&frame_lock);
+
+	frame_write_out (victim);
+	frame_release (victim);
+	return victim;
+}
+
+/* Writes out the pages of VICTIM, which vm_get_victim() picked.
+ * The victim is pinned and its owners locked, so its pages cannot
+ * change under us.  All are unmapped first so that nothing writes
+ * to the frame meanwhile: a page may write out what others wrote,
+ * as the page cache does. */
+static void
+frame_write_out (struct frame *victim) {
+	struct list_elem *e;
+
+	for (e = list_begin (&victim->pages); e != list_end (&victim->pages);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, frame_elem);
+		pml4_clear_page (page->owner->pml4, page->va);
+	}
+	for (e = list_begin (&victim->pages); e != list_end (&victim->pages);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, frame_elem);
+		if (!swap_out (page))
+			PANIC ("cannot evict page at %p", page->va);
+		vm_count_event (page->owner, VM_EVICTION);
+	}
+}
+
+/* Detaches the written-out pages of VICTIM and unlocks their
+ * owners.  VICTIM stays pinned for its next use. */
+static void
+frame_release (struct frame *victim) {
+	lock_acquire (&frame_lock);
+	unlock_owners (victim, list_end (&victim->pages), NULL);
+	while (!list_empty (&victim->pages)) {
+		struct page *page = list_entry (list_front (&victim->pages),
+				struct page, frame_elem);
+
+		ghost_add (page, victim->demoted);
+		frame_unlink (page);
+	}
+	lock_release (&frame_lock);
+}
+
+/* Puts FRAME, which holds no page, on the free list. */
+static void
+frame_free (struct frame *frame) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+	ASSERT (list_empty (&frame->pages));
+
+	frame->pinned = false;
+	frame->merged = false;
+	lru_move (frame, NULL);
+	list_push_back (&free_frames, &frame->elem);
+	free_cnt++;
+}
+
+/* Returns the owner of the first page of FRAME, by which victims
+ * are grouped. */
+static struct thread *
+frame_owner (struct frame *frame) {
+	return list_entry (list_front (&frame->pages), struct page,
+			frame_elem)->owner;
+}
+
+/* Swap daemon.  Woken when free frames run low, it evicts frames in
+ * batches until there are enough again.  Victims of one process are
+ * written out together, so that swap places them next to each
+ * other and the disk sees a run of sequential requests. */
+static void
+swapd (void *aux UNUSED) {
+	for (;;) {
+		sema_down (&swapd_wake);
+
+		for (;;) {
+			struct frame *victims[EVICT_BATCH];
+			size_t cnt = 0;
+			size_t i, j;
+
+			lock_acquire (&frame_lock);
+			while (free_cnt + cnt < 2 * free_low && cnt < EVICT_BATCH) {
+				struct frame *victim = vm_get_victim ();
+				if (victim == NULL)
+					break;
+				victims[cnt++] = victim;
+			}
+			if (cnt == 0) {
+				swapd_awake = false;
+				lock_release (&frame_lock);
+				break;
+			}
+			lock_release (&frame_lock);
+
+			/* Group by owner, keeping clock order within a group. */
+			for (i = 1; i < cnt; i++)
+				for (j = i; j > 0 && (uintptr_t) frame_owner (victims[j - 1])
+						> (uintptr_t) frame_owner (victims[j]); j--) {
+					struct frame *t = victims[j];
+					victims[j] = victims[j - 1];
+					victims[j - 1] = t;
+				}
+
+			for (i = 0; i < cnt; i++) {
+				frame_write_out (victims[i]);
+				frame_release (victims[i]);
+			}
+
+			lock_acquire (&frame_lock);
+			for (i = 0; i < cnt; i++)
+				frame_free (victims[i]);
+			lock_release (&frame_lock);
+		}
+	}
 }
 
 /* palloc() and get frame. If there is no available page, evict the page
@@ -111,33 +1028,1008 @@ vm_evict_frame (void) {
 static struct frame *
 vm_get_frame (void) {
 	struct frame *frame = NULL;
-	/* TODO: Fill this function. */
+
+	lock_acquire (&frame_lock);
+	if (!list_empty (&free_frames)) {
+		frame = list_entry (list_pop_front (&free_frames), struct frame, elem);
+		frame->pinned = true;
+		free_cnt--;
+	}
+	if (free_cnt < free_low && !swapd_awake) {
+		swapd_awake = true;
+		sema_up (&swapd_wake);
+	}
+	lock_release (&frame_lock);
+
+	/* Nothing free even so: evict one ourselves. */
+	if (frame == NULL)
+		frame = vm_evict_frame ();
 
 	ASSERT (frame != NULL);
-	ASSERT (frame->page == NULL);
+	ASSERT (list_empty (&frame->pages));
 	return frame;
 }
 
-/* Growing the stack. */
+/* Brings PAGE, of the process whose table the caller has locked,
+ * into a frame only if one is free without evicting anything.
+ * For reading ahead: returns false if memory is getting short. */
+bool
+vm_prefetch_page (struct page *page) {
+	struct frame *frame = NULL;
+
+#ifdef EFILESYS
+	if (frame_attach_cached (page)) {
+		page->around = true;
+		return true;
+	}
+#endif
+	lock_acquire (&frame_lock);
+	if (free_cnt > free_low) {
+		frame = list_entry (list_pop_front (&free_frames), struct frame, elem);
+		frame->pinned = true;
+		free_cnt--;
+	}
+	lock_release (&frame_lock);
+
+	if (frame == NULL || !frame_claim (page, frame))
+		return false;
+	page->around = true;
+	return true;
+}
+
+/* Brings PAGE, of the process whose table the caller has locked,
+ * into a frame, evicting another page if need be. */
+bool
+vm_load_page (struct page *page) {
+	return vm_do_claim_page (page);
+}
+
+/* Returns the page cache page that FRAME holds, if any: pages of a
+ * file on disk share the frame with it. */
+struct page *
+vm_frame_cached (struct frame *frame) {
+	struct page *cache;
+
+	lock_acquire (&frame_lock);
+	cache = frame_cache_page (frame);
+	lock_release (&frame_lock);
+	return cache;
+}
+
+/* Clears the dirty bits of every page mapped to FRAME.  Returns true
+ * if any was set, in which case the caller must write FRAME back
+ * after this, so that writes from now on are seen next time. */
+bool
+vm_frame_clean (struct frame *frame) {
+	struct list_elem *e;
+	bool dirty = false;
+
+	lock_acquire (&frame_lock);
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, frame_elem);
+		uint64_t *pml4 = page->owner->pml4;
+
+		if (pml4_is_dirty (pml4, page->va)) {
+			pml4_set_dirty (pml4, page->va, false);
+			dirty = true;
+		}
+	}
+	lock_release (&frame_lock);
+	return dirty;
+}
+
+/* Returns the frame at IDX in the frame table, or a null pointer if
+ * there are fewer frames. */
+struct frame *
+vm_frame_at (size_t idx) {
+	return idx < frame_cnt ? &frames[idx] : NULL;
+}
+
+/* Returns the number of pages on FRAME if it is not pinned and holds
+ * anonymous pages only, else 0.  Sets *MERGED to whether it is a
+ * frame that vm_frame_merge() made. */
+size_t
+vm_frame_anon_pages (struct frame *frame, bool *merged) {
+	size_t cnt = 0;
+
+	lock_acquire (&frame_lock);
+	if (!frame->pinned && frame_anon (frame))
+		cnt = list_size (&frame->pages);
+	if (cnt == 1) {
+		/* Merging would split a huge page: not worth it. */
+		struct page *page = list_entry (list_front (&frame->pages),
+				struct page, frame_elem);
+		if (pml4_is_huge (page->owner->pml4, page->va))
+			cnt = 0;
+	}
+	*merged = frame->merged;
+	lock_release (&frame_lock);
+	return cnt;
+}
+
+/* Moves the pages of DUP to KEEP if both hold the same anonymous
+ * contents, and frees DUP.  Every page on KEEP is then mapped
+ * read-only, so KEEP cannot change until a page writes to it and
+ * page_unshare() gives that page a copy.  Returns the number of
+ * pages moved, or 0 if the frames differ or are busy. */
+size_t
+vm_frame_merge (struct frame *keep, struct frame *dup) {
+	struct list_elem *e;
+	size_t cnt = 0;
+
+	if (keep == dup)
+		return 0;
+
+	lock_acquire (&frame_lock);
+	if (keep->pinned || dup->pinned || !frame_anon (keep) || !frame_anon (dup)
+			|| !lock_owners (keep, NULL)) {
+		lock_release (&frame_lock);
+		return 0;
+	}
+	if (!lock_owners (dup, keep)) {
+		unlock_owners (keep, list_end (&keep->pages), NULL);
+		lock_release (&frame_lock);
+		return 0;
+	}
+	keep->pinned = dup->pinned = true;
+	lock_release (&frame_lock);
+
+	/* Only once no page can write to either frame do equal contents
+	 * stay equal.  Most candidates differ, though: compare first, so
+	 * that those keep their writable mappings. */
+	if (memcmp (keep->kva, dup->kva, PGSIZE) == 0) {
+		for (e = list_begin (&keep->pages); e != list_end (&keep->pages);
+				e = list_next (e))
+			page_map (list_entry (e, struct page, frame_elem), false);
+		for (e = list_begin (&dup->pages); e != list_end (&dup->pages);
+				e = list_next (e))
+			page_map (list_entry (e, struct page, frame_elem), false);
+		if (memcmp (keep->kva, dup->kva, PGSIZE) == 0) {
+			for (e = list_begin (&dup->pages); e != list_end (&dup->pages);
+					e = list_next (e)) {
+				struct page *page = list_entry (e, struct page, frame_elem);
+
+				/* The page table of a mapped page is there already,
+				 * so this cannot fail. */
+				page->frame = keep;
+				page_map (page, false);
+				cnt++;
+			}
+		}
+	}
+
+	lock_acquire (&frame_lock);
+	unlock_owners (dup, list_end (&dup->pages), keep);
+	unlock_owners (keep, list_end (&keep->pages), NULL);
+	if (cnt > 0) {
+		while (!list_empty (&dup->pages))
+			list_push_back (&keep->pages, list_pop_front (&dup->pages));
+		keep->merged = true;
+		frame_free (dup);
+	} else
+		dup->pinned = false;
+	keep->pinned = false;
+	lock_release (&frame_lock);
+	return cnt;
+}
+
+/* Fills *ST with the memory use of the current process.  Its
+ * working set is estimated as its pages on the active list, plus
+ * those on the inactive list used since they were last looked at.
+ * A page is shared if another process maps its frame; the page
+ * cache does not count. */
+void
+vm_stat (struct vmstat *st) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct hash_iterator i;
+
+	memset (st, 0, sizeof *st);
+	lock_acquire (&spt->lock);
+	lock_acquire (&frame_lock);
+	hash_first (&i, &spt->pages);
+	while (hash_next (&i)) {
+		struct page *page = hash_entry (hash_cur (&i), struct page, spt_elem);
+		struct frame *frame = page->frame;
+		size_t sharers;
+
+		if (frame == NULL) {
+			if (page_swapped (page))
+				st->swapped++;
+			continue;
+		}
+		st->resident++;
+		if (VM_TYPE (page->operations->type) == VM_ANON)
+			st->anon++;
+		else if (VM_TYPE (page->operations->type) == VM_FILE)
+			st->file++;
+		sharers = list_size (&frame->pages);
+		if (frame_cache_page (frame) != NULL)
+			sharers--;
+		if (sharers > 1)
+			st->shared++;
+		if (frame->lru == &active_frames) {
+			st->active++;
+			st->working_set++;
+		} else if (frame->referenced
+				|| pml4_is_accessed (page->owner->pml4, page->va))
+			st->working_set++;
+	}
+	st->refaults = spt->refaults;
+	events_copy (&st->events, spt->events);
+	events_copy (&st->sys_events, sys_events);
+	lock_release (&frame_lock);
+	lock_release (&spt->lock);
+}
+
+/* Stores EVENTS, counts by enum vm_event, in *DST. */
+static void
+events_copy (struct vmevents *dst, const size_t *events) {
+	dst->minor_faults = events[VM_MINOR_FAULT];
+	dst->major_faults = events[VM_MAJOR_FAULT];
+	dst->evictions = events[VM_EVICTION];
+	dst->swap_outs = events[VM_SWAP_OUT];
+	dst->writebacks = events[VM_WRITEBACK];
+	dst->around_hits = events[VM_AROUND_HIT];
+}
+
+/* Counts an event of kind EV for process OWNER, if it is not null,
+ * and for the system.  Callers need not hold OWNER's table lock:
+ * the counts are only updated with interrupts off. */
+void
+vm_count_event (struct thread *owner, enum vm_event ev) {
+	enum intr_level old_level = intr_disable ();
+
+	if (owner != NULL)
+		owner->spt.events[ev]++;
+	sys_events[ev]++;
+	intr_set_level (old_level);
+}
+
+/* Prints paging statistics. */
+void
+vm_print_stats (void) {
+	printf ("Paging: %zu minor faults, %zu major faults, %zu evictions\n",
+			sys_events[VM_MINOR_FAULT], sys_events[VM_MAJOR_FAULT],
+			sys_events[VM_EVICTION]);
+	printf ("Paging: %zu swap-outs, %zu writebacks, %zu fault-around hits\n",
+			sys_events[VM_SWAP_OUT], sys_events[VM_WRITEBACK],
+			sys_events[VM_AROUND_HIT]);
+}
+
+/* Unmaps PAGE from its process and releases its frame, if it has
+ * one and no other page shares it.  Page types call this from
+ * their destroy method. */
+void
+vm_free_frame (struct page *page) {
+	struct frame *frame = page->frame;
+	struct page *cache;
+
+	if (frame == NULL) {
+		/* It may still map the zero page. */
+		if (page_maps_zero (page))
+			pml4_clear_page (page->owner->pml4, page->va);
+		return;
+	}
+
+	lock_acquire (&frame_lock);
+	if (page->around && pml4_is_accessed (page->owner->pml4, page->va))
+		vm_count_event (page->owner, VM_AROUND_HIT);
+	pml4_clear_page (page->owner->pml4, page->va);
+	cache = frame_cache_page (frame);
+	if (cache != NULL && cache != page
+			&& pml4_is_dirty (page->owner->pml4, page->va))
+		/* The page cache writes back what this page wrote. */
+		pml4_set_dirty (cache->owner->pml4, cache->va, true);
+	frame_unlink (page);
+	if (list_empty (&frame->pages))
+		frame_free (frame);
+	lock_release (&frame_lock);
+}
+
+/* Takes every page of the user pool into the frame table.  Under VM
+ * user pages come only from here, so nothing else needs the pool. */
+static void
+frame_table_init (void) {
+	void *chain = NULL;
+	void *kva;
+	size_t i;
+
+	lock_init (&frame_lock);
+	list_init (&free_frames);
+
+	/* Thread the pages together through their first word until we
+	 * know how many there are. */
+	while ((kva = palloc_get_page (PAL_USER)) != NULL) {
+		*(void **) kva = chain;
+		chain = kva;
+		frame_cnt++;
+	}
+	if (frame_cnt == 0)
+		PANIC ("no user pages for the frame table");
+
+	frames = calloc (frame_cnt, sizeof *frames);
+	if (frames == NULL)
+		PANIC ("frame table allocation failed");
+	/* The chain runs from the highest page down.  Keep the table in
+	 * address order, so that contiguous frames are next to each
+	 * other for huge pages. */
+	for (i = frame_cnt; i-- > 0;) {
+		frames[i].kva = chain;
+		chain = *(void **) chain;
+		list_init (&frames[i].pages);
+	}
+	for (i = 0; i < frame_cnt; i++)
+		list_push_back (&free_frames, &frames[i].elem);
+	free_cnt = frame_cnt;
+	free_low = frame_cnt / 64 > 4 ? frame_cnt / 64 : 4;
+
+	list_init (&active_frames);
+	list_init (&inactive_frames);
+	inactive_target = frame_cnt / 4;
+	list_init (&ghost_list);
+	if (!hash_init (&ghosts, ghost_hash, ghost_less, NULL))
+		PANIC ("ghost table creation failed");
+}
+
+/* Returns true if any page of FRAME was accessed since the last
+ * call, and clears the accessed bits to start the next round. */
+static bool
+frame_accessed (struct frame *frame) {
+	struct list_elem *e;
+	bool accessed = false;
+
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, frame_elem);
+		uint64_t *pml4 = page->owner->pml4;
+
+		if (pml4_is_accessed (pml4, page->va)) {
+			pml4_set_accessed (pml4, page->va, false);
+			accessed = true;
+			if (page->around) {
+				page->around = false;
+				vm_count_event (page->owner, VM_AROUND_HIT);
+			}
+		}
+	}
+	return accessed;
+}
+
+/* Returns true if any page of FRAME was written since it was
+ * loaded. */
+static bool
+frame_dirty (struct frame *frame) {
+	struct list_elem *e;
+
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, frame_elem);
+		if (pml4_is_dirty (page->owner->pml4, page->va))
+			return true;
+	}
+	return false;
+}
+
+/* Returns true if FRAME holds pages, all of them anonymous. */
+static bool
+frame_anon (struct frame *frame) {
+	struct list_elem *e;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e))
+		if (VM_TYPE (list_entry (e, struct page, frame_elem)->operations->type)
+				!= VM_ANON)
+			return false;
+	return !list_empty (&frame->pages);
+}
+
+/* Locks the page table of every process that maps FRAME, without
+ * waiting: a process that holds its own lock is in the middle of a
+ * fault, and its frames are not worth waiting for.  The current
+ * process's table is already locked if it is faulting, and so are
+ * those of the processes that map EXCEPT, if not null, by an earlier
+ * call.  Returns false, holding no new locks, if any table is
+ * busy. */
+static bool
+lock_owners (struct frame *frame, struct frame *except) {
+	struct list_elem *e;
+
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, frame_elem);
+		struct lock *lock = &page->owner->spt.lock;
+
+		if (page->owner == thread_current () || owner_seen (frame, page)
+				|| (except != NULL && owner_maps (except, page->owner)))
+			continue;
+		if (lock_held_by_current_thread (lock) || !lock_try_acquire (lock)) {
+			unlock_owners (frame, e, except);
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Releases the locks that lock_owners() took for the pages of
+ * FRAME before END. */
 static void
-vm_stack_growth (void *addr UNUSED) {
+unlock_owners (struct frame *frame, struct list_elem *end,
+		struct frame *except) {
+	struct list_elem *e;
+
+	for (e = list_begin (&frame->pages); e != end; e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, frame_elem);
+		if (page->owner != thread_current () && !owner_seen (frame, page)
+				&& (except == NULL || !owner_maps (except, page->owner)))
+			lock_release (&page->owner->spt.lock);
+	}
+}
+
+/* Returns true if a page of FRAME before PAGE has the same owner. */
+static bool
+owner_seen (struct frame *frame, struct page *page) {
+	struct list_elem *e;
+
+	for (e = list_begin (&frame->pages); e != &page->frame_elem;
+			e = list_next (e))
+		if (list_entry (e, struct page, frame_elem)->owner == page->owner)
+			return true;
+	return false;
+}
+
+/* Returns true if a page of FRAME belongs to OWNER. */
+static bool
+owner_maps (struct frame *frame, struct thread *owner) {
+	struct list_elem *e;
+
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e))
+		if (list_entry (e, struct page, frame_elem)->owner == owner)
+			return true;
+	return false;
+}
+
+/* Returns the page cache page on FRAME, or a null pointer. */
+static struct page *
+frame_cache_page (struct frame *frame) {
+	struct list_elem *e;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, frame_elem);
+		if (VM_TYPE (page->operations->type) == VM_PAGE_CACHE)
+			return page;
+	}
+	return NULL;
+}
+
+/* Detaches PAGE from its frame. */
+static void
+frame_unlink (struct page *page) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	list_remove (&page->frame_elem);
+	page->frame = NULL;
+}
+
+/* Takes HUGE_PAGE_CNT free frames, contiguous and aligned for a huge
+ * page, off the free list, pinned.  Returns the first, or a null
+ * pointer if there are none or taking them would leave memory
+ * short. */
+static struct frame *
+huge_alloc (void) {
+	size_t i, j;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	if (free_cnt < 2 * free_low + HUGE_PAGE_CNT)
+		return NULL;
+	for (i = 0; i + HUGE_PAGE_CNT <= frame_cnt; i++) {
+		if (vtop (frames[i].kva) & HUGE_PGMASK)
+			continue;
+		/* Frames on the free list are the unpinned ones without
+		 * pages. */
+		for (j = 0; j < HUGE_PAGE_CNT; j++) {
+			struct frame *frame = &frames[i + j];
+
+			if (frame->kva != (uint8_t *) frames[i].kva + j * PGSIZE
+					|| frame->pinned || !list_empty (&frame->pages))
+				break;
+		}
+		if (j < HUGE_PAGE_CNT)
+			continue;
+
+		for (j = 0; j < HUGE_PAGE_CNT; j++) {
+			list_remove (&frames[i + j].elem);
+			frames[i + j].pinned = true;
+		}
+		free_cnt -= HUGE_PAGE_CNT;
+		return &frames[i];
+	}
+	return NULL;
+}
+
+/* Returns the first page of the huge page around VA. */
+static uint8_t *
+huge_base (const void *va) {
+	return (uint8_t *) ((uintptr_t) va & ~HUGE_PGMASK);
+}
+
+/* Handles the first write to PAGE, one of zeros never written, by
+ * backing the whole huge page around it, if it is all such pages
+ * of one writable anonymous area, with a huge page.  Returns false,
+ * changing nothing, if it is not or no huge page is free. */
+static bool
+huge_claim (struct page *page) {
+	struct supplemental_page_table *spt = &page->owner->spt;
+	struct vma *vma = page->vma;
+	uint8_t *base = huge_base (page->va);
+	struct page *pages[HUGE_PAGE_CNT];
+	struct frame *huge;
+	size_t i;
+
+	if (vma == NULL || VM_TYPE (vma->type) != VM_ANON || !vma->writable
+			|| base < (uint8_t *) vma->start
+			|| base + HUGE_PGSIZE > (uint8_t *) vma->end
+			|| (size_t) (base - (uint8_t *) vma->start) < vma->read_bytes)
+		return false;
+	for (i = 0; i < HUGE_PAGE_CNT; i++) {
+		struct page *p = spt_lookup (spt, base + i * PGSIZE);
+
+		if (p != NULL && (p->frame != NULL || p->vma != vma
+					|| VM_TYPE (p->operations->type) != VM_UNINIT))
+			return false;
+	}
+
+	lock_acquire (&frame_lock);
+	huge = huge_alloc ();
+	lock_release (&frame_lock);
+	if (huge == NULL)
+		return false;
+
+	/* Make every page before filling any, so there is no going back
+	 * after that. */
+	for (i = 0; i < HUGE_PAGE_CNT; i++)
+		if ((pages[i] = spt_find_page (spt, base + i * PGSIZE)) == NULL) {
+			lock_acquire (&frame_lock);
+			for (i = 0; i < HUGE_PAGE_CNT; i++)
+				frame_free (&huge[i]);
+			lock_release (&frame_lock);
+			return false;
+		}
+
+	lock_acquire (&frame_lock);
+	for (i = 0; i < HUGE_PAGE_CNT; i++) {
+		list_push_back (&huge[i].pages, &pages[i]->frame_elem);
+		pages[i]->frame = &huge[i];
+		lru_move (&huge[i], &inactive_frames);
+	}
+	lock_release (&frame_lock);
+
+	/* Pages of zeros: filling them cannot fail. */
+	for (i = 0; i < HUGE_PAGE_CNT; i++)
+		if (!swap_in (pages[i], huge[i].kva))
+			PANIC ("cannot fill page at %p", pages[i]->va);
+	if (!pml4_set_huge_page (page->owner->pml4, base, huge->kva, true)) {
+		/* Map them one by one instead. */
+		for (i = 0; i < HUGE_PAGE_CNT; i++)
+			if (!page_map (pages[i], true))
+				PANIC ("cannot map page at %p", pages[i]->va);
+	}
+
+	lock_acquire (&frame_lock);
+	for (i = 0; i < HUGE_PAGE_CNT; i++)
+		huge[i].pinned = false;
+	lock_release (&frame_lock);
+	return true;
+}
+
+/* Moves the pages in the huge page that starts at the page on FRAME
+ * into a huge page, if they are all resident pages of one writable
+ * anonymous area that no other page shares and a huge page is free.
+ * For a background thread: gives up if the owner is busy.  Returns
+ * true if it collapsed them. */
+bool
+vm_frame_collapse (struct frame *frame) {
+	struct page *page;
+	struct thread *owner;
+	bool success;
+
+	lock_acquire (&frame_lock);
+	if (frame->pinned || list_size (&frame->pages) != 1) {
+		lock_release (&frame_lock);
+		return false;
+	}
+	page = list_entry (list_front (&frame->pages), struct page, frame_elem);
+	owner = page->owner;
+	/* While the page is on the frame, its owner lives. */
+	if (VM_TYPE (page->operations->type) != VM_ANON
+			|| huge_base (page->va) != page->va
+			|| pml4_is_huge (owner->pml4, page->va)
+			|| !lock_try_acquire (&owner->spt.lock)) {
+		lock_release (&frame_lock);
+		return false;
+	}
+	lock_release (&frame_lock);
+
+	success = huge_collapse (&owner->spt, page->va);
+	lock_release (&owner->spt.lock);
+	return success;
+}
+
+/* Does the work of vm_frame_collapse() for the huge page at BASE in
+ * SPT, which the caller has locked. */
+static bool
+huge_collapse (struct supplemental_page_table *spt, uint8_t *base) {
+	struct vma *vma = vma_find (&spt->vmas, base);
+	struct page *pages[HUGE_PAGE_CNT];
+	struct frame *huge;
+	uint64_t *pml4 = spt_owner (spt)->pml4;
+	size_t i;
+
+	if (vma == NULL || VM_TYPE (vma->type) != VM_ANON || !vma->writable
+			|| base + HUGE_PGSIZE > (uint8_t *) vma->end)
+		return false;
+
+	lock_acquire (&frame_lock);
+	for (i = 0; i < HUGE_PAGE_CNT; i++) {
+		struct page *p = spt_lookup (spt, base + i * PGSIZE);
+
+		if (p == NULL || p->frame == NULL || p->frame->pinned
+				|| VM_TYPE (p->operations->type) != VM_ANON
+				|| list_size (&p->frame->pages) != 1)
+			break;
+		pages[i] = p;
+	}
+	huge = i == HUGE_PAGE_CNT ? huge_alloc () : NULL;
+	if (huge != NULL)
+		for (i = 0; i < HUGE_PAGE_CNT; i++)
+			pages[i]->frame->pinned = true;
+	lock_release (&frame_lock);
+	if (huge == NULL)
+		return false;
+
+	/* Unmapped, the pages hold still while they are copied: the
+	 * owner faults and waits for its table lock. */
+	for (i = 0; i < HUGE_PAGE_CNT; i++) {
+		pml4_clear_page (pml4, pages[i]->va);
+		memcpy (huge[i].kva, pages[i]->frame->kva, PGSIZE);
+	}
+
+	lock_acquire (&frame_lock);
+	for (i = 0; i < HUGE_PAGE_CNT; i++) {
+		struct frame *old = pages[i]->frame;
+
+		lru_move (&huge[i], old->lru != NULL ? old->lru : &inactive_frames);
+		frame_unlink (pages[i]);
+		frame_free (old);
+		list_push_back (&huge[i].pages, &pages[i]->frame_elem);
+		pages[i]->frame = &huge[i];
+	}
+	lock_release (&frame_lock);
+
+	if (!pml4_set_huge_page (pml4, base, huge->kva, true))
+		for (i = 0; i < HUGE_PAGE_CNT; i++)
+			if (!page_map (pages[i], true))
+				PANIC ("cannot map page at %p", pages[i]->va);
+
+	lock_acquire (&frame_lock);
+	for (i = 0; i < HUGE_PAGE_CNT; i++)
+		huge[i].pinned = false;
+	lock_release (&frame_lock);
+	return true;
+}
+
+/* Returns true if ADDR, not in any area, looks like an access to
+ * the stack of a process whose stack pointer is RSP: at most 8 bytes
+ * below it, as PUSH writes, and within the largest stack. */
+static bool
+stack_access (void *addr, void *rsp) {
+	return (uint8_t *) addr >= (uint8_t *) rsp - 8
+		&& (uint8_t *) addr < (uint8_t *) USER_STACK
+		&& (uint8_t *) addr >= (uint8_t *) USER_STACK - vm_stack_max;
+}
+
+/* Growing the stack.  Extends the current process's stack area down
+ * to cover ADDR, by at least twice as many pages as last time, and
+ * loads the new pages while frames are free.  A page below the stack
+ * stays unmapped to tell it from the area under it: returns false if
+ * ADDR would take that page, or lies outside any stack.  The caller
+ * holds the process's page table lock. */
+static bool
+vm_stack_growth (void *addr) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	uint8_t *limit = (uint8_t *) USER_STACK - ROUND_UP (vm_stack_max, PGSIZE);
+	struct vma *stack = vma_lower_bound (&spt->vmas, addr);
+	struct vma *below;
+	uint8_t *start, *end, *va;
+	size_t grow;
+
+	ASSERT (lock_held_by_current_thread (&spt->lock));
+
+	if (stack == NULL || !(stack->type & VM_STACK)
+			|| (uint8_t *) addr < limit)
+		return false;
+	end = stack->start;
+
+	grow = spt->stack_grow * 2;
+	if (grow == 0)
+		grow = 1;
+	if (grow > STACK_GROW_MAX)
+		grow = STACK_GROW_MAX;
+	start = pg_round_down (addr);
+	if ((size_t) (end - start) < grow * PGSIZE)
+		start = (size_t) (end - limit) > grow * PGSIZE
+			? end - grow * PGSIZE : limit;
+
+	below = vma_lower_bound (&spt->vmas, start - PGSIZE);
+	if (below != stack) {
+		start = (uint8_t *) below->end + PGSIZE;
+		if ((uint8_t *) addr < start)
+			return false;
+	}
+
+	/* No other area lies in between, so the order of areas holds. */
+	stack->start = start;
+	spt->stack_grow = (end - start) / PGSIZE;
+
+	/* The faulting page is loaded by the caller. */
+	for (va = start; va < end; va += PGSIZE) {
+		struct page *page;
+
+		if (va == pg_round_down (addr))
+			continue;
+		page = spt_find_page (spt, va);
+		if (page == NULL || (page->frame == NULL && !vm_prefetch_page (page)))
+			break;
+	}
+	return true;
+}
+
+/* Grows the current process's stack to cover ADDR, as for a fault
+ * there with stack pointer RSP, for system calls that are handed
+ * user memory.  Returns true if ADDR is then in the stack. */
+bool
+vm_stack_grow (void *addr, void *rsp) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	bool success;
+
+	if (!stack_access (addr, rsp))
+		return false;
+	lock_acquire (&spt->lock);
+	success = vma_find (&spt->vmas, addr) != NULL || vm_stack_growth (addr);
+	lock_release (&spt->lock);
+	return success;
+}
+
+/* Returns true if PAGE would be all zeros when first loaded: an
+ * untouched anonymous page with nothing to read from a file. */
+static bool
+page_is_zero (struct page *page) {
+	if (VM_TYPE (page->operations->type) != VM_UNINIT
+			|| VM_TYPE (page->uninit.type) != VM_ANON)
+		return false;
+	if (page->vma != NULL)
+		return (size_t) ((uint8_t *) page->va - (uint8_t *) page->vma->start)
+			>= page->vma->read_bytes;
+	return page->uninit.init == NULL;
+}
+
+/* Returns true if PAGE is mapped to the zero page. */
+static bool
+page_maps_zero (struct page *page) {
+	return page->frame == NULL
+		&& pml4_get_page (page->owner->pml4, page->va) == zero_page;
 }
 
 /* Handle the fault on write_protected page */
 static bool
-vm_handle_wp (struct page *page UNUSED) {
+vm_handle_wp (struct page *page) {
+	/* First write to a page that has only been read: give it a
+	 * frame of its own. */
+	if (page_maps_zero (page)) {
+		pml4_clear_page (page->owner->pml4, page->va);
+		return huge_claim (page) || vm_do_claim_page (page);
+	}
+	/* First write to a page shared since fork. */
+	if (page->frame != NULL)
+		return page_unshare (page);
+	return false;
 }
 
 /* Return true on success */
 bool
-vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr UNUSED,
-		bool user UNUSED, bool write UNUSED, bool not_present UNUSED) {
-	struct supplemental_page_table *spt UNUSED = &thread_current ()->spt;
-	struct page *page = NULL;
-	/* TODO: Validate the fault */
-	/* TODO: Your code goes here */
+vm_try_handle_fault (struct intr_frame *f, void *addr,
+		bool user, bool write, bool not_present) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	/* In a system call, F holds the kernel's registers. */
+	void *rsp = user ? (void *) f->rsp : thread_current ()->user_rsp;
+	struct page *page;
+	bool success = false;
+	bool major;
 
-	return vm_do_claim_page (page);
+	if (addr == NULL || !is_user_vaddr (addr))
+		return false;
+
+	lock_acquire (&spt->lock);
+	page = spt_find_page (spt, addr);
+	if (page == NULL && not_present && stack_access (addr, rsp)
+			&& vm_stack_growth (addr))
+		page = spt_find_page (spt, addr);
+	major = page != NULL && page->frame == NULL && page_needs_io (page);
+	if (page == NULL || (write && !page->writable))
+		success = false;
+	else if (!not_present)
+		success = write && vm_handle_wp (page);
+	else if (page->frame != NULL)
+		/* Another thread mapped it while we waited for the lock. */
+		success = true;
+	else if (!write && page_is_zero (page))
+		/* Reading memory never written needs no frame. */
+		success = pml4_set_page (page->owner->pml4, page->va, zero_page,
+				false);
+	else if (page_is_zero (page) && huge_claim (page))
+		success = true;
+	else if (page_from_file (page)) {
+		success = vm_do_claim_page (page);
+		if (success)
+			fault_around (page);
+	} else
+		success = vm_do_claim_page (page);
+	if (success)
+		vm_count_event (thread_current (),
+				major ? VM_MAJOR_FAULT : VM_MINOR_FAULT);
+	lock_release (&spt->lock);
+	/* Requests may have found the table busy meanwhile. */
+	prefetch_retry ();
+	return success;
+}
+
+/* Fault-around window, in pages, including the faulting page. */
+#define FAULT_AROUND_MIN 1
+#define FAULT_AROUND_INIT 4
+#define FAULT_AROUND_MAX 32
+
+/* Returns true if PAGE has yet to be loaded from a file. */
+static bool
+page_from_file (struct page *page) {
+	struct vma *vma = page->vma;
+
+	return VM_TYPE (page->operations->type) == VM_UNINIT && vma != NULL
+		&& vma->file != NULL
+		&& (size_t) ((uint8_t *) page->va - (uint8_t *) vma->start)
+			< vma->read_bytes;
+}
+
+/* Called after PAGE was loaded from its file on a fault: loads the
+ * pages that follow it too, up to a window that doubles while the
+ * process faults sequentially and halves when it does not.  Pages
+ * whose file lives in memory are mapped right away; the others are
+ * left to the prefetch thread so that this fault need not wait for
+ * the disk. */
+static void
+fault_around (struct page *page) {
+	struct vma *vma = page->vma;
+	bool in_memory = file_get_inode (vma->file) == NULL;
+	uint8_t *va = page->va;
+	uint8_t *end;
+
+	/* Sequential if it hit the last window, or just past it, unless
+	 * the process said how it will go. */
+	if (vma->advice == MADV_RANDOM)
+		return;
+	if (vma->advice == MADV_SEQUENTIAL) {
+		vma->ra_window = FAULT_AROUND_MAX;
+		drop_behind (page);
+	} else if (vma->ra_window == 0)
+		vma->ra_window = FAULT_AROUND_INIT;
+	else if (va > (uint8_t *) vma->ra_start && va <= (uint8_t *) vma->ra_end)
+		vma->ra_window = vma->ra_window * 2 < FAULT_AROUND_MAX
+			? vma->ra_window * 2 : FAULT_AROUND_MAX;
+	else
+		vma->ra_window = vma->ra_window / 2 > FAULT_AROUND_MIN
+			? vma->ra_window / 2 : FAULT_AROUND_MIN;
+
+	end = va + vma->ra_window * PGSIZE;
+	if (end > (uint8_t *) vma->end || end < va)
+		end = vma->end;
+	vma->ra_start = va;
+	vma->ra_end = end;
+
+	for (va += PGSIZE; va < end; va += PGSIZE) {
+		struct page *next = spt_find_page (&page->owner->spt, va);
+
+		if (next == NULL || next->frame != NULL || !page_from_file (next))
+			continue;
+		if (!in_memory)
+			prefetch_queue (next->owner, va);
+		else if (!vm_prefetch_page (next))
+			break;
+	}
+}
+
+/* In an area read sequentially, a page well behind the one just
+ * faulted on, PAGE, will not be read again soon.  Releases the
+ * frames of the clean file pages one window back, so that they go
+ * before pages still in use; dirty ones are left to eviction,
+ * which writes them back.  A page dropped this way is read again
+ * from its file if it is touched after all. */
+static void
+drop_behind (struct page *page) {
+	struct vma *vma = page->vma;
+	size_t back = FAULT_AROUND_MAX * PGSIZE;
+	uint8_t *start, *end, *va;
+
+	if ((size_t) ((uint8_t *) page->va - (uint8_t *) vma->start) <= back)
+		return;
+	end = (uint8_t *) page->va - back;
+	start = (size_t) (end - (uint8_t *) vma->start) > back
+		? end - back : vma->start;
+
+	for (va = start; va < end; va += PGSIZE) {
+		struct page *old = spt_lookup (&page->owner->spt, va);
+
+		if (old != NULL && old->frame != NULL
+				&& VM_TYPE (old->operations->type) == VM_FILE
+				&& !pml4_is_dirty (old->owner->pml4, old->va))
+			vm_free_frame (old);
+	}
+}
+
+/* MADV_WILLNEED for START...END of VMA: starts loading the pages
+ * there that have contents to load and are not resident.  Those
+ * from a file in memory are loaded at once; the rest are left to
+ * the prefetch thread. */
+static void
+will_need (struct supplemental_page_table *spt, struct vma *vma,
+		uint8_t *start, uint8_t *end) {
+	bool in_memory = vma->file != NULL && file_get_inode (vma->file) == NULL;
+	uint8_t *va;
+
+	for (va = start; va < end; va += PGSIZE) {
+		struct page *page = spt_lookup (spt, va);
+
+		/* Pages never touched only have contents if the area's
+		 * file covers them. */
+		if (page == NULL) {
+			if (vma->file == NULL
+					|| (size_t) (va - (uint8_t *) vma->start) >= vma->read_bytes)
+				continue;
+			page = spt_find_page (spt, va);
+			if (page == NULL)
+				break;
+		}
+		if (page->frame != NULL || page_is_zero (page))
+			continue;
+		if (!in_memory || !page_from_file (page))
+			prefetch_queue (page->owner, va);
+		else if (!vm_prefetch_page (page))
+			break;
+	}
+}
+
+/* MADV_DONTNEED for START...END of VMA: drops the pages there,
+ * writing back modified file pages, but not the locked ones.  The
+ * area remains, so touching a page again starts it afresh, from the
+ * file or as zeros. */
+static void
+dont_need (struct supplemental_page_table *spt, struct vma *vma,
+		uint8_t *start, uint8_t *end) {
+	struct list_elem *e;
+
+	for (e = list_begin (&vma->pages); e != list_end (&vma->pages);) {
+		struct page *page = list_entry (e, struct page, vma_elem);
+
+		e = list_next (e);
+		if ((uint8_t *) page->va >= start && (uint8_t *) page->va < end
+				&& !page->locked)
+			spt_remove_page (spt, page);
+	}
 }
 
 /* Free the page.
@@ -150,41 +2042,333 @@ vm_dealloc_page (struct page *page) {
 
 /* Claim the page that allocate on VA. */
 bool
-vm_claim_page (void *va UNUSED) {
-	struct page *page = NULL;
-	/* TODO: Fill this function */
+vm_claim_page (void *va) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct page *page;
+	bool success = false;
 
-	return vm_do_claim_page (page);
+	lock_acquire (&spt->lock);
+	page = spt_find_page (spt, va);
+	if (page != NULL)
+		success = page->frame != NULL || vm_do_claim_page (page);
+	lock_release (&spt->lock);
+	return success;
 }
 
 /* Claim the PAGE and set up the mmu. */
 static bool
 vm_do_claim_page (struct page *page) {
-	struct frame *frame = vm_get_frame ();
+	page->around = false;
+	ghost_refault (page);
+#ifdef EFILESYS
+	if (frame_attach_cached (page))
+		return true;
+#endif
+	return frame_claim (page, vm_get_frame ());
+}
 
-	/* Set links */
-	frame->page = page;
+#ifdef EFILESYS
+/* Maps PAGE, a page of a file on disk, to the frame in which the
+ * page cache holds that part of the file, so that its process
+ * shares it with read(), write() and other mappings of the file.
+ * Returns false, leaving PAGE without a frame, if the page cache
+ * cannot hold it. */
+static bool
+frame_attach_cached (struct page *page) {
+	struct page *cache = file_backed_cache_get (page);
+	struct frame *frame;
+	bool success;
+
+	if (cache == NULL)
+		return false;
+	frame = cache->frame;
+
+	lock_acquire (&frame_lock);
+	list_push_back (&frame->pages, &page->frame_elem);
 	page->frame = frame;
+	lock_release (&frame_lock);
+
+	/* The frame is filled already, so this only sets up PAGE.  A
+	 * private page may not write to it. */
+	success = swap_in (page, frame->kva)
+		&& pml4_set_page (page->owner->pml4, page->va, frame->kva,
+				page->writable && !(page->vma->type & VM_PRIVATE));
+	if (!success)
+		vm_free_frame (page);
+	page_cache_put (cache, false);
+	return success;
+}
+#endif
+
+/* Fills FRAME, which vm_get_frame() returned, with PAGE and maps it
+ * into PAGE's process. */
+static bool
+frame_claim (struct page *page, struct frame *frame) {
+	bool success;
+
+	ASSERT (lock_held_by_current_thread (&page->owner->spt.lock));
 
-	/* TODO: Insert page table entry to map page's VA to frame's PA. */
+	/* Set links */
+	lock_acquire (&frame_lock);
+	list_push_back (&frame->pages, &page->frame_elem);
+	page->frame = frame;
+	lru_move (frame, &inactive_frames);
+	lock_release (&frame_lock);
 
-	return swap_in (page, frame->kva);
+	/* Fill the frame before the process can see it.  It stays
+	 * pinned until then. */
+	success = swap_in (page, frame->kva)
+		&& pml4_set_page (page->owner->pml4, page->va, frame->kva,
+				page->writable);
+	if (!success)
+		vm_free_frame (page);
+	else
+		frame->pinned = false;
+	return success;
 }
 
 /* Initialize new supplemental page table */
 void
-supplemental_page_table_init (struct supplemental_page_table *spt UNUSED) {
+supplemental_page_table_init (struct supplemental_page_table *spt) {
+	/* SPT->lock lives as long as the thread: see init_thread(). */
+	vma_tree_init (&spt->vmas);
+	spt->swap_next = SWAP_NONE;
+	spt->refaults = 0;
+	spt->stack_grow = 0;
+	spt->locked = 0;
+	spt->lock_future = false;
+	memset (spt->events, 0, sizeof spt->events);
+	if (!hash_init (&spt->pages, page_hash, page_less, NULL))
+		PANIC ("supplemental page table creation failed");
 }
 
 /* Copy supplemental page table from src to dst */
 bool
-supplemental_page_table_copy (struct supplemental_page_table *dst UNUSED,
-		struct supplemental_page_table *src UNUSED) {
+supplemental_page_table_copy (struct supplemental_page_table *dst,
+		struct supplemental_page_table *src) {
+	bool success;
+
+	/* The parent waits for us, but its pages must also stay put
+	 * while they are shared. */
+	lock_acquire (&src->lock);
+	lock_acquire (&dst->lock);
+	success = spt_copy (dst, src);
+	lock_release (&dst->lock);
+	lock_release (&src->lock);
+	return success;
+}
+
+/* Does the work of supplemental_page_table_copy(). */
+static bool
+spt_copy (struct supplemental_page_table *dst,
+		struct supplemental_page_table *src) {
+	struct hash_iterator i;
+	struct vma *vma;
+
+	/* Areas first, so the pages below find their counterparts. */
+	for (vma = vma_first (&src->vmas); vma != NULL;
+			vma = vma_next (&src->vmas, vma)) {
+		struct file *file = NULL;
+		struct vma *copy;
+
+		if (vma->file != NULL && (file = file_reopen (vma->file)) == NULL)
+			return false;
+		copy = vma_create (vma->start, vma->end, vma->type, vma->writable,
+				file, vma->offset, vma->read_bytes, vma->init);
+		if (copy == NULL) {
+			file_close (file);
+			return false;
+		}
+		copy->advice = vma->advice;
+		vma_insert (&dst->vmas, copy);
+	}
+
+	/* Nothing is copied: the child shares every page that has
+	 * contents of its own, resident or in swap, until one side
+	 * writes to it.  Untouched pages of an area, and file pages
+	 * already written back, need nothing: the child's area makes
+	 * them afresh. */
+	hash_first (&i, &src->pages);
+	while (hash_next (&i)) {
+		struct page *page = hash_entry (hash_cur (&i), struct page, spt_elem);
+		enum vm_type type = VM_TYPE (page->operations->type);
+
+		if (type == VM_UNINIT) {
+			if (page->vma != NULL)
+				continue;
+			/* A page made by vm_alloc_page_with_initializer() that
+			 * was never touched: start the child's the same way. */
+			if (!vm_alloc_page_with_initializer (page->uninit.type, page->va,
+						page->writable, page->uninit.init, page->uninit.aux))
+				return false;
+			continue;
+		}
+		if (type == VM_FILE && page->frame == NULL)
+			continue;
+		if (!page_share (dst, page))
+			return false;
+	}
+	return true;
+}
+
+/* Gives the current process, whose table is DST, a page that
+ * shares the contents of SRC: its frame, read-only in both, or its
+ * swap slot. */
+static bool
+page_share (struct supplemental_page_table *dst, struct page *src) {
+	struct page *child = malloc (sizeof *child);
+
+	if (child == NULL)
+		return false;
+	*child = *src;
+	child->owner = thread_current ();
+	/* Locks are not inherited. */
+	child->locked = false;
+	child->around = false;
+	child->frame = NULL;
+	child->vma = src->vma != NULL ? vma_find (&dst->vmas, src->va) : NULL;
+	if (VM_TYPE (src->operations->type) == VM_FILE)
+		child->file.file = child->vma->file;
+	if (!spt_insert_page (dst, child)) {
+		free (child);
+		return false;
+	}
+	if (VM_TYPE (src->operations->type) == VM_ANON)
+		anon_share (child);
+
+	if (src->frame != NULL) {
+		lock_acquire (&frame_lock);
+		list_push_back (&src->frame->pages, &child->frame_elem);
+		child->frame = src->frame;
+		lock_release (&frame_lock);
+
+		if (!page_map (src, false) || !page_map (child, false))
+			return false;
+	}
+	return true;
+}
+
+/* Gives PAGE, which is resident and shared, a frame of its own with
+ * the same contents, mapped writable.  Where the other sharers have
+ * already done so, only the mapping needs to change.  A page of a
+ * private file area is copied off the page cache's frame, too. */
+static bool
+page_unshare (struct page *page) {
+	struct frame *old = page->frame;
+	struct frame *frame;
+	bool shared;
+	bool success;
+
+	lock_acquire (&frame_lock);
+	if (frame_cache_page (old) != NULL
+			&& !(page->vma != NULL && (page->vma->type & VM_PRIVATE))) {
+		/* A file page shares the page cache's frame on purpose:
+		 * it may simply write to it. */
+		lock_release (&frame_lock);
+		return page_map (page, true);
+	}
+	shared = list_size (&old->pages) > 1;
+	if (shared)
+		/* Finding a frame may evict, but not this one. */
+		old->pinned = true;
+	else
+		/* Its contents may change from now on. */
+		old->merged = false;
+	lock_release (&frame_lock);
+	if (!shared)
+		return page_map (page, true);
+
+	frame = vm_get_frame ();
+	memcpy (frame->kva, old->kva, PGSIZE);
+
+	lock_acquire (&frame_lock);
+	list_remove (&page->frame_elem);
+	old->pinned = false;
+	list_push_back (&frame->pages, &page->frame_elem);
+	page->frame = frame;
+	lru_move (frame, &inactive_frames);
+	lock_release (&frame_lock);
+
+	/* A private file page copied from the page cache. */
+	if (VM_TYPE (page->operations->type) == VM_FILE
+			&& (page->vma->type & VM_PRIVATE))
+		anon_adopt (page);
+	success = page_map (page, true);
+	frame->pinned = false;
+	return success;
+}
+
+/* Maps PAGE to its frame in its process, keeping the accessed and
+ * dirty bits of any mapping it replaces. */
+static bool
+page_map (struct page *page, bool writable) {
+	uint64_t *pml4 = page->owner->pml4;
+	bool accessed = pml4_is_accessed (pml4, page->va);
+	bool dirty = pml4_is_dirty (pml4, page->va);
+
+	/* Clearing first drops any stale TLB entry. */
+	pml4_clear_page (pml4, page->va);
+	if (!pml4_set_page (pml4, page->va, page->frame->kva, writable))
+		return false;
+	pml4_set_accessed (pml4, page->va, accessed);
+	pml4_set_dirty (pml4, page->va, dirty);
+	return true;
 }
 
 /* Free the resource hold by the supplemental page table */
 void
-supplemental_page_table_kill (struct supplemental_page_table *spt UNUSED) {
-	/* TODO: Destroy all the supplemental_page_table hold by thread and
-	 * TODO: writeback all the modified contents to the storage. */
+supplemental_page_table_kill (struct supplemental_page_table *spt) {
+	struct vma *vma;
+
+	/* Unmapping an area writes back its modified file pages. */
+	lock_acquire (&spt->lock);
+	prefetch_cancel (spt_owner (spt));
+	while ((vma = vma_first (&spt->vmas)) != NULL)
+		vm_unmap (spt, vma);
+	hash_destroy (&spt->pages, page_destructor);
+	lock_release (&spt->lock);
+}
+
+/* Returns a hash of page E's address. */
+static uint64_t
+page_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct page *page = hash_entry (e, struct page, spt_elem);
+	return hash_bytes (&page->va, sizeof page->va);
+}
+
+/* Returns true if page A precedes page B. */
+static bool
+page_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return hash_entry (a, struct page, spt_elem)->va
+		< hash_entry (b, struct page, spt_elem)->va;
+}
+
+/* Returns a hash of ghost E's owner and address. */
+static uint64_t
+ghost_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct ghost *g = hash_entry (e, struct ghost, elem);
+	return hash_bytes (&g->owner, sizeof g->owner)
+		^ hash_bytes (&g->va, sizeof g->va);
+}
+
+/* Returns true if ghost A precedes ghost B. */
+static bool
+ghost_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct ghost *a = hash_entry (a_, struct ghost, elem);
+	const struct ghost *b = hash_entry (b_, struct ghost, elem);
+
+	if (a->owner != b->owner)
+		return a->owner < b->owner;
+	return a->va < b->va;
+}
+
+/* Frees the page that E belongs to. */
+static void
+page_destructor (struct hash_elem *e, void *aux UNUSED) {
+	struct page *page = hash_entry (e, struct page, spt_elem);
+
+	page_unlock (page);
+	vm_dealloc_page (page);
 }
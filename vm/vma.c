@@ -0,0 +1,243 @@
+/* vma.c: Virtual memory areas of a process.
+ *
+ * The areas of an address space never overlap, so ordering them by
+ * start address also orders them by end address.  They are kept in
+ * an AVL tree, and the area holding a faulting address is found in
+ * O(log n) however many pages the areas span. */
+
+#include "vm/vma.h"
+#include <debug.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/vaddr.h"
+
+static int height (const struct vma *);
+static void update (struct vma *);
+static struct vma *rotate_left (struct vma *);
+static struct vma *rotate_right (struct vma *);
+static struct vma *rebalance (struct vma *);
+static struct vma *insert_node (struct vma *root, struct vma *);
+static struct vma *remove_min (struct vma *root, struct vma **min);
+static struct vma *remove_node (struct vma *root, const struct vma *);
+
+/* Returns a new area for pages START...END, not yet in any tree.
+ * FILE, if any, becomes owned by the area.
+ * Returns a null pointer if memory is exhausted. */
+struct vma *
+vma_create (void *start, void *end, enum vm_type type, bool writable,
+		struct file *file, off_t offset, size_t read_bytes,
+		vm_initializer *init) {
+	struct vma *vma;
+
+	ASSERT (pg_ofs (start) == 0 && pg_ofs (end) == 0);
+	ASSERT (start < end);
+
+	vma = malloc (sizeof *vma);
+	if (vma == NULL)
+		return NULL;
+	*vma = (struct vma) {
+		.start = start,
+		.end = end,
+		.type = type,
+		.writable = writable,
+		.file = file,
+		.offset = offset,
+		.read_bytes = read_bytes,
+		.init = init,
+	};
+	list_init (&vma->pages);
+	return vma;
+}
+
+/* Frees VMA, which must not be in a tree and must have no pages
+ * left, and closes its file. */
+void
+vma_destroy (struct vma *vma) {
+	if (vma != NULL) {
+		ASSERT (list_empty (&vma->pages));
+		file_close (vma->file);
+		free (vma);
+	}
+}
+
+/* Initializes TREE as empty. */
+void
+vma_tree_init (struct vma_tree *tree) {
+	tree->root = NULL;
+	tree->cnt = 0;
+}
+
+/* Inserts VMA into TREE.  Returns false, leaving TREE unchanged, if
+ * VMA overlaps an area already there. */
+bool
+vma_insert (struct vma_tree *tree, struct vma *vma) {
+	if (vma_overlaps (tree, vma->start, vma->end))
+		return false;
+	tree->root = insert_node (tree->root, vma);
+	tree->cnt++;
+	return true;
+}
+
+/* Removes VMA, which must be in TREE, from TREE. */
+void
+vma_remove (struct vma_tree *tree, struct vma *vma) {
+	ASSERT (vma_find (tree, vma->start) == vma);
+	tree->root = remove_node (tree->root, vma);
+	tree->cnt--;
+}
+
+/* Returns the area of TREE that contains VA, or a null pointer if
+ * there is none. */
+struct vma *
+vma_find (struct vma_tree *tree, const void *va) {
+	struct vma *vma = vma_lower_bound (tree, va);
+	return vma != NULL && vma->start <= va ? vma : NULL;
+}
+
+/* Returns the lowest area of TREE that ends above VA, that is,
+ * the area containing VA or else the first one after it, or a null
+ * pointer if there is none. */
+struct vma *
+vma_lower_bound (struct vma_tree *tree, const void *va) {
+	struct vma *node = tree->root;
+	struct vma *best = NULL;
+
+	while (node != NULL) {
+		if (node->end > va) {
+			best = node;
+			node = node->left;
+		} else
+			node = node->right;
+	}
+	return best;
+}
+
+/* Returns true if any area of TREE overlaps START...END. */
+bool
+vma_overlaps (struct vma_tree *tree, const void *start, const void *end) {
+	struct vma *vma = vma_lower_bound (tree, start);
+	return vma != NULL && vma->start < end;
+}
+
+/* Returns the lowest area of TREE, or a null pointer if TREE is
+ * empty. */
+struct vma *
+vma_first (struct vma_tree *tree) {
+	struct vma *node = tree->root;
+
+	if (node != NULL)
+		while (node->left != NULL)
+			node = node->left;
+	return node;
+}
+
+/* Returns the area of TREE that follows VMA, or a null pointer if
+ * VMA is the last one.  VMA need not be in TREE any more, so it is
+ * safe to advance past an area that was just removed. */
+struct vma *
+vma_next (struct vma_tree *tree, const struct vma *vma) {
+	return vma_lower_bound (tree, vma->end);
+}
+
+/* Returns the height of the subtree rooted at NODE. */
+static int
+height (const struct vma *node) {
+	return node != NULL ? node->height : 0;
+}
+
+/* Recomputes NODE's height from its children. */
+static void
+update (struct vma *node) {
+	int l = height (node->left), r = height (node->right);
+	node->height = (l > r ? l : r) + 1;
+}
+
+static struct vma *
+rotate_left (struct vma *node) {
+	struct vma *r = node->right;
+	node->right = r->left;
+	r->left = node;
+	update (node);
+	update (r);
+	return r;
+}
+
+static struct vma *
+rotate_right (struct vma *node) {
+	struct vma *l = node->left;
+	node->left = l->right;
+	l->right = node;
+	update (node);
+	update (l);
+	return l;
+}
+
+/* Restores the AVL balance at NODE, whose subtrees are balanced
+ * and differ in height by at most 2.  Returns the new subtree
+ * root. */
+static struct vma *
+rebalance (struct vma *node) {
+	int balance;
+
+	update (node);
+	balance = height (node->left) - height (node->right);
+	if (balance > 1) {
+		if (height (node->left->left) < height (node->left->right))
+			node->left = rotate_left (node->left);
+		return rotate_right (node);
+	} else if (balance < -1) {
+		if (height (node->right->right) < height (node->right->left))
+			node->right = rotate_right (node->right);
+		return rotate_left (node);
+	}
+	return node;
+}
+
+/* Inserts VMA into the subtree at ROOT and returns its new root. */
+static struct vma *
+insert_node (struct vma *root, struct vma *vma) {
+	if (root == NULL) {
+		vma->left = vma->right = NULL;
+		vma->height = 1;
+		return vma;
+	}
+	if (vma->start < root->start)
+		root->left = insert_node (root->left, vma);
+	else
+		root->right = insert_node (root->right, vma);
+	return rebalance (root);
+}
+
+/* Unlinks the lowest node of the nonempty subtree at ROOT, storing
+ * it in *MIN, and returns the new subtree root. */
+static struct vma *
+remove_min (struct vma *root, struct vma **min) {
+	if (root->left == NULL) {
+		*min = root;
+		return root->right;
+	}
+	root->left = remove_min (root->left, min);
+	return rebalance (root);
+}
+
+/* Removes VMA from the subtree at ROOT and returns its new root. */
+static struct vma *
+remove_node (struct vma *root, const struct vma *vma) {
+	ASSERT (root != NULL);
+
+	if (vma->start < root->start)
+		root->left = remove_node (root->left, vma);
+	else if (vma->start > root->start)
+		root->right = remove_node (root->right, vma);
+	else {
+		struct vma *min;
+
+		if (root->right == NULL)
+			return root->left;
+		root->right = remove_min (root->right, &min);
+		min->left = root->left;
+		min->right = root->right;
+		return rebalance (min);
+	}
+	return rebalance (root);
+}
@@ -0,0 +1,422 @@
+/* zswap.c: Compressed tier in front of the swap disk.
+ *
+ * An anonymous page being evicted is first compressed and kept in
+ * memory, where swapping it back in costs a decompression instead
+ * of a disk read.  Only when the pool is full are the entries that
+ * went in first written out to the swap disk, to make room.
+ *
+ * The pool is laid out as zsmalloc does it: compressed pages are
+ * rounded up to one of a set of size classes, and each class carves
+ * its objects out of slabs of one to four contiguous pages, the
+ * number chosen to waste the least.  Pages that do not shrink below
+ * ZSWAP_MAX_SIZE go straight to disk.
+ *
+ * An entry written out keeps standing for the page, now pointing to
+ * its swap slot, so that the pages referring to it need not know.
+ * After fork, parent and child may share an entry; REFS counts the
+ * pages that refer to it. */
+
+#include "vm/zswap.h"
+#include <debug.h>
+#include <list.h>
+#include <stdint.h>
+#include <string.h>
+#include "vm/vm.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Largest compressed page worth keeping. */
+#define ZSWAP_MAX_SIZE (PGSIZE * 3 / 4)
+
+/* Most kernel pages the pool may take. */
+#define ZSWAP_POOL_PAGES 256
+
+/* Size classes are multiples of CLASS_STEP bytes. */
+#define CLASS_STEP 32
+#define CLASS_CNT (ZSWAP_MAX_SIZE / CLASS_STEP)
+#define SLAB_MAX_PAGES 4
+
+/* Most entries written out to make room for one. */
+#define WRITEBACK_MAX 16
+
+/* A run of pages carved into objects of one class.  Free objects
+ * are chained through their first two bytes. */
+struct slab {
+	struct list_elem elem;      /* Element in class's partial list. */
+	uint8_t *base;              /* First page. */
+	struct size_class *class;
+	unsigned used;              /* Objects in use. */
+	uint16_t free;              /* First free object, or NO_OBJ. */
+};
+
+#define NO_OBJ UINT16_MAX
+
+struct size_class {
+	size_t size;                /* Bytes per object. */
+	size_t pages;               /* Pages per slab. */
+	unsigned objs;              /* Objects per slab. */
+	struct list partial;        /* Slabs with free objects. */
+};
+
+struct zswap_entry {
+	struct list_elem elem;      /* Element in lru, while in memory. */
+	struct slab *slab;          /* Slab holding it, or null on disk. */
+	uint16_t obj;               /* Object within SLAB. */
+	uint16_t len;               /* Compressed size. */
+	size_t slot;                /* Swap slot once written out. */
+	unsigned refs;              /* Pages referring to it. */
+	bool writing;               /* Being written out? */
+};
+
+static struct size_class classes[CLASS_CNT];
+static struct list lru;             /* Entries in memory, oldest first. */
+static size_t pool_pages;           /* Pages taken by slabs. */
+static struct lock zswap_lock;      /* Protects all of the above. */
+
+/* Compressor state, used under ZSWAP_LOCK. */
+#define LZ_HASH_BITS 12
+static uint16_t lz_table[1 << LZ_HASH_BITS];
+static uint8_t lz_out[ZSWAP_MAX_SIZE];
+
+static size_t lz_compress (const uint8_t *, size_t, uint8_t *, size_t);
+static bool lz_decompress (const uint8_t *, size_t, uint8_t *, size_t);
+static uint8_t *obj_addr (struct slab *, uint16_t obj);
+static bool obj_alloc (size_t len, struct slab **, uint16_t *obj);
+static void obj_free (struct slab *, uint16_t obj);
+static bool write_back (void);
+static void entry_free (struct zswap_entry *);
+
+/* Sets up the size classes. */
+void
+zswap_init (void) {
+	size_t i;
+
+	lock_init (&zswap_lock);
+	list_init (&lru);
+	for (i = 0; i < CLASS_CNT; i++) {
+		struct size_class *c = &classes[i];
+		size_t best_waste = SIZE_MAX;
+		size_t pages;
+
+		c->size = (i + 1) * CLASS_STEP;
+		for (pages = 1; pages <= SLAB_MAX_PAGES; pages++) {
+			/* Waste per object, compared across slab sizes. */
+			size_t objs = pages * PGSIZE / c->size;
+			size_t waste = (pages * PGSIZE % c->size) * SLAB_MAX_PAGES / objs;
+
+			if (waste < best_waste) {
+				best_waste = waste;
+				c->pages = pages;
+			}
+		}
+		c->objs = c->pages * PGSIZE / c->size;
+		list_init (&c->partial);
+	}
+}
+
+/* Compresses the page at KVA into the pool, writing older entries
+ * out to disk if the pool is full.  Returns the new entry, with one
+ * reference, or a null pointer if the page does not compress well
+ * or there is no room; it must then go to disk itself. */
+struct zswap_entry *
+zswap_store (const void *kva) {
+	struct zswap_entry *z = malloc (sizeof *z);
+	struct slab *slab = NULL;
+	uint16_t obj;
+	size_t len;
+	int tries;
+
+	if (z == NULL)
+		return NULL;
+
+	lock_acquire (&zswap_lock);
+	len = lz_compress (kva, PGSIZE, lz_out, sizeof lz_out);
+	for (tries = 0; len > 0 && !obj_alloc (len, &slab, &obj); tries++)
+		if (tries == WRITEBACK_MAX || !write_back ()) {
+			slab = NULL;
+			break;
+		}
+	if (len == 0 || slab == NULL) {
+		lock_release (&zswap_lock);
+		free (z);
+		return NULL;
+	}
+
+	/* Writing back dropped the lock, so compress again if another
+	 * store used the buffer meanwhile. */
+	if (tries > 0)
+		len = lz_compress (kva, PGSIZE, lz_out, sizeof lz_out);
+	memcpy (obj_addr (slab, obj), lz_out, len);
+
+	*z = (struct zswap_entry) {
+		.slab = slab,
+		.obj = obj,
+		.len = len,
+		.slot = SWAP_NONE,
+		.refs = 1,
+	};
+	list_push_back (&lru, &z->elem);
+	lock_release (&zswap_lock);
+	return z;
+}
+
+/* Fills the page at KVA with the contents of Z. */
+void
+zswap_load (struct zswap_entry *z, void *kva) {
+	size_t slot;
+
+	lock_acquire (&zswap_lock);
+	slot = z->slot;
+	if (slot == SWAP_NONE
+			&& !lz_decompress (obj_addr (z->slab, z->obj), z->len, kva, PGSIZE))
+		PANIC ("zswap: corrupt entry");
+	lock_release (&zswap_lock);
+
+	if (slot != SWAP_NONE)
+		swap_slot_read (slot, kva);
+}
+
+/* Notes another page referring to Z. */
+void
+zswap_get (struct zswap_entry *z) {
+	lock_acquire (&zswap_lock);
+	z->refs++;
+	lock_release (&zswap_lock);
+}
+
+/* Drops a page's reference to Z, freeing it if it was the last. */
+void
+zswap_put (struct zswap_entry *z) {
+	lock_acquire (&zswap_lock);
+	ASSERT (z->refs > 0);
+	if (--z->refs == 0 && !z->writing)
+		entry_free (z);
+	lock_release (&zswap_lock);
+}
+
+/* Frees Z, which no page refers to, and what holds its contents. */
+static void
+entry_free (struct zswap_entry *z) {
+	ASSERT (lock_held_by_current_thread (&zswap_lock));
+
+	if (z->slab != NULL) {
+		list_remove (&z->elem);
+		obj_free (z->slab, z->obj);
+	} else
+		swap_slot_free (z->slot);
+	free (z);
+}
+
+/* Writes the oldest entry in memory out to the swap disk and frees
+ * its object.  Drops ZSWAP_LOCK while the disk works.  Returns false
+ * if there is nothing to write or no swap space. */
+static bool
+write_back (void) {
+	struct zswap_entry *z;
+	uint8_t *page;
+	size_t slot;
+
+	if (list_empty (&lru) || (page = palloc_get_page (0)) == NULL)
+		return false;
+
+	z = list_entry (list_pop_front (&lru), struct zswap_entry, elem);
+	if (!lz_decompress (obj_addr (z->slab, z->obj), z->len, page, PGSIZE))
+		PANIC ("zswap: corrupt entry");
+	z->writing = true;
+	lock_release (&zswap_lock);
+
+	slot = swap_slot_write (page);
+	palloc_free_page (page);
+
+	lock_acquire (&zswap_lock);
+	z->writing = false;
+	if (slot == SWAP_NONE) {
+		/* Swap is full: it stays in memory. */
+		list_push_front (&lru, &z->elem);
+		if (z->refs == 0)
+			entry_free (z);
+		return false;
+	}
+	obj_free (z->slab, z->obj);
+	z->slab = NULL;
+	z->slot = slot;
+	if (z->refs == 0)
+		entry_free (z);
+	return true;
+}
+
+/* Returns the address of object OBJ of SLAB. */
+static uint8_t *
+obj_addr (struct slab *slab, uint16_t obj) {
+	return slab->base + obj * slab->class->size;
+}
+
+/* Finds room for LEN bytes, storing the slab and object in *SLABP
+ * and *OBJ.  Returns false if the pool is full. */
+static bool
+obj_alloc (size_t len, struct slab **slabp, uint16_t *obj) {
+	struct size_class *c = &classes[(len - 1) / CLASS_STEP];
+	struct slab *slab;
+
+	if (list_empty (&c->partial)) {
+		unsigned i;
+
+		if (pool_pages + c->pages > ZSWAP_POOL_PAGES)
+			return false;
+		slab = malloc (sizeof *slab);
+		if (slab == NULL)
+			return false;
+		slab->base = palloc_get_multiple (0, c->pages);
+		if (slab->base == NULL) {
+			free (slab);
+			return false;
+		}
+		pool_pages += c->pages;
+		slab->class = c;
+		slab->used = 0;
+		slab->free = 0;
+		for (i = 0; i < c->objs; i++)
+			*(uint16_t *) obj_addr (slab, i) = i + 1 < c->objs ? i + 1 : NO_OBJ;
+		list_push_back (&c->partial, &slab->elem);
+	}
+
+	slab = list_entry (list_front (&c->partial), struct slab, elem);
+	*obj = slab->free;
+	slab->free = *(uint16_t *) obj_addr (slab, *obj);
+	if (++slab->used == c->objs)
+		list_remove (&slab->elem);
+	*slabp = slab;
+	return true;
+}
+
+/* Frees object OBJ of SLAB, and SLAB itself once it is empty. */
+static void
+obj_free (struct slab *slab, uint16_t obj) {
+	struct size_class *c = slab->class;
+
+	if (slab->used-- == c->objs)
+		list_push_back (&c->partial, &slab->elem);
+	if (slab->used == 0) {
+		list_remove (&slab->elem);
+		palloc_free_multiple (slab->base, c->pages);
+		pool_pages -= c->pages;
+		free (slab);
+		return;
+	}
+	*(uint16_t *) obj_addr (slab, obj) = slab->free;
+	slab->free = obj;
+}
+
+/* A small LZ77 coder.  The output is a series of items, each
+ * starting with a control byte C:
+ *
+ *   C < 0x80: C + 1 literal bytes follow.
+ *   C >= 0x80: a match of (C & 0x7f) + 3 bytes, copied from the
+ *     output the next two bytes, little-endian, back.
+ *
+ * Matches are found through a hash of the next three bytes, which
+ * is fast and finds the long runs that make pages compressible. */
+#define LZ_MIN_MATCH 3
+#define LZ_MAX_MATCH (0x7f + LZ_MIN_MATCH)
+#define LZ_MAX_LITERAL 0x80
+
+static unsigned
+lz_hash (const uint8_t *p) {
+	uint32_t v = p[0] | p[1] << 8 | (uint32_t) p[2] << 16;
+	return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* Appends the literals IN[START...END) to OUT at *OP.  Returns false
+ * if they do not fit in OUT_MAX bytes. */
+static bool
+lz_literals (const uint8_t *in, size_t start, size_t end, uint8_t *out,
+		size_t *op, size_t out_max) {
+	while (start < end) {
+		size_t n = end - start < LZ_MAX_LITERAL ? end - start : LZ_MAX_LITERAL;
+
+		if (*op + 1 + n > out_max)
+			return false;
+		out[(*op)++] = n - 1;
+		memcpy (out + *op, in + start, n);
+		*op += n;
+		start += n;
+	}
+	return true;
+}
+
+/* Compresses IN_LEN bytes, at most 64 kB, at IN into OUT.  Returns
+ * the compressed size, or 0 if it would exceed OUT_MAX bytes. */
+static size_t
+lz_compress (const uint8_t *in, size_t in_len, uint8_t *out,
+		size_t out_max) {
+	size_t ip = 0, op = 0, lit = 0;
+
+	/* Positions are stored plus one, so zero means none. */
+	memset (lz_table, 0, sizeof lz_table);
+	while (ip + LZ_MIN_MATCH <= in_len) {
+		unsigned h = lz_hash (in + ip);
+		size_t cand = lz_table[h];
+		size_t len;
+
+		lz_table[h] = ip + 1;
+		if (cand == 0 || memcmp (in + cand - 1, in + ip, LZ_MIN_MATCH)) {
+			ip++;
+			continue;
+		}
+		cand--;
+
+		len = LZ_MIN_MATCH;
+		while (ip + len < in_len && len < LZ_MAX_MATCH
+				&& in[cand + len] == in[ip + len])
+			len++;
+
+		if (!lz_literals (in, lit, ip, out, &op, out_max) || op + 3 > out_max)
+			return 0;
+		out[op++] = 0x80 | (len - LZ_MIN_MATCH);
+		out[op++] = (ip - cand) & 0xff;
+		out[op++] = (ip - cand) >> 8;
+		ip += len;
+		lit = ip;
+	}
+	if (!lz_literals (in, lit, in_len, out, &op, out_max))
+		return 0;
+	return op;
+}
+
+/* Decompresses IN_LEN bytes at IN into exactly OUT_LEN bytes at
+ * OUT.  Returns false if IN is not valid. */
+static bool
+lz_decompress (const uint8_t *in, size_t in_len, uint8_t *out,
+		size_t out_len) {
+	size_t ip = 0, op = 0;
+
+	while (ip < in_len) {
+		uint8_t c = in[ip++];
+
+		if (c < 0x80) {
+			size_t n = c + 1;
+
+			if (ip + n > in_len || op + n > out_len)
+				return false;
+			memcpy (out + op, in + ip, n);
+			ip += n;
+			op += n;
+		} else {
+			size_t n = (c & 0x7f) + LZ_MIN_MATCH;
+			size_t dist;
+
+			if (ip + 2 > in_len)
+				return false;
+			dist = in[ip] | in[ip + 1] << 8;
+			ip += 2;
+			if (dist == 0 || dist > op || op + n > out_len)
+				return false;
+			/* Byte by byte: the match may overlap what it makes. */
+			for (; n > 0; n--, op++)
+				out[op] = out[op - dist];
+		}
+	}
+	return op == out_len;
+}